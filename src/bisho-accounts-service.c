@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * bisho --accounts-service: publishes the account cache on the session bus, so
+ * that other desktop components can ask which services are logged in and as
+ * whom without going to the keyring themselves.  The cache file is watched and
+ * AccountChanged is emitted for every service whose entry changes.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <gio/gio.h>
+#include "service-info.h"
+#include "bisho-accounts.h"
+#include "bisho-metrics.h"
+#include "bisho-accounts-service.h"
+
+static const char introspection_xml[] =
+  "<node>"
+  "  <interface name='" BISHO_ACCOUNTS_SERVICE_INTERFACE "'>"
+  "    <method name='ListAccounts'>"
+  "      <arg type='a(sbsx)' name='accounts' direction='out'/>"
+  "    </method>"
+  "    <method name='GetAccount'>"
+  "      <arg type='s' name='service' direction='in'/>"
+  "      <arg type='b' name='logged_in' direction='out'/>"
+  "      <arg type='s' name='user_name' direction='out'/>"
+  "      <arg type='x' name='last_validated' direction='out'/>"
+  "    </method>"
+  "    <signal name='AccountChanged'>"
+  "      <arg type='s' name='service'/>"
+  "      <arg type='b' name='logged_in'/>"
+  "      <arg type='s' name='user_name'/>"
+  "      <arg type='x' name='last_validated'/>"
+  "    </signal>"
+  "  </interface>"
+  "</node>";
+
+typedef struct {
+  gboolean logged_in;
+  char *user_name;
+  glong validated;
+} Account;
+
+static GDBusNodeInfo *introspection = NULL;
+static GDBusConnection *connection = NULL;
+static GMainLoop *loop = NULL;
+/* Hash of service name to the Account last published */
+static GHashTable *accounts = NULL;
+/* The ServiceInfo of every service, parsed once at startup */
+static GList *services = NULL;
+
+static void
+account_free (gpointer data)
+{
+  Account *account = data;
+
+  g_free (account->user_name);
+  g_slice_free (Account, account);
+}
+
+static Account *
+read_account (GKeyFile *keys, const char *service)
+{
+  Account *account;
+
+  account = g_slice_new0 (Account);
+  account->logged_in = bisho_accounts_lookup_in (keys, service, &account->user_name,
+                                                 &account->validated);
+  return account;
+}
+
+static gboolean
+account_equal (const Account *a, const Account *b)
+{
+  return a->logged_in == b->logged_in &&
+    a->validated == b->validated &&
+    g_strcmp0 (a->user_name, b->user_name) == 0;
+}
+
+static void
+emit_changed (const char *service, const Account *account)
+{
+  GError *error = NULL;
+
+  if (connection == NULL)
+    return;
+
+  if (!g_dbus_connection_emit_signal (connection, NULL,
+                                      BISHO_ACCOUNTS_SERVICE_PATH,
+                                      BISHO_ACCOUNTS_SERVICE_INTERFACE,
+                                      "AccountChanged",
+                                      g_variant_new ("(sbsx)", service,
+                                                     account->logged_in,
+                                                     account->user_name ?: "",
+                                                     (gint64) account->validated),
+                                      &error)) {
+    g_message ("Cannot emit AccountChanged: %s", error->message);
+    g_error_free (error);
+  }
+}
+
+/* Re-read the cache, and announce every service that isn't as last published */
+static void
+refresh (void)
+{
+  GKeyFile *keys;
+  GList *l;
+  ServiceInfo *info;
+  Account *old, *account;
+
+  keys = bisho_accounts_load ();
+
+  for (l = services; l; l = l->next) {
+    info = l->data;
+    account = read_account (keys, info->name);
+    old = g_hash_table_lookup (accounts, info->name);
+
+    if (old && account_equal (old, account)) {
+      account_free (account);
+      continue;
+    }
+
+    g_hash_table_insert (accounts, g_strdup (info->name), account);
+    if (old)
+      emit_changed (info->name, account);
+  }
+
+  g_key_file_free (keys);
+}
+
+static void
+cache_changed_cb (GFileMonitor *monitor, GFile *file, GFile *other_file,
+                  GFileMonitorEvent event, gpointer user_data)
+{
+  switch (event) {
+  case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+  case G_FILE_MONITOR_EVENT_CREATED:
+  case G_FILE_MONITOR_EVENT_DELETED:
+    refresh ();
+    break;
+  default:
+    break;
+  }
+}
+
+static GVariant *
+account_to_variant (const char *service, const Account *account)
+{
+  return g_variant_new ("(sbsx)", service, account->logged_in,
+                        account->user_name ?: "", (gint64) account->validated);
+}
+
+static void
+method_call_cb (GDBusConnection *conn, const char *sender,
+                const char *object_path, const char *interface_name,
+                const char *method_name, GVariant *parameters,
+                GDBusMethodInvocation *invocation, gpointer user_data)
+{
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  gpointer key, value;
+  const char *service;
+  Account *account;
+
+  if (strcmp (method_name, "ListAccounts") == 0) {
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sbsx)"));
+    g_hash_table_iter_init (&iter, accounts);
+    while (g_hash_table_iter_next (&iter, &key, &value))
+      g_variant_builder_add_value (&builder, account_to_variant (key, value));
+    g_dbus_method_invocation_return_value (invocation,
+                                           g_variant_new ("(a(sbsx))", &builder));
+  } else if (strcmp (method_name, "GetAccount") == 0) {
+    g_variant_get (parameters, "(&s)", &service);
+    account = g_hash_table_lookup (accounts, service);
+    if (account == NULL) {
+      g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                             G_DBUS_ERROR_INVALID_ARGS,
+                                             "Unknown service %s", service);
+      return;
+    }
+    g_dbus_method_invocation_return_value (invocation,
+                                           g_variant_new ("(bsx)", account->logged_in,
+                                                          account->user_name ?: "",
+                                                          (gint64) account->validated));
+  }
+}
+
+static const GDBusInterfaceVTable vtable = {
+  method_call_cb,
+  NULL,
+  NULL
+};
+
+static void
+bus_acquired_cb (GDBusConnection *conn, const char *name, gpointer user_data)
+{
+  GError *error = NULL;
+
+  if (g_dbus_connection_register_object (conn, BISHO_ACCOUNTS_SERVICE_PATH,
+                                         introspection->interfaces[0],
+                                         &vtable, NULL, NULL, &error) == 0) {
+    g_message ("Cannot register account service: %s", error->message);
+    g_error_free (error);
+    g_main_loop_quit (loop);
+    return;
+  }
+
+  connection = g_object_ref (conn);
+
+  if (!bisho_metrics_register (conn, &error)) {
+    g_message ("Cannot export metrics: %s", error->message);
+    g_error_free (error);
+  }
+}
+
+static void
+name_lost_cb (GDBusConnection *conn, const char *name, gpointer user_data)
+{
+  g_message ("Lost the bus name %s", name);
+  g_main_loop_quit (loop);
+}
+
+int
+bisho_accounts_service_run (void)
+{
+  GFileMonitor *monitor;
+  GFile *file;
+  GError *error = NULL;
+  char *path;
+  guint owner_id;
+
+  introspection = g_dbus_node_info_new_for_xml (introspection_xml, NULL);
+  g_assert (introspection);
+
+  accounts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, account_free);
+  services = service_info_list_all ();
+  refresh ();
+
+  /* Watch the cache before owning the name, so no change is missed */
+  path = bisho_accounts_get_path ();
+  file = g_file_new_for_path (path);
+  monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, &error);
+  if (monitor) {
+    g_signal_connect (monitor, "changed", G_CALLBACK (cache_changed_cb), NULL);
+  } else {
+    g_message ("Cannot watch %s: %s", path, error->message);
+    g_error_free (error);
+  }
+  g_object_unref (file);
+  g_free (path);
+
+  loop = g_main_loop_new (NULL, FALSE);
+
+  bisho_metrics_init ();
+
+  owner_id = g_bus_own_name (G_BUS_TYPE_SESSION, BISHO_ACCOUNTS_SERVICE_NAME,
+                             G_BUS_NAME_OWNER_FLAGS_NONE,
+                             bus_acquired_cb, NULL, name_lost_cb,
+                             NULL, NULL);
+
+  g_main_loop_run (loop);
+
+  g_bus_unown_name (owner_id);
+  if (monitor)
+    g_object_unref (monitor);
+  if (connection)
+    g_object_unref (connection);
+  g_main_loop_unref (loop);
+  g_hash_table_destroy (accounts);
+  g_dbus_node_info_unref (introspection);
+
+  return 0;
+}
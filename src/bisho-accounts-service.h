@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BISHO_ACCOUNTS_SERVICE_H__
+#define __BISHO_ACCOUNTS_SERVICE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define BISHO_ACCOUNTS_SERVICE_NAME "com.intel.Bisho.Accounts"
+#define BISHO_ACCOUNTS_SERVICE_PATH "/com/intel/Bisho/Accounts"
+#define BISHO_ACCOUNTS_SERVICE_INTERFACE "com.intel.Bisho.Accounts"
+
+int bisho_accounts_service_run (void);
+
+G_END_DECLS
+
+#endif /* __BISHO_ACCOUNTS_SERVICE_H__ */
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A cache of what the panes last learnt about each account: the user's name
+ * and when the credentials were last found to work.  It lets bisho --status
+ * answer without talking to the web services.
+ */
+
+#include <config.h>
+#include <glib/gstdio.h>
+#include "bisho-accounts.h"
+#include "bisho-watchdog.h"
+
+char *
+bisho_accounts_get_path (void)
+{
+  return g_build_filename (g_get_user_config_dir (), "bisho", "accounts", NULL);
+}
+
+/* Read the whole cache, to be freed with g_key_file_free() */
+GKeyFile *
+bisho_accounts_load (void)
+{
+  GKeyFile *keys;
+  char *path;
+
+  keys = g_key_file_new ();
+  path = bisho_accounts_get_path ();
+  g_key_file_load_from_file (keys, path, G_KEY_FILE_NONE, NULL);
+  g_free (path);
+
+  return keys;
+}
+
+static void
+save (GKeyFile *keys)
+{
+  char *path, *dir, *data;
+  gsize length;
+  GError *error = NULL;
+
+  path = bisho_accounts_get_path ();
+  dir = g_path_get_dirname (path);
+  g_mkdir_with_parents (dir, 0700);
+
+  data = g_key_file_to_data (keys, &length, NULL);
+  bisho_watchdog_span_begin ("accounts.save");
+  if (!g_file_set_contents (path, data, length, &error)) {
+    g_message ("Cannot write account cache: %s", error->message);
+    g_error_free (error);
+  }
+  bisho_watchdog_span_end ();
+
+  g_free (data);
+  g_free (dir);
+  g_free (path);
+}
+
+/* The credentials for @service have just been seen to work */
+void
+bisho_accounts_validated (const char *service, const char *user_name)
+{
+  GKeyFile *keys;
+  GTimeVal now;
+
+  g_return_if_fail (service);
+
+  g_get_current_time (&now);
+
+  keys = bisho_accounts_load ();
+  if (user_name)
+    g_key_file_set_string (keys, service, "UserName", user_name);
+  g_key_file_set_int64 (keys, service, "LastValidated", now.tv_sec);
+  save (keys);
+  g_key_file_free (keys);
+}
+
+void
+bisho_accounts_forget (const char *service)
+{
+  GKeyFile *keys;
+
+  g_return_if_fail (service);
+
+  keys = bisho_accounts_load ();
+  if (g_key_file_remove_group (keys, service, NULL))
+    save (keys);
+  g_key_file_free (keys);
+}
+
+/*
+ * Returns TRUE if anything is known about @service.  @user_name is set to NULL
+ * if the name isn't known, and should be freed.
+ */
+gboolean
+bisho_accounts_lookup (const char *service, char **user_name, glong *validated)
+{
+  GKeyFile *keys;
+  gboolean ret;
+
+  g_return_val_if_fail (service, FALSE);
+
+  keys = bisho_accounts_load ();
+  ret = bisho_accounts_lookup_in (keys, service, user_name, validated);
+  g_key_file_free (keys);
+
+  return ret;
+}
+
+/* As bisho_accounts_lookup(), in a cache already read by bisho_accounts_load() */
+gboolean
+bisho_accounts_lookup_in (GKeyFile *keys, const char *service,
+                          char **user_name, glong *validated)
+{
+  gboolean ret;
+
+  g_return_val_if_fail (keys, FALSE);
+  g_return_val_if_fail (service, FALSE);
+
+  ret = g_key_file_has_group (keys, service);
+
+  if (user_name)
+    *user_name = ret ? g_key_file_get_string (keys, service, "UserName", NULL) : NULL;
+  if (validated)
+    *validated = ret ? g_key_file_get_int64 (keys, service, "LastValidated", NULL) : 0;
+
+  return ret;
+}
+
+/* The services anything is known about, to be freed with g_strfreev() */
+char **
+bisho_accounts_list (void)
+{
+  GKeyFile *keys;
+  char **services;
+
+  keys = bisho_accounts_load ();
+  services = g_key_file_get_groups (keys, NULL);
+  g_key_file_free (keys);
+
+  return services;
+}
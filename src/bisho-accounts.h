@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BISHO_ACCOUNTS_H__
+#define __BISHO_ACCOUNTS_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+char * bisho_accounts_get_path (void);
+
+void bisho_accounts_validated (const char *service, const char *user_name);
+
+void bisho_accounts_forget (const char *service);
+
+GKeyFile * bisho_accounts_load (void);
+
+gboolean bisho_accounts_lookup (const char *service, char **user_name, glong *validated);
+
+gboolean bisho_accounts_lookup_in (GKeyFile *keys, const char *service,
+                                   char **user_name, glong *validated);
+
+char ** bisho_accounts_list (void);
+
+G_END_DECLS
+
+#endif /* __BISHO_ACCOUNTS_H__ */
@@ -0,0 +1,689 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The steps of each log in protocol, without any user interface.  Every
+ * network step is asynchronous and reports back through a BishoAuthCallback,
+ * so the panes, the benchmarks and anything else can share them.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <gio/gio.h>
+#include <libsoup/soup.h>
+#include <rest/oauth-proxy.h>
+#include <rest/rest-xml-parser.h>
+#include <rest-extras/flickr-proxy.h>
+#include <rest-extras/facebook-proxy.h>
+#include "bisho-auth.h"
+#include "bisho-cassette.h"
+#include "bisho-metrics.h"
+#include "bisho-timeline.h"
+#include "bisho-probes.h"
+
+typedef enum {
+  STEP_OAUTH_REQUEST_TOKEN,
+  STEP_OAUTH_ACCESS_TOKEN,
+  STEP_FLICKR_GET_FROB,
+  STEP_FLICKR_GET_TOKEN,
+  STEP_FLICKR_CHECK_TOKEN,
+  STEP_FACEBOOK_GET_USER,
+  STEP_FACEBOOK_GET_USER_NAME,
+} Step;
+
+/* The names steps are timed under, as auth.SERVICE.STEP */
+static const char *step_names[] = {
+  "request_token",
+  "access_token",
+  "get_frob",
+  "get_token",
+  "check_token",
+  "get_user",
+  "get_user_name",
+};
+
+typedef struct {
+  ServiceInfo *info;
+  Step step;
+  gint64 start;
+  guint event;
+  /* The step is abandoned if this goes away, so librest never sees it */
+  GObject *weak_object;
+  gboolean abandoned;
+  BishoAuthCallback callback;
+  gpointer user_data;
+  /* Frees @user_data if the callback won't be called */
+  GDestroyNotify destroy;
+} StepData;
+
+GQuark
+bisho_auth_error_quark (void)
+{
+  return g_quark_from_static_string ("bisho-auth-error-quark");
+}
+
+static void
+record_step (StepData *data, const GError *error)
+{
+  char *name;
+
+  bisho_timeline_end (data->event, error != NULL);
+  BISHO_PROBE4 (auth__done, data->info->name, step_names[data->step],
+                g_get_monotonic_time () - data->start, error != NULL);
+
+  name = g_strdup_printf ("auth.%s.%s", data->info->name, step_names[data->step]);
+  bisho_metrics_observe_since (name, data->start);
+  g_free (name);
+
+  if (error) {
+    name = g_strdup_printf ("auth.%s.%s.errors", data->info->name, step_names[data->step]);
+    bisho_metrics_count (name);
+    g_free (name);
+  }
+}
+
+static void
+weak_object_gone_cb (gpointer user_data, GObject *where_the_object_was)
+{
+  StepData *data = user_data;
+  GError *error;
+
+  data->weak_object = NULL;
+  data->abandoned = TRUE;
+
+  error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CANCELLED, "Abandoned");
+  record_step (data, error);
+  g_error_free (error);
+}
+
+/*
+ * librest silently drops a call whose weak object is finalized, leaking the
+ * step, so hold the weak reference here and finish the step as abandoned.
+ */
+static StepData *
+step_data_new (ServiceInfo *info, Step step, GObject *weak_object,
+               BishoAuthCallback callback, gpointer user_data,
+               GDestroyNotify destroy)
+{
+  StepData *data;
+
+  data = g_slice_new (StepData);
+  data->info = info;
+  data->step = step;
+  data->start = g_get_monotonic_time ();
+  data->weak_object = weak_object;
+  data->abandoned = FALSE;
+  data->callback = callback;
+  data->user_data = user_data;
+  data->destroy = destroy;
+
+  if (weak_object)
+    g_object_weak_ref (weak_object, weak_object_gone_cb, data);
+
+  data->event = bisho_timeline_begin (info->name, "rest", step_names[step]);
+  BISHO_PROBE2 (auth__start, info->name, step_names[step]);
+
+  return data;
+}
+
+/* Record the step and pass the result on, unless it was abandoned */
+static void
+finish_step (StepData *data, const char *value, const char *user_name,
+             const GError *error)
+{
+  if (data->abandoned) {
+    if (data->destroy)
+      data->destroy (data->user_data);
+    return;
+  }
+
+  record_step (data, error);
+  data->callback (value, user_name, error, data->user_data);
+}
+
+static void
+step_data_free (StepData *data)
+{
+  if (data->weak_object)
+    g_object_weak_unref (data->weak_object, weak_object_gone_cb, data);
+  g_slice_free (StepData, data);
+}
+
+/* Create a proxy for the service, pointed at its BaseURL if it has one */
+RestProxy *
+bisho_auth_new_proxy (ServiceInfo *info)
+{
+  RestProxy *proxy;
+
+  g_return_val_if_fail (info, NULL);
+
+  switch (info->auth) {
+  case AUTH_OAUTH:
+    proxy = oauth_proxy_new (info->oauth.consumer_key,
+                             info->oauth.consumer_secret,
+                             info->oauth.base_url, FALSE);
+    break;
+  case AUTH_FLICKR:
+    proxy = flickr_proxy_new (info->flickr.api_key, info->flickr.shared_secret);
+    if (info->flickr.base_url)
+      g_object_set (proxy, "url-format", info->flickr.base_url, NULL);
+    break;
+  case AUTH_FACEBOOK:
+    proxy = facebook_proxy_new (info->facebook.app_id, info->facebook.secret);
+    if (info->facebook.base_url)
+      g_object_set (proxy, "url-format", info->facebook.base_url, NULL);
+    break;
+  default:
+    return NULL;
+  }
+
+  rest_proxy_set_user_agent (proxy, "Bisho/" VERSION);
+
+  return proxy;
+}
+
+/* Tokens are stored in the keyring as two base64 strings separated by a space */
+char *
+bisho_auth_encode_tokens (const char *token, const char *secret)
+{
+  char *encoded_token, *encoded_secret;
+  char *string;
+
+  g_assert (token);
+  g_assert (secret);
+
+  encoded_token = g_base64_encode ((guchar*)token, strlen (token));
+  encoded_secret = g_base64_encode ((guchar*)secret, strlen (secret));
+
+  string = g_strconcat (encoded_token, " ", encoded_secret, NULL);
+
+  g_free (encoded_token);
+  g_free (encoded_secret);
+
+  return string;
+}
+
+gboolean
+bisho_auth_decode_tokens (const char *string, char **token, char **secret)
+{
+  char **encoded_keys;
+  gboolean ret = FALSE;
+  gsize len;
+
+  g_assert (string);
+  g_assert (token);
+  g_assert (secret);
+
+  encoded_keys = g_strsplit (string, " ", 2);
+
+  if (encoded_keys[0] && encoded_keys[1]) {
+    *token = (char*)g_base64_decode (encoded_keys[0], &len);
+    *secret = (char*)g_base64_decode (encoded_keys[1], &len);
+    ret = TRUE;
+  }
+
+  g_strfreev (encoded_keys);
+
+  return ret;
+}
+
+/* OAuth */
+
+char *
+bisho_auth_oauth_build_authorize_url (ServiceInfo *info, const char *token)
+{
+  SoupURI *base, *uri;
+  char *s;
+
+  g_assert (info);
+  g_assert (token);
+
+  base = soup_uri_new (info->oauth.base_url);
+  uri = soup_uri_new_with_base (base, info->oauth.authorize_function);
+  soup_uri_free (base);
+
+  soup_uri_set_query_from_fields (uri,
+                                  "oauth_token", token,
+                                  "oauth_callback", info->oauth.callback ?: "",
+                                  NULL);
+
+  s = soup_uri_to_string (uri, FALSE);
+  soup_uri_free (uri);
+  return s;
+}
+
+static void
+oauth_cb (OAuthProxy *proxy, const GError *error, GObject *weak_object, gpointer user_data)
+{
+  StepData *data = user_data;
+
+  bisho_cassette_record_token (data->info, proxy,
+                               data->step == STEP_OAUTH_REQUEST_TOKEN ?
+                               data->info->oauth.request_token_function :
+                               data->info->oauth.access_token_function,
+                               error);
+
+  finish_step (data, error ? NULL : oauth_proxy_get_token (proxy), NULL, error);
+  step_data_free (data);
+}
+
+gboolean
+bisho_auth_oauth_request_token (ServiceInfo *info, RestProxy *proxy,
+                                GObject *weak_object,
+                                BishoAuthCallback callback, gpointer user_data,
+                                GError **error)
+{
+  StepData *data;
+
+  g_return_val_if_fail (info && info->auth == AUTH_OAUTH, FALSE);
+  g_return_val_if_fail (OAUTH_IS_PROXY (proxy), FALSE);
+
+  data = step_data_new (info, STEP_OAUTH_REQUEST_TOKEN, weak_object,
+                        callback, user_data, NULL);
+
+  bisho_cassette_begin (proxy);
+  if (!oauth_proxy_request_token_async (OAUTH_PROXY (proxy),
+                                        info->oauth.request_token_function,
+                                        info->oauth.callback,
+                                        oauth_cb, NULL, data, error)) {
+    step_data_free (data);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+gboolean
+bisho_auth_oauth_access_token (ServiceInfo *info, RestProxy *proxy,
+                               const char *verifier,
+                               GObject *weak_object,
+                               BishoAuthCallback callback, gpointer user_data,
+                               GError **error)
+{
+  StepData *data;
+
+  g_return_val_if_fail (info && info->auth == AUTH_OAUTH, FALSE);
+  g_return_val_if_fail (OAUTH_IS_PROXY (proxy), FALSE);
+
+  data = step_data_new (info, STEP_OAUTH_ACCESS_TOKEN, weak_object,
+                        callback, user_data, NULL);
+
+  bisho_cassette_begin (proxy);
+  if (!oauth_proxy_access_token_async (OAUTH_PROXY (proxy),
+                                       info->oauth.access_token_function,
+                                       verifier,
+                                       oauth_cb, NULL, data, error)) {
+    step_data_free (data);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Flickr and Facebook */
+
+static RestXmlNode *
+parse_xml (RestProxyCall *call)
+{
+  static RestXmlParser *parser = NULL;
+
+  if (parser == NULL)
+    parser = rest_xml_parser_new ();
+
+  return rest_xml_parser_parse_from_data (parser,
+                                          rest_proxy_call_get_payload (call),
+                                          rest_proxy_call_get_payload_length (call));
+}
+
+static RestXmlNode *
+get_flickr_xml (RestProxyCall *call, GError **error)
+{
+  RestXmlNode *root, *node;
+
+  root = parse_xml (call);
+
+  if (root == NULL || strcmp (root->name, "rsp") != 0) {
+    g_set_error (error, BISHO_AUTH_ERROR, BISHO_AUTH_ERROR_INVALID_RESPONSE,
+                 "Unexpected response from Flickr:\n%s",
+                 rest_proxy_call_get_payload (call));
+    if (root)
+      rest_xml_node_unref (root);
+    return NULL;
+  }
+
+  if (g_strcmp0 (rest_xml_node_get_attr (root, "stat"), "ok") != 0) {
+    node = rest_xml_node_find (root, "err");
+    g_set_error (error, BISHO_AUTH_ERROR, BISHO_AUTH_ERROR_REFUSED,
+                 "Error from Flickr: %s",
+                 node ? rest_xml_node_get_attr (node, "msg") : "unknown");
+    rest_xml_node_unref (root);
+    return NULL;
+  }
+
+  return root;
+}
+
+static RestXmlNode *
+get_facebook_xml (RestProxyCall *call, GError **error)
+{
+  RestXmlNode *root, *node;
+
+  root = parse_xml (call);
+
+  if (root == NULL) {
+    g_set_error (error, BISHO_AUTH_ERROR, BISHO_AUTH_ERROR_INVALID_RESPONSE,
+                 "Invalid XML from Facebook:\n%s",
+                 rest_proxy_call_get_payload (call));
+    return NULL;
+  }
+
+  if (strcmp (root->name, "error_response") == 0) {
+    node = rest_xml_node_find (root, "error_msg");
+    g_set_error (error, BISHO_AUTH_ERROR, BISHO_AUTH_ERROR_REFUSED,
+                 "Error response from Facebook: %s",
+                 node ? node->content : "unknown");
+    rest_xml_node_unref (root);
+    return NULL;
+  }
+
+  return root;
+}
+
+static const char *
+get_content (RestXmlNode *root, const char *name)
+{
+  RestXmlNode *node;
+
+  node = rest_xml_node_find (root, name);
+  return node ? node->content : NULL;
+}
+
+/* The user's full name if they gave one, otherwise their user name */
+static const char *
+get_flickr_user_name (RestXmlNode *root)
+{
+  RestXmlNode *user;
+  const char *name;
+
+  user = rest_xml_node_find (root, "user");
+  if (user == NULL)
+    return NULL;
+
+  name = rest_xml_node_get_attr (user, "fullname");
+  if (name == NULL || name[0] == '\0')
+    name = rest_xml_node_get_attr (user, "username");
+
+  return name;
+}
+
+static void
+call_cb (RestProxyCall *call, const GError *call_error, GObject *weak_object, gpointer user_data)
+{
+  StepData *data = user_data;
+  RestXmlNode *root = NULL;
+  const char *value = NULL, *user_name = NULL;
+  GError *error = NULL;
+
+  bisho_cassette_record_call (data->info, call);
+
+  if (call_error) {
+    finish_step (data, NULL, NULL, call_error);
+    goto done;
+  }
+
+  if (data->info->auth == AUTH_FLICKR)
+    root = get_flickr_xml (call, &error);
+  else
+    root = get_facebook_xml (call, &error);
+
+  if (root) {
+    switch (data->step) {
+    case STEP_FLICKR_GET_FROB:
+      value = get_content (root, "frob");
+      break;
+    case STEP_FLICKR_GET_TOKEN:
+    case STEP_FLICKR_CHECK_TOKEN:
+      value = get_content (root, "token");
+      user_name = get_flickr_user_name (root);
+      break;
+    case STEP_FACEBOOK_GET_USER:
+      value = root->content;
+      break;
+    case STEP_FACEBOOK_GET_USER_NAME:
+      value = user_name = get_content (root, "name");
+      break;
+    default:
+      g_assert_not_reached ();
+    }
+
+    if (value == NULL) {
+      g_set_error (&error, BISHO_AUTH_ERROR, BISHO_AUTH_ERROR_INVALID_RESPONSE,
+                   "Unexpected response:\n%s", rest_proxy_call_get_payload (call));
+    }
+  }
+
+  if (error) {
+    finish_step (data, NULL, NULL, error);
+    g_error_free (error);
+  } else {
+    finish_step (data, value, user_name, NULL);
+  }
+
+  if (root)
+    rest_xml_node_unref (root);
+
+ done:
+  g_object_unref (call);
+  step_data_free (data);
+}
+
+static gboolean
+start_call (ServiceInfo *info, RestProxyCall *call, Step step,
+            GObject *weak_object, BishoAuthCallback callback, gpointer user_data,
+            GDestroyNotify destroy, GError **error)
+{
+  StepData *data;
+
+  data = step_data_new (info, step, weak_object, callback, user_data, destroy);
+
+  bisho_cassette_begin (call);
+  if (!rest_proxy_call_async (call, call_cb, NULL, data, error)) {
+    g_object_unref (call);
+    step_data_free (data);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+gboolean
+bisho_auth_flickr_get_frob (ServiceInfo *info, RestProxy *proxy,
+                            GObject *weak_object,
+                            BishoAuthCallback callback, gpointer user_data,
+                            GError **error)
+{
+  RestProxyCall *call;
+
+  g_return_val_if_fail (info && info->auth == AUTH_FLICKR, FALSE);
+
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_function (call, "flickr.auth.getFrob");
+
+  return start_call (info, call, STEP_FLICKR_GET_FROB,
+                     weak_object, callback, user_data, NULL, error);
+}
+
+typedef struct {
+  RestProxy *proxy;
+  BishoAuthCallback callback;
+  gpointer user_data;
+} TokenData;
+
+static void
+token_data_free (gpointer user_data)
+{
+  TokenData *data = user_data;
+
+  g_object_unref (data->proxy);
+  g_slice_free (TokenData, data);
+}
+
+static void
+got_flickr_token_cb (const char *value, const char *user_name,
+                     const GError *error, gpointer user_data)
+{
+  TokenData *data = user_data;
+
+  if (value)
+    flickr_proxy_set_token (FLICKR_PROXY (data->proxy), value);
+
+  data->callback (value, user_name, error, data->user_data);
+
+  token_data_free (data);
+}
+
+/* Exchange an authorised frob for a token.  The token is also set on @proxy. */
+gboolean
+bisho_auth_flickr_get_token (ServiceInfo *info, RestProxy *proxy,
+                             const char *frob,
+                             GObject *weak_object,
+                             BishoAuthCallback callback, gpointer user_data,
+                             GError **error)
+{
+  RestProxyCall *call;
+  TokenData *data;
+
+  g_return_val_if_fail (info && info->auth == AUTH_FLICKR, FALSE);
+  g_return_val_if_fail (frob, FALSE);
+
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_function (call, "flickr.auth.getToken");
+  rest_proxy_call_add_param (call, "frob", frob);
+
+  data = g_slice_new (TokenData);
+  data->proxy = g_object_ref (proxy);
+  data->callback = callback;
+  data->user_data = user_data;
+
+  if (!start_call (info, call, STEP_FLICKR_GET_TOKEN,
+                   weak_object, got_flickr_token_cb, data, token_data_free, error)) {
+    token_data_free (data);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Check the token set on @proxy is still valid */
+gboolean
+bisho_auth_flickr_check_token (ServiceInfo *info, RestProxy *proxy,
+                               GObject *weak_object,
+                               BishoAuthCallback callback, gpointer user_data,
+                               GError **error)
+{
+  RestProxyCall *call;
+
+  g_return_val_if_fail (info && info->auth == AUTH_FLICKR, FALSE);
+
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_function (call, "flickr.auth.checkToken");
+
+  return start_call (info, call, STEP_FLICKR_CHECK_TOKEN,
+                     weak_object, callback, user_data, NULL, error);
+}
+
+/* A parser to extract keys and values from the JSON style session */
+GHashTable *
+bisho_auth_facebook_parse_session (const char *session)
+{
+  GHashTable* hashTable = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  char *input = g_strdup (session);
+  char **split_input, **session_vals, *key, *value;
+  int last, i;
+
+  if (input[0] == '{')
+    input[0] = ' ';
+  last = strlen(input)-1;
+  if (input[last] == '}')
+    input[last] = ' ';
+  g_strstrip (input);
+
+  /* Split the string by ," */
+  split_input = g_strsplit (input, ",\"", 0);
+  for (i = 0; split_input[i] != NULL; i++){
+    /* Seperate key and value from "key:value" */
+    session_vals = g_strsplit (split_input[i], ":", 2);
+    if (session_vals[0] != NULL && session_vals[1] != NULL){
+      /* Remove " from the head and the tail */
+      g_strdelimit (session_vals[0], "\"", ' ');
+      g_strstrip (session_vals[0]);
+      g_strdelimit (session_vals[1], "\"", ' ');
+      g_strstrip (session_vals[1]);
+      key = g_strdup (session_vals[0]);
+      value = g_strdup (session_vals[1]);
+
+      /* Insert into the Hashtable */
+      g_hash_table_insert (hashTable, key, value);
+    }
+    /* free the strings */
+    g_strfreev (session_vals);
+  }
+  /* free the strings */
+  g_strfreev (split_input);
+  g_free (input);
+
+  return hashTable;
+}
+
+/* Find the ID of the user the session on @proxy belongs to */
+gboolean
+bisho_auth_facebook_get_user (ServiceInfo *info, RestProxy *proxy,
+                              GObject *weak_object,
+                              BishoAuthCallback callback, gpointer user_data,
+                              GError **error)
+{
+  RestProxyCall *call;
+
+  g_return_val_if_fail (info && info->auth == AUTH_FACEBOOK, FALSE);
+
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_function (call, "users.getLoggedInUser");
+
+  return start_call (info, call, STEP_FACEBOOK_GET_USER,
+                     weak_object, callback, user_data, NULL, error);
+}
+
+gboolean
+bisho_auth_facebook_get_user_name (ServiceInfo *info, RestProxy *proxy,
+                                   const char *uid,
+                                   GObject *weak_object,
+                                   BishoAuthCallback callback, gpointer user_data,
+                                   GError **error)
+{
+  RestProxyCall *call;
+
+  g_return_val_if_fail (info && info->auth == AUTH_FACEBOOK, FALSE);
+  g_return_val_if_fail (uid, FALSE);
+
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_function (call, "users.getInfo");
+  rest_proxy_call_add_param (call, "uids", uid);
+  rest_proxy_call_add_param (call, "fields", "name");
+
+  return start_call (info, call, STEP_FACEBOOK_GET_USER_NAME,
+                     weak_object, callback, user_data, NULL, error);
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BISHO_AUTH_H__
+#define __BISHO_AUTH_H__
+
+#include <rest/rest-proxy.h>
+#include "service-info.h"
+
+G_BEGIN_DECLS
+
+#define BISHO_AUTH_ERROR bisho_auth_error_quark ()
+
+typedef enum {
+  /* The service sent something we couldn't understand */
+  BISHO_AUTH_ERROR_INVALID_RESPONSE,
+  /* The service understood but said no, such as for an expired token */
+  BISHO_AUTH_ERROR_REFUSED,
+} BishoAuthError;
+
+/*
+ * Called when a step finishes.  @value is the step's result, such as a frob,
+ * token or user ID, and @user_name is the user's name if the step learnt it.
+ * Both are NULL if @error is set.  If the step was given a weak object that
+ * has since been finalized, it isn't called at all.
+ */
+typedef void (*BishoAuthCallback) (const char *value,
+                                   const char *user_name,
+                                   const GError *error,
+                                   gpointer user_data);
+
+GQuark bisho_auth_error_quark (void);
+
+RestProxy * bisho_auth_new_proxy (ServiceInfo *info);
+
+char * bisho_auth_encode_tokens (const char *token, const char *secret);
+
+gboolean bisho_auth_decode_tokens (const char *string, char **token, char **secret);
+
+/* OAuth */
+
+char * bisho_auth_oauth_build_authorize_url (ServiceInfo *info, const char *token);
+
+gboolean bisho_auth_oauth_request_token (ServiceInfo *info, RestProxy *proxy,
+                                         GObject *weak_object,
+                                         BishoAuthCallback callback, gpointer user_data,
+                                         GError **error);
+
+gboolean bisho_auth_oauth_access_token (ServiceInfo *info, RestProxy *proxy,
+                                        const char *verifier,
+                                        GObject *weak_object,
+                                        BishoAuthCallback callback, gpointer user_data,
+                                        GError **error);
+
+/* Flickr */
+
+gboolean bisho_auth_flickr_get_frob (ServiceInfo *info, RestProxy *proxy,
+                                     GObject *weak_object,
+                                     BishoAuthCallback callback, gpointer user_data,
+                                     GError **error);
+
+gboolean bisho_auth_flickr_get_token (ServiceInfo *info, RestProxy *proxy,
+                                      const char *frob,
+                                      GObject *weak_object,
+                                      BishoAuthCallback callback, gpointer user_data,
+                                      GError **error);
+
+gboolean bisho_auth_flickr_check_token (ServiceInfo *info, RestProxy *proxy,
+                                        GObject *weak_object,
+                                        BishoAuthCallback callback, gpointer user_data,
+                                        GError **error);
+
+/* Facebook */
+
+GHashTable * bisho_auth_facebook_parse_session (const char *session);
+
+gboolean bisho_auth_facebook_get_user (ServiceInfo *info, RestProxy *proxy,
+                                       GObject *weak_object,
+                                       BishoAuthCallback callback, gpointer user_data,
+                                       GError **error);
+
+gboolean bisho_auth_facebook_get_user_name (ServiceInfo *info, RestProxy *proxy,
+                                            const char *uid,
+                                            GObject *weak_object,
+                                            BishoAuthCallback callback, gpointer user_data,
+                                            GError **error);
+
+G_END_DECLS
+
+#endif /* __BISHO_AUTH_H__ */
@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Records the web service calls the panes make when BISHO_RECORD is set to a
+ * file name, so that a login can be replayed later by bisho-mock-server
+ * --replay.  See bisho-cassette.h for the format.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include <libsoup/soup.h>
+#include "bisho-cassette.h"
+
+#define DATA_START "bisho:cassette-start"
+
+/* Parameters that must never be written out */
+static const char *secret_params[] = {
+  "api_key",
+  "api_sig",
+  "sig",
+  "session_key",
+  "auth_token",
+  "oauth_consumer_key",
+  "oauth_token",
+  "oauth_signature",
+  "oauth_verifier",
+  NULL
+};
+
+static GKeyFile *cassette = NULL;
+static guint n_calls = 0;
+/* Hash of secret value to placeholder */
+static GHashTable *secrets = NULL;
+
+gboolean
+bisho_cassette_is_recording (void)
+{
+  return g_getenv ("BISHO_RECORD") != NULL;
+}
+
+/* Remember when the call (or OAuth proxy request) in @object started */
+void
+bisho_cassette_begin (gpointer object)
+{
+  gint64 *start;
+
+  g_return_if_fail (G_IS_OBJECT (object));
+
+  if (!bisho_cassette_is_recording ())
+    return;
+
+  start = g_new (gint64, 1);
+  *start = g_get_monotonic_time ();
+  g_object_set_data_full (G_OBJECT (object), DATA_START, start, g_free);
+}
+
+static gdouble
+get_elapsed (gpointer object)
+{
+  gint64 *start;
+
+  start = g_object_get_data (G_OBJECT (object), DATA_START);
+  if (start == NULL)
+    return 0.0;
+
+  return (g_get_monotonic_time () - *start) / 1000.0;
+}
+
+static const char *
+redact (const char *value)
+{
+  char *placeholder;
+
+  if (value == NULL || value[0] == '\0')
+    return value;
+
+  placeholder = g_hash_table_lookup (secrets, value);
+  if (placeholder == NULL) {
+    placeholder = g_strdup_printf ("redacted-%u", g_hash_table_size (secrets) + 1);
+    g_hash_table_insert (secrets, g_strdup (value), placeholder);
+  }
+
+  return placeholder;
+}
+
+/* Replace every secret seen so far in @body */
+static char *
+redact_body (const char *body)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  char *ret, *tmp, **split;
+
+  ret = g_strdup (body ?: "");
+
+  g_hash_table_iter_init (&iter, secrets);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    if (strstr (ret, key) == NULL)
+      continue;
+
+    split = g_strsplit (ret, key, -1);
+    tmp = g_strjoinv (value, split);
+    g_strfreev (split);
+    g_free (ret);
+    ret = tmp;
+  }
+
+  return ret;
+}
+
+/* Note a secret that is handed back in an XML element, such as a Flickr token */
+static void
+redact_element (const char *body, const char *element)
+{
+  char *open, *value;
+  const char *start, *end;
+
+  open = g_strdup_printf ("<%s>", element);
+  start = body ? strstr (body, open) : NULL;
+  if (start) {
+    start += strlen (open);
+    end = strchr (start, '<');
+    if (end && end > start) {
+      value = g_strndup (start, end - start);
+      redact (value);
+      g_free (value);
+    }
+  }
+  g_free (open);
+}
+
+static gboolean
+ensure_cassette (ServiceInfo *info)
+{
+  if (!bisho_cassette_is_recording ())
+    return FALSE;
+
+  if (cassette == NULL) {
+    cassette = g_key_file_new ();
+    g_key_file_set_integer (cassette, BISHO_CASSETTE_GROUP, "Version", 1);
+    secrets = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  }
+
+  /* The application's own keys */
+  switch (info->auth) {
+  case AUTH_OAUTH:
+    redact (info->oauth.consumer_key);
+    redact (info->oauth.consumer_secret);
+    break;
+  case AUTH_FLICKR:
+    redact (info->flickr.api_key);
+    redact (info->flickr.shared_secret);
+    break;
+  case AUTH_FACEBOOK:
+    redact (info->facebook.app_id);
+    redact (info->facebook.secret);
+    break;
+  default:
+    break;
+  }
+
+  return TRUE;
+}
+
+static void
+save (void)
+{
+  const char *path;
+  char *data;
+  gsize length;
+  GError *error = NULL;
+
+  path = g_getenv ("BISHO_RECORD");
+
+  g_key_file_set_integer (cassette, BISHO_CASSETTE_GROUP, "Calls", n_calls);
+  data = g_key_file_to_data (cassette, &length, NULL);
+
+  if (g_file_set_contents (path, data, length, &error)) {
+    g_chmod (path, 0600);
+  } else {
+    g_message ("Cannot write cassette: %s", error->message);
+    g_error_free (error);
+  }
+
+  g_free (data);
+}
+
+static void
+add_call (ServiceInfo *info, const char *function, const char *method,
+          const char *params, guint status, gdouble elapsed, const char *body)
+{
+  const char *auth;
+  char *group, *redacted;
+
+  switch (info->auth) {
+  case AUTH_OAUTH:
+    auth = "oauth";
+    break;
+  case AUTH_FLICKR:
+    auth = "flickr";
+    break;
+  case AUTH_FACEBOOK:
+    auth = "facebook";
+    break;
+  default:
+    return;
+  }
+
+  group = g_strdup_printf (BISHO_CASSETTE_CALL_GROUP, n_calls++);
+  g_key_file_set_string (cassette, group, "Service", auth);
+  g_key_file_set_string (cassette, group, "Name", info->name);
+  g_key_file_set_string (cassette, group, "Function", function ?: "");
+  g_key_file_set_string (cassette, group, "Method", method ?: "GET");
+  g_key_file_set_string (cassette, group, "Params", params ?: "");
+  g_key_file_set_integer (cassette, group, "Status", status);
+  g_key_file_set_double (cassette, group, "Elapsed", elapsed);
+
+  redacted = redact_body (body);
+  g_key_file_set_string (cassette, group, "Body", redacted);
+  g_free (redacted);
+
+  g_free (group);
+
+  save ();
+}
+
+/* Record a finished REST call.  Call this before the call is unreffed. */
+void
+bisho_cassette_record_call (ServiceInfo *info, RestProxyCall *call)
+{
+  GHashTable *params, *redacted;
+  GHashTableIter iter;
+  gpointer key, value;
+  const char *function;
+  char *encoded, *body;
+  int i;
+
+  g_return_if_fail (info);
+  g_return_if_fail (REST_IS_PROXY_CALL (call));
+
+  if (!ensure_cassette (info))
+    return;
+
+  params = rest_proxy_call_get_params (call);
+  redacted = g_hash_table_new (g_str_hash, g_str_equal);
+
+  g_hash_table_iter_init (&iter, params);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    for (i = 0; secret_params[i]; i++) {
+      if (strcmp (key, secret_params[i]) == 0) {
+        value = (gpointer) redact (value);
+        break;
+      }
+    }
+    g_hash_table_insert (redacted, key, value);
+  }
+
+  /* Flickr and Facebook pass the function as the "method" parameter */
+  function = g_hash_table_lookup (params, "method");
+  encoded = soup_form_encode_hash (redacted);
+
+  body = g_strndup (rest_proxy_call_get_payload (call),
+                    rest_proxy_call_get_payload_length (call));
+  redact_element (body, "token");
+
+  add_call (info, function, rest_proxy_call_get_method (call), encoded,
+            rest_proxy_call_get_status_code (call), get_elapsed (call), body);
+
+  g_free (body);
+  g_free (encoded);
+  g_hash_table_destroy (redacted);
+}
+
+/*
+ * Record an OAuth token request.  The proxy doesn't give us the response, so
+ * build the equivalent from the token it now holds.
+ */
+void
+bisho_cassette_record_token (ServiceInfo *info, OAuthProxy *proxy,
+                             const char *function, const GError *error)
+{
+  char *body;
+  guint status;
+
+  g_return_if_fail (info);
+  g_return_if_fail (OAUTH_IS_PROXY (proxy));
+
+  if (!ensure_cassette (info))
+    return;
+
+  if (error) {
+    status = error->domain == REST_PROXY_ERROR && error->code >= 100 ? error->code : 0;
+    body = g_strdup (error->message);
+  } else {
+    status = SOUP_STATUS_OK;
+    body = g_strdup_printf ("oauth_token=%s&oauth_token_secret=%s%s",
+                            redact (oauth_proxy_get_token (proxy)),
+                            redact (oauth_proxy_get_token_secret (proxy)),
+                            oauth_proxy_is_oauth10a (proxy) ?
+                            "&oauth_callback_confirmed=true" : "");
+  }
+
+  add_call (info, function, "POST", NULL, status, get_elapsed (proxy), body);
+
+  g_free (body);
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BISHO_CASSETTE_H__
+#define __BISHO_CASSETTE_H__
+
+#include <rest/rest-proxy-call.h>
+#include <rest/oauth-proxy.h>
+#include "service-info.h"
+
+G_BEGIN_DECLS
+
+/*
+ * A cassette is a key file with a [Cassette] group and one [Call N] group per
+ * request, numbered from zero in the order the calls finished:
+ *
+ *   Service  the auth type: oauth, flickr or facebook
+ *   Name     the service the call was made for
+ *   Function the REST function, or the OAuth token endpoint
+ *   Method   the HTTP method
+ *   Params   the request parameters, form encoded
+ *   Status   the HTTP status, or 0 if there was no response
+ *   Elapsed  milliseconds between starting the call and the response
+ *   Body     the response
+ *
+ * Keys, signatures and tokens are replaced with placeholders, the same
+ * placeholder wherever a value is seen, so replayed flows stay consistent.
+ */
+
+#define BISHO_CASSETTE_GROUP "Cassette"
+#define BISHO_CASSETTE_CALL_GROUP "Call %u"
+
+gboolean bisho_cassette_is_recording (void);
+
+void bisho_cassette_begin (gpointer object);
+
+void bisho_cassette_record_call (ServiceInfo *info, RestProxyCall *call);
+
+void bisho_cassette_record_token (ServiceInfo *info, OAuthProxy *proxy,
+                                  const char *function, const GError *error);
+
+G_END_DECLS
+
+#endif /* __BISHO_CASSETTE_H__ */
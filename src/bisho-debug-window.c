@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * A window showing the timeline of each pane's last login flow, see
+ * bisho-timeline.c.  It is opened with Ctrl+Shift+D, or at startup when
+ * BISHO_DEBUG contains "timeline".
+ */
+
+#include <config.h>
+#include <glib/gi18n.h>
+#include "bisho-debug-window.h"
+#include "bisho-timeline.h"
+
+/* How often running events are redrawn, in milliseconds */
+#define REFRESH_INTERVAL 500
+
+struct _BishoDebugWindowPrivate {
+  GtkTextBuffer *buffer;
+  guint refresh_id;
+};
+
+#define GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), BISHO_TYPE_DEBUG_WINDOW, BishoDebugWindowPrivate))
+
+G_DEFINE_TYPE (BishoDebugWindow, bisho_debug_window, GTK_TYPE_WINDOW);
+
+static void
+refresh (BishoDebugWindow *window)
+{
+  char *text;
+
+  text = bisho_timeline_to_text (NULL);
+  gtk_text_buffer_set_text (window->priv->buffer, text, -1);
+  g_free (text);
+}
+
+static void
+timeline_changed_cb (const char *service, gpointer user_data)
+{
+  refresh (BISHO_DEBUG_WINDOW (user_data));
+}
+
+static gboolean
+refresh_cb (gpointer user_data)
+{
+  refresh (BISHO_DEBUG_WINDOW (user_data));
+  return TRUE;
+}
+
+static void
+copy_clicked_cb (GtkButton *button, gpointer user_data)
+{
+  char *text;
+
+  text = bisho_timeline_to_text (NULL);
+  gtk_clipboard_set_text (gtk_widget_get_clipboard (GTK_WIDGET (button), GDK_SELECTION_CLIPBOARD),
+                          text, -1);
+  g_free (text);
+}
+
+static void
+close_clicked_cb (GtkButton *button, gpointer user_data)
+{
+  gtk_widget_destroy (GTK_WIDGET (user_data));
+}
+
+static void
+bisho_debug_window_dispose (GObject *object)
+{
+  BishoDebugWindow *window = BISHO_DEBUG_WINDOW (object);
+
+  if (window->priv->refresh_id) {
+    bisho_timeline_set_notify (NULL, NULL);
+    g_source_remove (window->priv->refresh_id);
+    window->priv->refresh_id = 0;
+  }
+
+  G_OBJECT_CLASS (bisho_debug_window_parent_class)->dispose (object);
+}
+
+static void
+bisho_debug_window_class_init (BishoDebugWindowClass *klass)
+{
+  GObjectClass *o_class = G_OBJECT_CLASS (klass);
+
+  g_type_class_add_private (klass, sizeof (BishoDebugWindowPrivate));
+
+  o_class->dispose = bisho_debug_window_dispose;
+}
+
+static void
+bisho_debug_window_init (BishoDebugWindow *self)
+{
+  GtkWidget *box, *scrolled, *view, *buttons, *button;
+  PangoFontDescription *font;
+
+  self->priv = GET_PRIVATE (self);
+
+  gtk_window_set_title (GTK_WINDOW (self), _("Login Timeline"));
+  gtk_window_set_default_size (GTK_WINDOW (self), 800, 400);
+
+  box = gtk_vbox_new (FALSE, 8);
+  gtk_container_set_border_width (GTK_CONTAINER (box), 8);
+  gtk_container_add (GTK_CONTAINER (self), box);
+
+  scrolled = gtk_scrolled_window_new (NULL, NULL);
+  gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolled),
+                                  GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+  gtk_scrolled_window_set_shadow_type (GTK_SCROLLED_WINDOW (scrolled), GTK_SHADOW_IN);
+  gtk_box_pack_start (GTK_BOX (box), scrolled, TRUE, TRUE, 0);
+
+  view = gtk_text_view_new ();
+  gtk_text_view_set_editable (GTK_TEXT_VIEW (view), FALSE);
+  gtk_text_view_set_cursor_visible (GTK_TEXT_VIEW (view), FALSE);
+  font = pango_font_description_from_string ("Monospace");
+  gtk_widget_modify_font (view, font);
+  pango_font_description_free (font);
+  gtk_container_add (GTK_CONTAINER (scrolled), view);
+  self->priv->buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (view));
+
+  buttons = gtk_hbutton_box_new ();
+  gtk_button_box_set_layout (GTK_BUTTON_BOX (buttons), GTK_BUTTONBOX_END);
+  gtk_box_set_spacing (GTK_BOX (buttons), 8);
+  gtk_box_pack_start (GTK_BOX (box), buttons, FALSE, FALSE, 0);
+
+  button = gtk_button_new_from_stock (GTK_STOCK_COPY);
+  g_signal_connect (button, "clicked", G_CALLBACK (copy_clicked_cb), self);
+  gtk_container_add (GTK_CONTAINER (buttons), button);
+
+  button = gtk_button_new_from_stock (GTK_STOCK_CLOSE);
+  g_signal_connect (button, "clicked", G_CALLBACK (close_clicked_cb), self);
+  gtk_container_add (GTK_CONTAINER (buttons), button);
+
+  gtk_widget_show_all (box);
+
+  refresh (self);
+  bisho_timeline_set_notify (timeline_changed_cb, self);
+  self->priv->refresh_id = g_timeout_add (REFRESH_INTERVAL, refresh_cb, self);
+}
+
+GtkWidget *
+bisho_debug_window_new (void)
+{
+  return g_object_new (BISHO_TYPE_DEBUG_WINDOW, NULL);
+}
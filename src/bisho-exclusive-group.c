@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Keeps at most one of a set of expanding items open.  Only the open item is
+ * remembered, through a weak pointer, so expanding an item collapses just the
+ * previous one, and items can be destroyed at any time without telling the
+ * group.
+ */
+
+#include <config.h>
+#include "bisho-exclusive-group.h"
+
+struct _BishoExclusiveGroupPrivate {
+  MuxExpandingItem *active;
+};
+
+#define GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), BISHO_TYPE_EXCLUSIVE_GROUP, BishoExclusiveGroupPrivate))
+
+G_DEFINE_TYPE (BishoExclusiveGroup, bisho_exclusive_group, G_TYPE_OBJECT);
+
+static void
+set_active (BishoExclusiveGroup *group, MuxExpandingItem *item)
+{
+  BishoExclusiveGroupPrivate *priv = group->priv;
+
+  if (priv->active)
+    g_object_remove_weak_pointer (G_OBJECT (priv->active), (gpointer *)&priv->active);
+
+  priv->active = item;
+
+  if (priv->active)
+    g_object_add_weak_pointer (G_OBJECT (priv->active), (gpointer *)&priv->active);
+}
+
+static void
+expanded_cb (GObject *object, GParamSpec *param_spec, gpointer user_data)
+{
+  BishoExclusiveGroup *group = BISHO_EXCLUSIVE_GROUP (user_data);
+  MuxExpandingItem *item = MUX_EXPANDING_ITEM (object);
+  MuxExpandingItem *previous;
+
+  if (mux_expanding_item_get_active (item)) {
+    previous = group->priv->active;
+    if (previous == item)
+      return;
+
+    set_active (group, item);
+
+    /* This notifies again, but the item is no longer the active one */
+    if (previous)
+      mux_expanding_item_set_active (previous, FALSE);
+  } else if (group->priv->active == item) {
+    set_active (group, NULL);
+  }
+}
+
+static void
+bisho_exclusive_group_dispose (GObject *object)
+{
+  set_active (BISHO_EXCLUSIVE_GROUP (object), NULL);
+
+  G_OBJECT_CLASS (bisho_exclusive_group_parent_class)->dispose (object);
+}
+
+static void
+bisho_exclusive_group_class_init (BishoExclusiveGroupClass *klass)
+{
+  GObjectClass *o_class = G_OBJECT_CLASS (klass);
+
+  g_type_class_add_private (klass, sizeof (BishoExclusiveGroupPrivate));
+
+  o_class->dispose = bisho_exclusive_group_dispose;
+}
+
+static void
+bisho_exclusive_group_init (BishoExclusiveGroup *self)
+{
+  self->priv = GET_PRIVATE (self);
+}
+
+BishoExclusiveGroup *
+bisho_exclusive_group_new (void)
+{
+  return g_object_new (BISHO_TYPE_EXCLUSIVE_GROUP, NULL);
+}
+
+/*
+ * Add @item to the group.  The group doesn't hold a reference, and the
+ * handler is disconnected when either the item or the group goes away.
+ */
+void
+bisho_exclusive_group_add (BishoExclusiveGroup *group, MuxExpandingItem *item)
+{
+  g_return_if_fail (BISHO_IS_EXCLUSIVE_GROUP (group));
+  g_return_if_fail (MUX_IS_EXPANDING_ITEM (item));
+
+  g_signal_connect_object (item, "notify::expanded", G_CALLBACK (expanded_cb), group, 0);
+
+  if (mux_expanding_item_get_active (item))
+    expanded_cb (G_OBJECT (item), NULL, group);
+}
+
+/* Returns the item that is open, or NULL */
+MuxExpandingItem *
+bisho_exclusive_group_get_active (BishoExclusiveGroup *group)
+{
+  g_return_val_if_fail (BISHO_IS_EXCLUSIVE_GROUP (group), NULL);
+
+  return group->priv->active;
+}
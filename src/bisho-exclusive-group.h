@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __BISHO_EXCLUSIVE_GROUP_H__
+#define __BISHO_EXCLUSIVE_GROUP_H__
+
+#include <glib-object.h>
+#include "mux-expanding-item.h"
+
+G_BEGIN_DECLS
+
+#define BISHO_TYPE_EXCLUSIVE_GROUP                                      \
+   (bisho_exclusive_group_get_type())
+#define BISHO_EXCLUSIVE_GROUP(obj)                                      \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj),                                   \
+                               BISHO_TYPE_EXCLUSIVE_GROUP,              \
+                               BishoExclusiveGroup))
+#define BISHO_EXCLUSIVE_GROUP_CLASS(klass)                              \
+  (G_TYPE_CHECK_CLASS_CAST ((klass),                                    \
+                            BISHO_TYPE_EXCLUSIVE_GROUP,                 \
+                            BishoExclusiveGroupClass))
+#define BISHO_IS_EXCLUSIVE_GROUP(obj)                                   \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj),                                   \
+                               BISHO_TYPE_EXCLUSIVE_GROUP))
+#define BISHO_IS_EXCLUSIVE_GROUP_CLASS(klass)                           \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass),                                    \
+                            BISHO_TYPE_EXCLUSIVE_GROUP))
+#define BISHO_EXCLUSIVE_GROUP_GET_CLASS(obj)                            \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj),                                    \
+                              BISHO_TYPE_EXCLUSIVE_GROUP,               \
+                              BishoExclusiveGroupClass))
+
+typedef struct _BishoExclusiveGroupPrivate BishoExclusiveGroupPrivate;
+typedef struct _BishoExclusiveGroup      BishoExclusiveGroup;
+typedef struct _BishoExclusiveGroupClass BishoExclusiveGroupClass;
+
+struct _BishoExclusiveGroup {
+  GObject parent;
+  BishoExclusiveGroupPrivate *priv;
+};
+
+struct _BishoExclusiveGroupClass {
+  GObjectClass parent_class;
+};
+
+GType bisho_exclusive_group_get_type (void) G_GNUC_CONST;
+
+BishoExclusiveGroup * bisho_exclusive_group_new (void);
+
+void bisho_exclusive_group_add (BishoExclusiveGroup *group, MuxExpandingItem *item);
+
+MuxExpandingItem * bisho_exclusive_group_get_active (BishoExclusiveGroup *group);
+
+G_END_DECLS
+
+#endif /* __BISHO_EXCLUSIVE_GROUP_H__ */
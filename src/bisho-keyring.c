@@ -0,0 +1,447 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The credentials Mojito reads for each service.  They normally live in the
+ * GNOME keyring, but if BISHO_KEYRING_FILE is set they are kept in that key
+ * file instead, so that the panes can be driven without a keyring daemon.
+ */
+
+#include <config.h>
+#include <glib.h>
+#include <gnome-keyring.h>
+#include "bisho-keyring.h"
+#include "bisho-metrics.h"
+#include "bisho-watchdog.h"
+#include "bisho-timeline.h"
+#include "bisho-probes.h"
+
+#define FLICKR_SERVER "http://flickr.com/"
+#define FACEBOOK_SERVER "http://facebook.com/"
+
+/* TODO: use mojito-keyring */
+static const GnomeKeyringPasswordSchema oauth_schema = {
+  GNOME_KEYRING_ITEM_GENERIC_SECRET,
+  {
+    { "server", GNOME_KEYRING_ATTRIBUTE_TYPE_STRING },
+    { "consumer-key", GNOME_KEYRING_ATTRIBUTE_TYPE_STRING },
+    { NULL, 0 }
+  }
+};
+
+static const GnomeKeyringPasswordSchema api_key_schema = {
+  GNOME_KEYRING_ITEM_GENERIC_SECRET,
+  {
+    { "server", GNOME_KEYRING_ATTRIBUTE_TYPE_STRING },
+    { "api-key", GNOME_KEYRING_ATTRIBUTE_TYPE_STRING },
+    { NULL, 0 }
+  }
+};
+
+typedef struct {
+  const GnomeKeyringPasswordSchema *schema;
+  const char *server;
+  const char *key_name;
+  const char *key;
+} Attributes;
+
+static gboolean
+get_attributes (ServiceInfo *info, Attributes *attrs)
+{
+  switch (info->auth) {
+  case AUTH_OAUTH:
+    attrs->schema = &oauth_schema;
+    attrs->server = info->oauth.base_url;
+    attrs->key_name = "consumer-key";
+    attrs->key = info->oauth.consumer_key;
+    return TRUE;
+  case AUTH_FLICKR:
+    attrs->schema = &api_key_schema;
+    attrs->server = FLICKR_SERVER;
+    attrs->key_name = "api-key";
+    attrs->key = info->flickr.api_key;
+    return TRUE;
+  case AUTH_FACEBOOK:
+    attrs->schema = &api_key_schema;
+    attrs->server = FACEBOOK_SERVER;
+    attrs->key_name = "api-key";
+    attrs->key = info->facebook.app_id;
+    return TRUE;
+  default:
+    return FALSE;
+  }
+}
+
+/* Key file backend */
+
+typedef struct {
+  GnomeKeyringOperationGetStringCallback find_callback;
+  GnomeKeyringOperationDoneCallback done_callback;
+  GnomeKeyringResult result;
+  char *secret;
+  gpointer user_data;
+} Reply;
+
+static gboolean
+reply_cb (gpointer data)
+{
+  Reply *reply = data;
+
+  if (reply->find_callback)
+    reply->find_callback (reply->result, reply->secret, reply->user_data);
+  else
+    reply->done_callback (reply->result, reply->user_data);
+
+  g_free (reply->secret);
+  g_slice_free (Reply, reply);
+
+  return FALSE;
+}
+
+/* Call back from the main loop, like the keyring daemon would */
+static void
+reply_later (GnomeKeyringOperationGetStringCallback find_callback,
+             GnomeKeyringOperationDoneCallback done_callback,
+             GnomeKeyringResult result, char *secret, gpointer user_data)
+{
+  Reply *reply;
+
+  reply = g_slice_new0 (Reply);
+  reply->find_callback = find_callback;
+  reply->done_callback = done_callback;
+  reply->result = result;
+  reply->secret = secret;
+  reply->user_data = user_data;
+
+  g_idle_add (reply_cb, reply);
+}
+
+static char *
+get_group (Attributes *attrs)
+{
+  return g_strdup_printf ("%s %s=%s", attrs->server, attrs->key_name, attrs->key);
+}
+
+static GKeyFile *
+load_file (const char *path)
+{
+  GKeyFile *keys;
+
+  keys = g_key_file_new ();
+  g_key_file_load_from_file (keys, path, G_KEY_FILE_NONE, NULL);
+
+  return keys;
+}
+
+static GnomeKeyringResult
+save_file (GKeyFile *keys, const char *path)
+{
+  char *data;
+  gsize length;
+  gboolean ret;
+
+  data = g_key_file_to_data (keys, &length, NULL);
+  ret = g_file_set_contents (path, data, length, NULL);
+  g_free (data);
+
+  return ret ? GNOME_KEYRING_RESULT_OK : GNOME_KEYRING_RESULT_IO_ERROR;
+}
+
+/* Timing */
+
+/* Not finding a secret is an answer, not a failure */
+#define FAILED(result) ((result) != GNOME_KEYRING_RESULT_OK && \
+                        (result) != GNOME_KEYRING_RESULT_NO_MATCH)
+
+typedef struct {
+  /* The timeline event and probe name */
+  const char *name;
+  /* The histogram the call is recorded in */
+  const char *metric;
+  const char *service;
+  /* The call blocks the main loop, so is a watchdog span */
+  gboolean blocking;
+  gint64 start;
+  guint event;
+} Timing;
+
+static void
+timing_begin (Timing *timing, const char *name, const char *metric,
+              ServiceInfo *info, gboolean blocking)
+{
+  timing->name = name;
+  timing->metric = metric;
+  timing->service = info->name;
+  timing->blocking = blocking;
+  timing->start = g_get_monotonic_time ();
+  timing->event = bisho_timeline_begin (info->name, "keyring", name);
+
+  BISHO_PROBE2 (keyring__start, name, info->name);
+  if (blocking)
+    bisho_watchdog_span_begin (name);
+}
+
+static void
+timing_end (Timing *timing, GnomeKeyringResult result)
+{
+  if (timing->blocking)
+    bisho_watchdog_span_end ();
+  bisho_timeline_end (timing->event, FAILED (result));
+  BISHO_PROBE4 (keyring__done, timing->name, timing->service,
+                g_get_monotonic_time () - timing->start, result);
+  bisho_metrics_observe_since (timing->metric, timing->start);
+}
+
+typedef struct {
+  Timing timing;
+  GnomeKeyringOperationGetStringCallback find_callback;
+  GnomeKeyringOperationDoneCallback done_callback;
+  gpointer user_data;
+} Timed;
+
+static Timed *
+timed_new (const char *metric, ServiceInfo *info,
+           GnomeKeyringOperationGetStringCallback find_callback,
+           GnomeKeyringOperationDoneCallback done_callback,
+           gpointer user_data)
+{
+  Timed *timed;
+
+  timed = g_slice_new (Timed);
+  timing_begin (&timed->timing, metric, metric, info, FALSE);
+  timed->find_callback = find_callback;
+  timed->done_callback = done_callback;
+  timed->user_data = user_data;
+
+  return timed;
+}
+
+static void
+timed_find_cb (GnomeKeyringResult result, const char *string, gpointer data)
+{
+  Timed *timed = data;
+
+  timing_end (&timed->timing, result);
+  timed->find_callback (result, string, timed->user_data);
+  g_slice_free (Timed, timed);
+}
+
+static void
+timed_done_cb (GnomeKeyringResult result, gpointer data)
+{
+  Timed *timed = data;
+
+  timing_end (&timed->timing, result);
+  timed->done_callback (result, timed->user_data);
+  g_slice_free (Timed, timed);
+}
+
+/* Public API */
+
+void
+bisho_keyring_find (ServiceInfo *info,
+                    GnomeKeyringOperationGetStringCallback callback,
+                    gpointer user_data)
+{
+  Attributes attrs;
+  const char *path;
+
+  g_return_if_fail (info);
+  g_return_if_fail (callback);
+
+  if (!get_attributes (info, &attrs)) {
+    reply_later (callback, NULL, GNOME_KEYRING_RESULT_BAD_ARGUMENTS, NULL, user_data);
+    return;
+  }
+
+  user_data = timed_new ("keyring.find", info, callback, NULL, user_data);
+  callback = timed_find_cb;
+
+  path = g_getenv ("BISHO_KEYRING_FILE");
+  if (path) {
+    GKeyFile *keys;
+    char *group, *secret;
+
+    keys = load_file (path);
+    group = get_group (&attrs);
+    secret = g_key_file_get_string (keys, group, "Secret", NULL);
+    reply_later (callback, NULL,
+                 secret ? GNOME_KEYRING_RESULT_OK : GNOME_KEYRING_RESULT_NO_MATCH,
+                 secret, user_data);
+    g_free (group);
+    g_key_file_free (keys);
+    return;
+  }
+
+  gnome_keyring_find_password (attrs.schema, callback, user_data, NULL,
+                               "server", attrs.server,
+                               attrs.key_name, attrs.key,
+                               NULL);
+}
+
+/*
+ * Look the secret up without a main loop, for bisho --status.  @secret may be
+ * NULL, otherwise it should be freed.
+ */
+GnomeKeyringResult
+bisho_keyring_find_sync (ServiceInfo *info, char **secret)
+{
+  GnomeKeyringResult result;
+  Attributes attrs;
+  const char *path;
+  char *found = NULL;
+  Timing timing;
+
+  g_return_val_if_fail (info, GNOME_KEYRING_RESULT_BAD_ARGUMENTS);
+
+  if (!get_attributes (info, &attrs))
+    return GNOME_KEYRING_RESULT_BAD_ARGUMENTS;
+
+  timing_begin (&timing, "keyring.find_sync", "keyring.find", info, TRUE);
+
+  path = g_getenv ("BISHO_KEYRING_FILE");
+  if (path) {
+    GKeyFile *keys;
+    char *group;
+
+    keys = load_file (path);
+    group = get_group (&attrs);
+    found = g_key_file_get_string (keys, group, "Secret", NULL);
+    result = found ? GNOME_KEYRING_RESULT_OK : GNOME_KEYRING_RESULT_NO_MATCH;
+    g_free (group);
+    g_key_file_free (keys);
+  } else {
+    char *password = NULL;
+
+    result = gnome_keyring_find_password_sync (attrs.schema, &password,
+                                               "server", attrs.server,
+                                               attrs.key_name, attrs.key,
+                                               NULL);
+    if (password) {
+      found = g_strdup (password);
+      gnome_keyring_free_password (password);
+    }
+  }
+
+  timing_end (&timing, result);
+
+  if (secret)
+    *secret = found;
+  else
+    g_free (found);
+
+  return result;
+}
+
+void
+bisho_keyring_delete (ServiceInfo *info,
+                      GnomeKeyringOperationDoneCallback callback,
+                      gpointer user_data)
+{
+  Attributes attrs;
+  const char *path;
+
+  g_return_if_fail (info);
+  g_return_if_fail (callback);
+
+  if (!get_attributes (info, &attrs)) {
+    reply_later (NULL, callback, GNOME_KEYRING_RESULT_BAD_ARGUMENTS, NULL, user_data);
+    return;
+  }
+
+  user_data = timed_new ("keyring.delete", info, NULL, callback, user_data);
+  callback = timed_done_cb;
+
+  path = g_getenv ("BISHO_KEYRING_FILE");
+  if (path) {
+    GKeyFile *keys;
+    GnomeKeyringResult result;
+    char *group;
+
+    keys = load_file (path);
+    group = get_group (&attrs);
+    if (g_key_file_remove_group (keys, group, NULL))
+      result = save_file (keys, path);
+    else
+      result = GNOME_KEYRING_RESULT_NO_MATCH;
+    reply_later (NULL, callback, result, NULL, user_data);
+    g_free (group);
+    g_key_file_free (keys);
+    return;
+  }
+
+  gnome_keyring_delete_password (attrs.schema, callback, user_data, NULL,
+                                 "server", attrs.server,
+                                 attrs.key_name, attrs.key,
+                                 NULL);
+}
+
+/* Store the secret for the service and let mojito-core read it */
+GnomeKeyringResult
+bisho_keyring_store_sync (ServiceInfo *info, const char *secret)
+{
+  GnomeKeyringResult result;
+  GnomeKeyringAttributeList *list;
+  Attributes attrs;
+  const char *path;
+  guint32 id;
+  Timing timing;
+
+  g_return_val_if_fail (info, GNOME_KEYRING_RESULT_BAD_ARGUMENTS);
+  g_return_val_if_fail (secret, GNOME_KEYRING_RESULT_BAD_ARGUMENTS);
+
+  if (!get_attributes (info, &attrs))
+    return GNOME_KEYRING_RESULT_BAD_ARGUMENTS;
+
+  timing_begin (&timing, "keyring.store_sync", "keyring.store", info, TRUE);
+
+  path = g_getenv ("BISHO_KEYRING_FILE");
+  if (path) {
+    GKeyFile *keys;
+    char *group;
+
+    keys = load_file (path);
+    group = get_group (&attrs);
+    g_key_file_set_string (keys, group, "Secret", secret);
+    g_key_file_set_string (keys, group, "Name", info->display_name);
+    result = save_file (keys, path);
+    g_free (group);
+    g_key_file_free (keys);
+  } else {
+    list = gnome_keyring_attribute_list_new ();
+    gnome_keyring_attribute_list_append_string (list, "server", attrs.server);
+    gnome_keyring_attribute_list_append_string (list, attrs.key_name, attrs.key);
+
+    result = gnome_keyring_item_create_sync (NULL,
+                                             GNOME_KEYRING_ITEM_GENERIC_SECRET,
+                                             info->display_name,
+                                             list, secret,
+                                             TRUE, &id);
+    gnome_keyring_attribute_list_free (list);
+
+    if (result == GNOME_KEYRING_RESULT_OK) {
+      gnome_keyring_item_grant_access_rights_sync (NULL,
+                                                   "mojito",
+                                                   LIBEXECDIR "/mojito-core",
+                                                   id, GNOME_KEYRING_ACCESS_READ);
+    }
+  }
+
+  timing_end (&timing, result);
+
+  return result;
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BISHO_KEYRING_H__
+#define __BISHO_KEYRING_H__
+
+#include <gnome-keyring.h>
+#include "service-info.h"
+
+G_BEGIN_DECLS
+
+void bisho_keyring_find (ServiceInfo *info,
+                         GnomeKeyringOperationGetStringCallback callback,
+                         gpointer user_data);
+
+GnomeKeyringResult bisho_keyring_find_sync (ServiceInfo *info, char **secret);
+
+void bisho_keyring_delete (ServiceInfo *info,
+                           GnomeKeyringOperationDoneCallback callback,
+                           gpointer user_data);
+
+GnomeKeyringResult bisho_keyring_store_sync (ServiceInfo *info, const char *secret);
+
+G_END_DECLS
+
+#endif /* __BISHO_KEYRING_H__ */
@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A process-wide registry of counters and latency histograms.  Names are
+ * dotted, such as "keyring.find" or "auth.twitter.access_token".  The whole
+ * registry is written out as JSON when the process gets SIGUSR1, and can be
+ * fetched with the Dump method on BISHO_METRICS_PATH.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <glib-unix.h>
+#include <glib/gstdio.h>
+#include "bisho-metrics.h"
+
+typedef struct {
+  guint64 count;
+  gdouble sum;
+  gdouble min;
+  gdouble max;
+  guint64 buckets[BISHO_METRICS_BUCKETS];
+} Histogram;
+
+static const char introspection_xml[] =
+  "<node>"
+  "  <interface name='" BISHO_METRICS_INTERFACE "'>"
+  "    <method name='Dump'>"
+  "      <arg type='s' name='json' direction='out'/>"
+  "    </method>"
+  "  </interface>"
+  "</node>";
+
+/* Calls can finish on other threads, so the registry is locked */
+G_LOCK_DEFINE_STATIC (registry);
+/* Hash of name to guint64 count */
+static GHashTable *counters = NULL;
+/* Hash of name to Histogram */
+static GHashTable *histograms = NULL;
+static gint64 started = 0;
+
+static void
+ensure_registry (void)
+{
+  if (counters)
+    return;
+
+  counters = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  histograms = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  started = g_get_monotonic_time ();
+}
+
+void
+bisho_metrics_count (const char *name)
+{
+  guint64 *count;
+
+  g_return_if_fail (name);
+
+  G_LOCK (registry);
+  ensure_registry ();
+
+  count = g_hash_table_lookup (counters, name);
+  if (count == NULL) {
+    count = g_new0 (guint64, 1);
+    g_hash_table_insert (counters, g_strdup (name), count);
+  }
+  (*count)++;
+
+  G_UNLOCK (registry);
+}
+
+void
+bisho_metrics_observe (const char *name, gdouble ms)
+{
+  Histogram *h;
+  guint bucket;
+
+  g_return_if_fail (name);
+
+  ms = MAX (ms, 0.0);
+  bucket = ms < 1.0 ? 0 : MIN (g_bit_storage ((gulong) ms), BISHO_METRICS_BUCKETS - 1);
+
+  G_LOCK (registry);
+  ensure_registry ();
+
+  h = g_hash_table_lookup (histograms, name);
+  if (h == NULL) {
+    h = g_new0 (Histogram, 1);
+    h->min = ms;
+    g_hash_table_insert (histograms, g_strdup (name), h);
+  }
+
+  h->count++;
+  h->sum += ms;
+  h->min = MIN (h->min, ms);
+  h->max = MAX (h->max, ms);
+  h->buckets[bucket]++;
+
+  G_UNLOCK (registry);
+}
+
+/* Record the time since @start, a g_get_monotonic_time() value */
+void
+bisho_metrics_observe_since (const char *name, gint64 start)
+{
+  bisho_metrics_observe (name, (g_get_monotonic_time () - start) / 1000.0);
+}
+
+static void
+append_name (GString *s, const char *name)
+{
+  char *escaped;
+
+  escaped = g_strescape (name, NULL);
+  g_string_append_printf (s, "\"%s\"", escaped);
+  g_free (escaped);
+}
+
+static int
+compare_names (gconstpointer a, gconstpointer b)
+{
+  return strcmp (a, b);
+}
+
+char *
+bisho_metrics_to_json (void)
+{
+  GString *s;
+  GList *names, *l;
+  Histogram *h;
+  int i;
+
+  s = g_string_new (NULL);
+
+  G_LOCK (registry);
+  ensure_registry ();
+
+  g_string_append_printf (s, "{\n  \"pid\": %d,\n  \"uptime_s\": %.3f,\n  \"counters\": {",
+                          (int) getpid (),
+                          (g_get_monotonic_time () - started) / 1000000.0);
+
+  names = g_list_sort (g_hash_table_get_keys (counters), compare_names);
+  for (l = names; l; l = l->next) {
+    g_string_append (s, "\n    ");
+    append_name (s, l->data);
+    g_string_append_printf (s, ": %" G_GUINT64_FORMAT "%s",
+                            *(guint64 *) g_hash_table_lookup (counters, l->data),
+                            l->next ? "," : "\n  ");
+  }
+  g_list_free (names);
+
+  g_string_append (s, "},\n  \"histograms\": {");
+
+  names = g_list_sort (g_hash_table_get_keys (histograms), compare_names);
+  for (l = names; l; l = l->next) {
+    h = g_hash_table_lookup (histograms, l->data);
+
+    g_string_append (s, "\n    ");
+    append_name (s, l->data);
+    g_string_append_printf (s, ": { \"count\": %" G_GUINT64_FORMAT
+                            ", \"sum_ms\": %.3f, \"min_ms\": %.3f, \"max_ms\": %.3f, \"buckets\": [",
+                            h->count, h->sum, h->min, h->max);
+    for (i = 0; i < BISHO_METRICS_BUCKETS; i++)
+      g_string_append_printf (s, "%s%" G_GUINT64_FORMAT, i ? ", " : "", h->buckets[i]);
+    g_string_append_printf (s, "] }%s", l->next ? "," : "\n  ");
+  }
+  g_list_free (names);
+
+  g_string_append (s, "}\n}\n");
+
+  G_UNLOCK (registry);
+
+  return g_string_free (s, FALSE);
+}
+
+/* SIGUSR1 */
+
+static gboolean
+dump_cb (gpointer user_data)
+{
+  GError *error = NULL;
+  char *dir, *filename, *path, *json;
+
+  dir = g_build_filename (g_get_user_cache_dir (), "bisho", NULL);
+  g_mkdir_with_parents (dir, 0700);
+  filename = g_strdup_printf ("metrics-%d.json", (int) getpid ());
+  path = g_build_filename (dir, filename, NULL);
+
+  json = bisho_metrics_to_json ();
+  if (g_file_set_contents (path, json, -1, &error)) {
+    g_message ("Wrote metrics to %s", path);
+  } else {
+    g_message ("Cannot write metrics: %s", error->message);
+    g_error_free (error);
+  }
+
+  g_free (json);
+  g_free (path);
+  g_free (filename);
+  g_free (dir);
+
+  return TRUE;
+}
+
+/*
+ * Dump the registry to $XDG_CACHE_HOME/bisho/metrics-PID.json on SIGUSR1.
+ * Main loop stalls are only recorded while the watchdog is running.
+ */
+void
+bisho_metrics_init (void)
+{
+  G_LOCK (registry);
+  ensure_registry ();
+  G_UNLOCK (registry);
+
+  g_unix_signal_add (SIGUSR1, dump_cb, NULL);
+}
+
+/* D-Bus */
+
+static void
+method_call_cb (GDBusConnection *connection, const char *sender,
+                const char *object_path, const char *interface_name,
+                const char *method_name, GVariant *parameters,
+                GDBusMethodInvocation *invocation, gpointer user_data)
+{
+  char *json;
+
+  json = bisho_metrics_to_json ();
+  g_dbus_method_invocation_return_value (invocation, g_variant_new ("(s)", json));
+  g_free (json);
+}
+
+static const GDBusInterfaceVTable vtable = {
+  method_call_cb,
+  NULL,
+  NULL
+};
+
+/* Serve the Dump method on @connection */
+gboolean
+bisho_metrics_register (GDBusConnection *connection, GError **error)
+{
+  static GDBusNodeInfo *introspection = NULL;
+
+  g_return_val_if_fail (G_IS_DBUS_CONNECTION (connection), FALSE);
+
+  if (introspection == NULL)
+    introspection = g_dbus_node_info_new_for_xml (introspection_xml, NULL);
+
+  return g_dbus_connection_register_object (connection, BISHO_METRICS_PATH,
+                                            introspection->interfaces[0],
+                                            &vtable, NULL, NULL, error) != 0;
+}
+
+static void
+bus_acquired_cb (GDBusConnection *connection, const char *name, gpointer user_data)
+{
+  GError *error = NULL;
+
+  if (!bisho_metrics_register (connection, &error)) {
+    g_message ("Cannot export metrics: %s", error->message);
+    g_error_free (error);
+  }
+}
+
+/* Own com.intel.Bisho.Metrics and serve the registry there */
+void
+bisho_metrics_export (void)
+{
+  g_bus_own_name (G_BUS_TYPE_SESSION, "com.intel.Bisho.Metrics",
+                  G_BUS_NAME_OWNER_FLAGS_NONE,
+                  bus_acquired_cb, NULL, NULL, NULL, NULL);
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BISHO_METRICS_H__
+#define __BISHO_METRICS_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define BISHO_METRICS_PATH "/com/intel/Bisho/Metrics"
+#define BISHO_METRICS_INTERFACE "com.intel.Bisho.Metrics"
+
+/* Bucket 0 counts values under 1ms, bucket n those of 2^(n-1) to 2^n ms */
+#define BISHO_METRICS_BUCKETS 24
+
+void bisho_metrics_count (const char *name);
+
+void bisho_metrics_observe (const char *name, gdouble ms);
+
+void bisho_metrics_observe_since (const char *name, gint64 start);
+
+char * bisho_metrics_to_json (void);
+
+void bisho_metrics_init (void);
+
+gboolean bisho_metrics_register (GDBusConnection *connection, GError **error);
+
+void bisho_metrics_export (void);
+
+G_END_DECLS
+
+#endif /* __BISHO_METRICS_H__ */
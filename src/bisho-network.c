@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Network warm-up for the authentication endpoints.  Host names are resolved
+ * in the background as soon as the services are listed, so that the first
+ * request of a login finds them in the resolver's cache.
+ */
+
+#include <config.h>
+#include <gio/gio.h>
+#include <libsoup/soup.h>
+#include "bisho-network.h"
+
+typedef struct {
+  BishoNetworkTiming timing;
+  gint64 phase_start;
+} HostEntry;
+
+/* Hash of "host:port" to HostEntry */
+static GHashTable *hosts = NULL;
+
+static void
+host_entry_free (gpointer data)
+{
+  HostEntry *entry = data;
+
+  g_free (entry->timing.host);
+  g_slice_free (HostEntry, entry);
+}
+
+static HostEntry *
+get_entry (const char *url, gboolean create)
+{
+  SoupURI *uri;
+  HostEntry *entry = NULL;
+  char *key;
+
+  if (url == NULL)
+    return NULL;
+
+  uri = soup_uri_new (url);
+  if (uri == NULL || uri->host == NULL) {
+    if (uri)
+      soup_uri_free (uri);
+    return NULL;
+  }
+
+  if (hosts == NULL)
+    hosts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, host_entry_free);
+
+  key = g_strdup_printf ("%s:%u", uri->host, uri->port);
+  entry = g_hash_table_lookup (hosts, key);
+
+  if (entry == NULL && create) {
+    entry = g_slice_new0 (HostEntry);
+    entry->timing.host = g_strdup (uri->host);
+    entry->timing.port = uri->port;
+    entry->timing.dns = -1;
+    g_hash_table_insert (hosts, key, entry);
+  } else {
+    g_free (key);
+  }
+
+  soup_uri_free (uri);
+  return entry;
+}
+
+/* Only used for durations, so immune to the wall clock being changed */
+static gint64
+now (void)
+{
+  return g_get_monotonic_time ();
+}
+
+static void
+resolved_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+  HostEntry *entry = user_data;
+  GList *addresses;
+  GError *error = NULL;
+
+  addresses = g_resolver_lookup_by_name_finish (G_RESOLVER (source), res, &error);
+  if (addresses) {
+    entry->timing.dns = now () - entry->phase_start;
+    g_debug ("Resolved %s in %.1fms", entry->timing.host, entry->timing.dns / 1000.0);
+    g_resolver_free_addresses (addresses);
+  } else {
+    g_message ("Cannot resolve %s: %s", entry->timing.host, error->message);
+    g_error_free (error);
+  }
+}
+
+/* Resolve the host of @url in the background */
+void
+bisho_network_prefetch (const char *url)
+{
+  HostEntry *entry;
+
+  if (get_entry (url, FALSE))
+    return;
+
+  entry = get_entry (url, TRUE);
+  if (entry == NULL)
+    return;
+
+  entry->phase_start = now ();
+  g_resolver_lookup_by_name_async (g_resolver_get_default (),
+                                   entry->timing.host, NULL,
+                                   resolved_cb, entry);
+}
+
+/* Returns the warm-up timings for the host of @url, or NULL */
+const BishoNetworkTiming *
+bisho_network_get_timing (const char *url)
+{
+  HostEntry *entry;
+
+  entry = get_entry (url, FALSE);
+  return entry ? &entry->timing : NULL;
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BISHO_NETWORK_H__
+#define __BISHO_NETWORK_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Time spent warming up a host, in microseconds, or -1 if it hasn't been
+ * measured (yet).
+ */
+typedef struct {
+  char *host;
+  guint16 port;
+  gint64 dns;
+} BishoNetworkTiming;
+
+void bisho_network_prefetch (const char *url);
+
+const BishoNetworkTiming * bisho_network_get_timing (const char *url);
+
+G_END_DECLS
+
+#endif /* __BISHO_NETWORK_H__ */
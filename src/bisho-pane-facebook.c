@@ -24,25 +24,17 @@
 #include <libsoup/soup.h>
 #include <string.h>
 #include <rest-extras/facebook-proxy.h>
-#include <rest/rest-xml-parser.h>
 #include "service-info.h"
 #include "bisho-pane-facebook.h"
-#include "bisho-utils.h"
 #include "bisho-webkit.h"
+#include "bisho-timeline.h"
+#include "bisho-keyring.h"
+#include "bisho-auth.h"
 
-/* TODO: use mojito-keyring */
-static const GnomeKeyringPasswordSchema facebook_schema = {
-  GNOME_KEYRING_ITEM_GENERIC_SECRET,
-  {
-    { "server", GNOME_KEYRING_ATTRIBUTE_TYPE_STRING },
-    { "api-key", GNOME_KEYRING_ATTRIBUTE_TYPE_STRING },
-    { NULL, 0 }
-  }
-};
-
-#define FACEBOOK_SERVER "http://facebook.com/"
 #define FACEBOOK_STOP   "http://www.facebook.com/?session=";
 
+static const char *facebook_domains[] = { "facebook.com", NULL };
+
 struct _BishoPaneFacebookPrivate {
   ServiceInfo *info;
   RestProxy *proxy;
@@ -50,311 +42,190 @@ struct _BishoPaneFacebookPrivate {
   BrowserInfo *browser_info;
 };
 
-typedef enum {
-  LOGGED_OUT,
-  WORKING,
-  CONTINUE_AUTH,
-  LOGGED_IN,
-} ButtonState;
-
 #define GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), BISHO_TYPE_PANE_FACEBOOK, BishoPaneFacebookPrivate))
 G_DEFINE_TYPE (BishoPaneFacebook, bisho_pane_facebook, BISHO_TYPE_PANE);
 
-static void update_widgets (BishoPaneFacebook *pane, ButtonState state, const char *name);
-
-/* TODO: move to mojito */
-static gboolean
-decode (const char *string, char **token, char **token_secret)
-{
-  char **encoded_keys;
-  gboolean ret = FALSE;
-  gsize len;
-
-  g_assert (string);
-  g_assert (token);
-  g_assert (token_secret);
-
-  encoded_keys = g_strsplit (string, " ", 2);
-
-  if (encoded_keys[0] && encoded_keys[1]) {
-    *token = (char*)g_base64_decode (encoded_keys[0], &len);
-    *token_secret = (char*)g_base64_decode (encoded_keys[1], &len);
-    ret = TRUE;
-  }
-
-  g_strfreev (encoded_keys);
-
-  return ret;
-}
-
-/* A parser to extract keys and values from the JSON style session */
-static GHashTable*
-session_parse (const char *session)
-{
-  GHashTable* hashTable = g_hash_table_new(g_str_hash, g_str_equal);
-  char *input = g_strdup (session);
-  char **split_input, **session_vals, *key, *value;
-  int last, i;
-
-  if (input[0] == '{')
-    input[0] = ' ';
-  last = strlen(input)-1;
-  if (input[last] == '}')
-    input[last] = ' ';
-  g_strstrip (input);
-
-  /* Split the string by ," */
-  split_input = g_strsplit (input, ",\"", 0);
-  for (i = 0; split_input[i] != NULL; i++){
-    /* Seperate key and value from "key:value" */
-    session_vals = g_strsplit (split_input[i], ":", 2);
-    if (session_vals[0] != NULL && session_vals[1] != NULL){
-      /* Remove " from the head and the tail */
-      g_strdelimit (session_vals[0], "\"", ' ');
-      g_strstrip (session_vals[0]);
-      g_strdelimit (session_vals[1], "\"", ' ');
-      g_strstrip (session_vals[1]);
-      key = g_strdup (session_vals[0]);
-      value = g_strdup (session_vals[1]);
-
-      /* Insert into the Hashtable */
-      g_hash_table_insert (hashTable, key, value);
-
-      /* free the strings */
-      g_strfreev (session_vals);
-    }
-  }
-  /* free the strings */
-  g_strfreev (split_input);
-
-  return hashTable;
-}
-
-static RestXmlNode *
-get_xml (RestProxyCall *call)
+static void
+got_user_name_cb (const char *value, const char *user_name, const GError *error, gpointer user_data)
 {
-  static RestXmlParser *parser = NULL;
-  RestXmlNode *root;
-
-  if (parser == NULL)
-    parser = rest_xml_parser_new ();
+  BishoPane *pane = bisho_pane_op_finish (user_data);
 
-  root = rest_xml_parser_parse_from_data (parser,
-                                          rest_proxy_call_get_payload (call),
-                                          rest_proxy_call_get_payload_length (call));
-
-  if (root == NULL) {
-    g_message ("Invalid XML from Facebook:\n%s\n",
-               rest_proxy_call_get_payload (call));
-    goto done;
-  }
+  if (pane == NULL)
+    return;
 
-  if (strcmp (root->name, "error_response") == 0) {
-    RestXmlNode *node;
-    node = rest_xml_node_find (root, "error_msg");
-    g_message ("Error response from Facebook: %s\n", node->content);
-    rest_xml_node_unref (root);
-    root = NULL;
-    goto done;
+  if (error == NULL) {
+    bisho_pane_set_user (pane, NULL, user_name);
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_LOGGED_IN);
+    bisho_pane_validated (pane);
+  } else if (error->domain == BISHO_AUTH_ERROR) {
+    g_message ("Cannot get user info: %s", error->message);
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_LOGGED_OUT);
+    bisho_pane_set_banner_error (pane, error);
+  } else {
+    /* The credentials are stored, they just couldn't be checked */
+    g_message ("Cannot get user info: %s", error->message);
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_LOGGED_IN);
   }
-
- done:
-  g_object_unref (call);
-  return root;
 }
 
-/* TODO review this function */
 static void
 get_user_name (BishoPaneFacebook *pane, const char *uid)
 {
   BishoPaneFacebookPrivate *priv = pane->priv;
-
-  RestProxyCall *call;
-  RestXmlNode *node;
+  BishoPaneOp *op;
   GError *error = NULL;
 
   g_assert (pane);
   g_assert (uid);
 
-  call = rest_proxy_new_call (priv->proxy);
-  rest_proxy_call_set_function (call, "users.getInfo");
-  rest_proxy_call_add_param (call, "uids", uid);
-  rest_proxy_call_add_param (call, "fields", "name");
-
-  if (!rest_proxy_call_sync (call, &error)) {
+  op = bisho_pane_op_new (BISHO_PANE (pane));
+  if (!bisho_auth_facebook_get_user_name (priv->info, priv->proxy, uid, NULL,
+                                          got_user_name_cb, op, &error)) {
+    bisho_pane_op_finish (op);
     g_message ("Cannot get user info: %s", error->message);
     g_error_free (error);
-    return;
-  }
-
-  node = get_xml (call);
-  if (node) {
-    update_widgets (pane, LOGGED_IN, rest_xml_node_find (node, "name")->content);
-    rest_xml_node_unref (node);
-  } else {
-    update_widgets (pane, LOGGED_OUT, NULL);
+    bisho_pane_set_state (BISHO_PANE (pane), BISHO_PANE_STATE_LOGGED_IN);
   }
 }
 
 static void
-log_in_clicked (GtkWidget *button, gpointer user_data)
+bisho_pane_facebook_log_in (BishoPane *pane)
 {
-  BishoPaneFacebook *pane = BISHO_PANE_FACEBOOK (user_data);
-  BishoPaneFacebookPrivate *priv = pane->priv;
+  BishoPaneFacebookPrivate *priv = BISHO_PANE_FACEBOOK (pane)->priv;
   char *url;
 
   url = facebook_proxy_build_fbconnect_login_url (FACEBOOK_PROXY (priv->proxy), 
                                                   "read_stream,publish_stream,offline_access");
-  bisho_webkit_open_url (gtk_widget_get_screen (GTK_WIDGET (button)), priv->browser_info, url);
-  update_widgets (pane, CONTINUE_AUTH, NULL);
+  if (!bisho_pane_open_url (pane, url))
+    bisho_webkit_open_url (gtk_widget_get_screen (GTK_WIDGET (pane)), priv->browser_info, url);
+  g_free (url);
+  bisho_pane_set_state (pane, BISHO_PANE_STATE_CONTINUE_AUTH);
 }
 
 static void
 delete_done_cb (GnomeKeyringResult result, gpointer user_data)
 {
-  BishoPaneFacebook *pane = BISHO_PANE_FACEBOOK (user_data);
-  MojitoClientService *service;
-  BishoPane *generic_pane = BISHO_PANE (pane);
+  BishoPane *pane = bisho_pane_op_finish (user_data);
+
+  if (pane == NULL)
+    return;
 
   if (result == GNOME_KEYRING_RESULT_OK){
-    update_widgets (pane, LOGGED_OUT, NULL);
-    service = mojito_client_get_service (generic_pane->mojito, generic_pane->info->name);
-    mojito_client_service_credentials_updated (service);
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_LOGGED_OUT);
+    bisho_pane_credentials_updated (pane);
   } else {
-    update_widgets (pane, LOGGED_IN, NULL);
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_LOGGED_IN);
   }
 }
 
+/* Only forget the browser session if the user asked to log out */
 static void
-log_out_clicked (GtkButton *button, gpointer user_data)
+log_out (BishoPane *pane, gboolean clear_cookies)
 {
-  BishoPaneFacebook *pane = BISHO_PANE_FACEBOOK (user_data);
-  BishoPaneFacebookPrivate *priv = pane->priv;
+  bisho_pane_set_state (pane, BISHO_PANE_STATE_WORKING);
 
-  update_widgets (pane, WORKING, NULL);
+  if (clear_cookies)
+    bisho_webkit_clear_cookies (BISHO_PANE_FACEBOOK (pane)->priv->browser_info);
 
-  gnome_keyring_delete_password (&facebook_schema, delete_done_cb, user_data, NULL,
-                                 "server", FACEBOOK_SERVER,
-                                 "api-key", priv->info->facebook.app_id,
-                                 NULL);
+  bisho_keyring_delete (pane->info, delete_done_cb, bisho_pane_op_new (pane));
 }
 
 static void
-continue_clicked (GtkButton *button, gpointer data)
+bisho_pane_facebook_log_out (BishoPane *pane)
 {
-  BishoPaneFacebook *pane = BISHO_PANE_FACEBOOK (data);
-  update_widgets (pane, LOGGED_OUT, NULL);
+  log_out (pane, TRUE);
 }
 
 static void
 session_handler (gpointer data)
 {
   BrowserInfo *info = (BrowserInfo *)data;
-  BishoPaneFacebook *pane = BISHO_PANE_FACEBOOK (info->pane);
-  BishoPaneFacebookPrivate *priv = pane->priv;
-  MojitoClientService *service;
-  BishoPane *generic_pane = BISHO_PANE (pane);
-  GHashTable *form, *session;
+  BishoPane *pane = BISHO_PANE (info->pane);
   char **split_str = g_strsplit (info->session_url, "?", 2);
-  const char *session_key, *secret, *uid;
-  char *password;
+  GHashTable *form;
 
   if (!split_str[1]){
-    update_widgets (pane, LOGGED_OUT, NULL);
+    g_strfreev (split_str);
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_LOGGED_OUT);
     return;
   }
 
   form = soup_form_decode (split_str[1]);
+  bisho_pane_continue_auth (pane, form);
 
-  session = session_parse (g_hash_table_lookup (form, "session"));
+  g_hash_table_unref (form);
+  g_strfreev (split_str);
+}
+
+/*
+ * The login page hands back the session as a JSON blob in the "session"
+ * parameter.  Pressing Continue without one gives up on the log in.
+ */
+static void
+bisho_pane_facebook_continue_auth (BishoPane *_pane, GHashTable *params)
+{
+  BishoPaneFacebook *pane = BISHO_PANE_FACEBOOK (_pane);
+  BishoPaneFacebookPrivate *priv = pane->priv;
+  GnomeKeyringResult result;
+  GHashTable *session;
+  const char *session_key, *secret, *uid, *value;
+  char *password;
+
+  value = params ? g_hash_table_lookup (params, "session") : NULL;
+  if (value == NULL) {
+    bisho_pane_set_state (_pane, BISHO_PANE_STATE_LOGGED_OUT);
+    return;
+  }
+
+  session = bisho_auth_facebook_parse_session (value);
 
   session_key = g_hash_table_lookup (session, "session_key");
   secret = g_hash_table_lookup (session, "secret");
   uid = g_hash_table_lookup (session, "uid");
 
   if (!session_key || !secret || !uid){
-    update_widgets (pane, LOGGED_OUT, NULL);
+    g_hash_table_destroy (session);
+    bisho_pane_set_state (_pane, BISHO_PANE_STATE_LOGGED_OUT);
     return;
   }
 
-  password = bisho_utils_encode_tokens (session_key, secret);
+  bisho_pane_set_state (_pane, BISHO_PANE_STATE_WORKING);
+
+  password = bisho_auth_encode_tokens (session_key, secret);
   facebook_proxy_set_session_key (FACEBOOK_PROXY (priv->proxy), session_key);
   facebook_proxy_set_app_secret (FACEBOOK_PROXY (priv->proxy), secret);
 
-  get_user_name (pane, uid);
-
-  GnomeKeyringResult result;
-  GnomeKeyringAttributeList *attrs;
-  guint32 id;
-  attrs = gnome_keyring_attribute_list_new ();
-  gnome_keyring_attribute_list_append_string (attrs, "server", FACEBOOK_SERVER);
-  gnome_keyring_attribute_list_append_string (attrs, "api-key", priv->info->facebook.app_id);
-
-  result = gnome_keyring_item_create_sync (NULL,
-                                           GNOME_KEYRING_ITEM_GENERIC_SECRET,
-                                           priv->info->display_name,
-                                           attrs, password,
-                                           TRUE, &id);
-
+  result = bisho_keyring_store_sync (priv->info, password);
   if (result == GNOME_KEYRING_RESULT_OK) {
-    gnome_keyring_item_grant_access_rights_sync (NULL,
-                                                 "mojito",
-                                                 LIBEXECDIR "/mojito-core",
-                                                 id, GNOME_KEYRING_ACCESS_READ);
-
-    service = mojito_client_get_service (generic_pane->mojito, generic_pane->info->name);
-    mojito_client_service_credentials_updated (service);
+    get_user_name (pane, uid);
+    bisho_pane_credentials_updated (_pane);
   } else {
-    update_widgets (pane, LOGGED_OUT, NULL);
+    g_message ("Cannot update keyring: %s", gnome_keyring_result_to_message (result));
+    bisho_pane_set_state (_pane, BISHO_PANE_STATE_LOGGED_OUT);
   }
+
+  g_free (password);
+  g_hash_table_destroy (session);
 }
 
 static void
-update_widgets (BishoPaneFacebook *pane, ButtonState state, const char *name)
+got_user_cb (const char *uid, const char *user_name, const GError *error, gpointer user_data)
 {
-  BishoPaneFacebookPrivate *priv = pane->priv;
-  GtkWidget *button = priv->button;
-  char *str;
-
-  g_signal_handlers_disconnect_by_func (button, log_out_clicked, pane);
-  g_signal_handlers_disconnect_by_func (button, continue_clicked, pane);
-  g_signal_handlers_disconnect_by_func (button, log_in_clicked, pane);
-
-  switch (state) {
-  case LOGGED_OUT:
-    gtk_widget_show (button);
-    bisho_pane_set_user (BISHO_PANE (pane), NULL, NULL);
-    bisho_pane_set_banner (BISHO_PANE (pane), NULL);
-    gtk_widget_set_sensitive (GTK_BUTTON (button), TRUE);
-    gtk_button_set_label (GTK_BUTTON (button), _("Log me in"));
-    g_signal_connect (button, "clicked", G_CALLBACK (log_in_clicked), pane);
-    break;
-  case WORKING:
-    bisho_pane_set_banner (BISHO_PANE (pane), NULL);
-    gtk_widget_set_sensitive (GTK_BUTTON (button), FALSE);
-    gtk_button_set_label (GTK_BUTTON (button), _("Working..."));
-    break;
-  case CONTINUE_AUTH:
-    gtk_widget_show (button);
-    gtk_widget_set_sensitive (GTK_BUTTON (button), TRUE);
-
-    /* Use the same string in bisho-pane-oauth.c for translations. */
-    str = g_strdup_printf (_("Once you have logged in to %s, press Continue."), "Facebook");
-
-    bisho_pane_set_banner (BISHO_PANE (pane), str);
-    g_free (str);
-
-    gtk_button_set_label (GTK_BUTTON (button), _("Continue"));
-    g_signal_connect (button, "clicked", G_CALLBACK (continue_clicked), pane);
-    break;
-  case LOGGED_IN:
-    gtk_widget_show (button);
-    bisho_pane_set_banner (BISHO_PANE (pane), _("Log in succeeded. You'll see new items in a couple of minutes."));
-    bisho_pane_set_user (BISHO_PANE (pane), NULL, name);
-    gtk_widget_set_sensitive (GTK_BUTTON (button), TRUE);
-    gtk_button_set_label (GTK_BUTTON (button), _("Log me out"));
-    g_signal_connect (button, "clicked", G_CALLBACK (log_out_clicked), pane);
-    break;
+  BishoPane *pane = bisho_pane_op_finish (user_data);
+
+  if (pane == NULL)
+    return;
+
+  if (error == NULL) {
+    get_user_name (BISHO_PANE_FACEBOOK (pane), uid);
+  } else if (error->domain == BISHO_AUTH_ERROR) {
+    /* The token isn't valid so fake a log out */
+    g_message ("Cannot get user: %s", error->message);
+    log_out (pane, FALSE);
+  } else {
+    /* The credentials are stored, they just couldn't be checked */
+    g_message ("Cannot get user: %s", error->message);
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_LOGGED_IN);
   }
 }
 
@@ -363,43 +234,42 @@ find_key_cb (GnomeKeyringResult result,
              const char *string,
              gpointer user_data)
 {
-  BishoPaneFacebook *pane = BISHO_PANE_FACEBOOK (user_data);
-  BishoPaneFacebookPrivate *priv = pane->priv;
+  BishoPane *pane = bisho_pane_op_finish (user_data);
+  BishoPaneFacebookPrivate *priv;
+  char *secret, *session;
+  BishoPaneOp *op;
+  GError *error = NULL;
 
-  if (result == GNOME_KEYRING_RESULT_OK) {
-    RestProxyCall *call;
-    RestXmlNode *node;
-    char *secret, *session;
-    GError *error = NULL;
-
-    if (decode (string, &session, &secret)) {
-      facebook_proxy_set_app_secret (FACEBOOK_PROXY (priv->proxy), secret);
-      facebook_proxy_set_session_key (FACEBOOK_PROXY (priv->proxy), session);
-
-      call = rest_proxy_new_call (priv->proxy);
-      rest_proxy_call_set_function (call, "users.getLoggedInUser");
-
-      /* TODO async */
-      if (!rest_proxy_call_sync (call, &error)) {
-        g_message ("Cannot get user: %s", error->message);
-        g_error_free (error);
-        return;
-      }
-
-      node = get_xml (call);
-      if (node) {
-        get_user_name (pane, node->content);
-        rest_xml_node_unref (node);
-      } else {
-        /* The token isn't valid so fake a log out */
-        log_out_clicked (NULL, pane);
-      }
-    } else {
-      /* The token isn't valid so fake a log out */
-      log_out_clicked (NULL, pane);
-    }
+  if (pane == NULL)
+    return;
+
+  priv = BISHO_PANE_FACEBOOK (pane)->priv;
+
+  if (result != GNOME_KEYRING_RESULT_OK) {
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_LOGGED_OUT);
+    return;
+  }
+
+  if (!bisho_auth_decode_tokens (string, &session, &secret)) {
+    /* The token isn't valid so fake a log out */
+    log_out (pane, FALSE);
+    return;
+  }
+
+  facebook_proxy_set_app_secret (FACEBOOK_PROXY (priv->proxy), secret);
+  facebook_proxy_set_session_key (FACEBOOK_PROXY (priv->proxy), session);
+  g_free (secret);
+  g_free (session);
+
+  op = bisho_pane_op_new (pane);
+  if (bisho_auth_facebook_get_user (priv->info, priv->proxy, NULL,
+                                    got_user_cb, op, &error)) {
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_WORKING);
   } else {
-    update_widgets (pane, LOGGED_OUT, NULL);
+    bisho_pane_op_finish (op);
+    g_message ("Cannot get user: %s", error->message);
+    g_error_free (error);
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_LOGGED_IN);
   }
 }
 
@@ -408,6 +278,10 @@ bisho_pane_facebook_class_init (BishoPaneFacebookClass *klass)
 {
   BishoPaneClass *pane_class = BISHO_PANE_CLASS (klass);
 
+  pane_class->log_in = bisho_pane_facebook_log_in;
+  pane_class->continue_auth = bisho_pane_facebook_continue_auth;
+  pane_class->log_out = bisho_pane_facebook_log_out;
+
   g_type_class_add_private (klass, sizeof (BishoPaneFacebookPrivate));
 }
 
@@ -437,8 +311,10 @@ bisho_pane_facebook_new (MojitoClient *client, ServiceInfo *info)
   priv = pane->priv;
   priv->info = info;
 
-  priv->proxy = facebook_proxy_new (info->facebook.app_id, info->facebook.secret);
-  rest_proxy_set_user_agent (priv->proxy, "Bisho/" VERSION);
+  priv->proxy = bisho_auth_new_proxy (info);
+
+  bisho_timeline_add_host (info->name, info->facebook.base_url ?: FACEBOOK_API_URL);
+  bisho_timeline_add_host (info->name, FACEBOOK_LOGIN_URL);
 
   content = BISHO_PANE (pane)->content;
 
@@ -451,21 +327,16 @@ bisho_pane_facebook_new (MojitoClient *client, ServiceInfo *info)
   gtk_container_add (GTK_CONTAINER (align), box);
 
   priv->button = gtk_button_new ();
-  gtk_widget_show (priv->button);
-  bisho_pane_follow_connected (BISHO_PANE (pane), priv->button);
   gtk_box_pack_start (GTK_BOX (box), priv->button, FALSE, FALSE, 0);
-
-  update_widgets (pane, LOGGED_OUT, NULL);
-
-  gnome_keyring_find_password (&facebook_schema, find_key_cb, pane, NULL,
-                               "server", FACEBOOK_SERVER,
-                               "api-key", info->facebook.app_id,
-                               NULL);
+  bisho_pane_set_button (BISHO_PANE (pane), priv->button);
 
   priv->browser_info = g_new0 (BrowserInfo, 1);
   priv->browser_info->pane = pane;
   priv->browser_info->stop_url = FACEBOOK_STOP;
   priv->browser_info->session_handler = session_handler;
+  priv->browser_info->cookie_domains = facebook_domains;
+
+  bisho_keyring_find (info, find_key_cb, bisho_pane_op_new (BISHO_PANE (pane)));
 
   return (GtkWidget *)pane;
 }
@@ -23,23 +23,12 @@
 #include <gnome-keyring.h>
 #include <libsoup/soup.h>
 #include <rest-extras/flickr-proxy.h>
-#include <rest/rest-xml-parser.h>
 #include "service-info.h"
 #include "bisho-pane-flickr.h"
-#include "bisho-utils.h"
 #include "bisho-webkit.h"
-
-/* TODO: use mojito-keyring */
-static const GnomeKeyringPasswordSchema flickr_schema = {
-  GNOME_KEYRING_ITEM_GENERIC_SECRET,
-  {
-    { "server", GNOME_KEYRING_ATTRIBUTE_TYPE_STRING },
-    { "api-key", GNOME_KEYRING_ATTRIBUTE_TYPE_STRING },
-    { NULL, 0 }
-  }
-};
-
-#define FLICKR_SERVER "http://flickr.com/"
+#include "bisho-timeline.h"
+#include "bisho-keyring.h"
+#include "bisho-auth.h"
 
 struct _BishoPaneFlickrPrivate {
   ServiceInfo *info;
@@ -48,264 +37,153 @@ struct _BishoPaneFlickrPrivate {
   BrowserInfo *browser_info;
 };
 
-typedef enum {
-  LOGGED_OUT,
-  WORKING,
-  CONTINUE_AUTH,
-  LOGGED_IN,
-} ButtonState;
-
 #define GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), BISHO_TYPE_PANE_FLICKR, BishoPaneFlickrPrivate))
 G_DEFINE_TYPE (BishoPaneFlickr, bisho_pane_flickr, BISHO_TYPE_PANE);
 
-static void update_widgets (BishoPaneFlickr *data, ButtonState state, const char *name);
-
-static RestXmlNode *
-get_xml (RestProxyCall *call)
-{
-  static RestXmlParser *parser = NULL;
-  RestXmlNode *root;
-
-  if (parser == NULL)
-    parser = rest_xml_parser_new ();
-
-  root = rest_xml_parser_parse_from_data (parser,
-                                          rest_proxy_call_get_payload (call),
-                                          rest_proxy_call_get_payload_length (call));
-
-  if (root == NULL) {
-    g_message ("Invalid XML from Flickr:\n%s",
-               rest_proxy_call_get_payload (call));
-    goto done;
-  }
-
-  if (strcmp (root->name, "rsp") != 0) {
-    g_message ("Unexpected response from Flickr:\n%s",
-               rest_proxy_call_get_payload (call));
-    rest_xml_node_unref (root);
-    root = NULL;
-    goto done;
-  }
-
-  if (strcmp (rest_xml_node_get_attr (root, "stat"), "ok") != 0) {
-    RestXmlNode *node;
-    const char *msg;
-
-    node = rest_xml_node_find (root, "err");
-    msg = rest_xml_node_get_attr (node, "msg");
-
-    /* TODO bisho_utils_message (NULL, "Flickr", msg); */
-    g_message ("Error from Flickr: %s", msg);
-
-    rest_xml_node_unref (root);
-    root = NULL;
-    goto done;
-  }
-
-  done:
-  g_object_unref (call);
-  return root;
-}
-
 static void
-log_in_clicked (GtkWidget *button, gpointer user_data)
+got_frob_cb (const char *frob, const char *user_name, const GError *error, gpointer user_data)
 {
-  BishoPaneFlickr *pane = BISHO_PANE_FLICKR (user_data);
-  BishoPaneFlickrPrivate *priv = pane->priv;
+  BishoPane *pane = bisho_pane_op_finish (user_data);
+  BishoPaneFlickrPrivate *priv;
   char *url;
-  RestProxyCall *call;
-  RestXmlNode *node;
 
-  update_widgets (pane, WORKING, NULL);
-
-  /* TODO: async */
-  call = rest_proxy_new_call (priv->proxy);
-  rest_proxy_call_set_function (call, "flickr.auth.getFrob");
+  if (pane == NULL)
+    return;
 
-  if (!rest_proxy_call_run (call, NULL, NULL))
-    g_error ("Cannot get frob");
+  priv = BISHO_PANE_FLICKR (pane)->priv;
 
-  node = get_xml (call);
+  if (error) {
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_LOGGED_OUT);
+    bisho_pane_set_banner_error (pane, error);
+    g_message ("Cannot get frob: %s", error->message);
+    return;
+  }
 
-  priv->info->flickr.frob = g_strdup (rest_xml_node_find (node, "frob")->content);
-  rest_xml_node_unref (node);
+  g_free (priv->info->flickr.frob);
+  priv->info->flickr.frob = g_strdup (frob);
 
-  url = flickr_proxy_build_login_url (FLICKR_PROXY (priv->proxy), priv->info->flickr.frob);
-  gtk_show_uri (gtk_widget_get_screen (GTK_WIDGET (pane)), url, GDK_CURRENT_TIME, NULL);
+  url = flickr_proxy_build_login_url (FLICKR_PROXY (priv->proxy), frob);
+  if (!bisho_pane_open_url (pane, url))
+    gtk_show_uri (gtk_widget_get_screen (GTK_WIDGET (pane)), url, GDK_CURRENT_TIME, NULL);
+  g_free (url);
 
   /* TODO wait for dbus call from callback */
-  update_widgets (pane, CONTINUE_AUTH, NULL);
+  bisho_pane_set_state (pane, BISHO_PANE_STATE_CONTINUE_AUTH);
 }
 
-
 static void
-delete_done_cb (GnomeKeyringResult result, gpointer user_data)
+bisho_pane_flickr_log_in (BishoPane *pane)
 {
-  BishoPaneFlickr *pane = BISHO_PANE_FLICKR (user_data);
-  MojitoClientService *service;
-  BishoPane *generic_pane = BISHO_PANE (pane);
+  BishoPaneFlickrPrivate *priv = BISHO_PANE_FLICKR (pane)->priv;
+  BishoPaneOp *op;
+  GError *error = NULL;
 
-  if (result == GNOME_KEYRING_RESULT_OK){
-    update_widgets (pane, LOGGED_OUT, NULL);
-    service = mojito_client_get_service (generic_pane->mojito, generic_pane->info->name);
-    mojito_client_service_credentials_updated (service);
+  op = bisho_pane_op_new (pane);
+  if (bisho_auth_flickr_get_frob (priv->info, priv->proxy, NULL,
+                                  got_frob_cb, op, &error)) {
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_WORKING);
   } else {
-    update_widgets (pane, LOGGED_IN, NULL);
+    bisho_pane_op_finish (op);
+    bisho_pane_set_banner_error (pane, error);
+    g_message ("Cannot get frob: %s", error->message);
+    g_error_free (error);
   }
 }
 
 static void
-log_out_clicked (GtkButton *button, gpointer user_data)
+delete_done_cb (GnomeKeyringResult result, gpointer user_data)
 {
-  BishoPaneFlickr *pane = BISHO_PANE_FLICKR (user_data);
-  BishoPaneFlickrPrivate *priv = pane->priv;
+  BishoPane *pane = bisho_pane_op_finish (user_data);
 
-  gnome_keyring_delete_password (&flickr_schema, delete_done_cb, user_data, NULL,
-                                 "server", FLICKR_SERVER,
-                                 "api-key", priv->info->flickr.api_key,
-                                 NULL);
+  if (pane == NULL)
+    return;
 
-  update_widgets (pane, LOGGED_OUT, NULL);
+  if (result == GNOME_KEYRING_RESULT_OK){
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_LOGGED_OUT);
+    bisho_pane_credentials_updated (pane);
+  } else {
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_LOGGED_IN);
+  }
 }
 
 static void
-got_auth (RestXmlNode *node, BishoPaneFlickr *pane)
+bisho_pane_flickr_log_out (BishoPane *pane)
 {
-  RestXmlNode *user;
-  const char *name;
+  bisho_pane_set_state (pane, BISHO_PANE_STATE_WORKING);
 
-  user = rest_xml_node_find (node, "user");
-  name = rest_xml_node_get_attr (user, "fullname");
-  if (name == NULL || name[0] == '\0')
-    name = rest_xml_node_get_attr (user, "username");
-
-  update_widgets (pane, LOGGED_IN, name);
+  bisho_keyring_delete (pane->info, delete_done_cb, bisho_pane_op_new (pane));
 }
 
 static void
-continue_clicked (GtkWidget *button, gpointer user_data)
+got_token_cb (const char *token, const char *user_name, const GError *error, gpointer user_data)
 {
-  BishoPaneFlickr *pane = BISHO_PANE_FLICKR (user_data);
-  BishoPaneFlickrPrivate *priv = pane->priv;
-  MojitoClientService *service;
-  BishoPane *generic_pane = BISHO_PANE (pane);
-  RestProxyCall *call;
-  RestXmlNode *node;
-  const char *token;
-  GError *error = NULL;
-
-  update_widgets (pane, WORKING, NULL);
-
-  call = rest_proxy_new_call (priv->proxy);
-  rest_proxy_call_set_function (call, "flickr.auth.getToken");
-  rest_proxy_call_add_param (call, "frob", priv->info->flickr.frob);
+  BishoPane *pane = bisho_pane_op_finish (user_data);
+  GnomeKeyringResult result;
 
-  if (!rest_proxy_call_sync (call, &error)) {
-    bisho_pane_set_banner_error (BISHO_PANE (pane), error);
-    g_message ("Cannot get token: %s", error->message);
-    g_error_free (error);
-    update_widgets (pane, LOGGED_OUT, NULL);
+  if (pane == NULL)
     return;
-  }
 
-  node = get_xml (call);
-
-  if (node == NULL) {
-    update_widgets (pane, LOGGED_OUT, NULL);
+  if (error) {
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_LOGGED_OUT);
+    bisho_pane_set_banner_error (pane, error);
+    g_message ("Cannot get token: %s", error->message);
     return;
   }
 
-  token = rest_xml_node_find (node, "token")->content;
-  flickr_proxy_set_token (FLICKR_PROXY (priv->proxy), token);
-
-  got_auth (node, pane);
-
   /* TODO async */
-  GnomeKeyringResult result;
-  GnomeKeyringAttributeList *attrs;
-  guint32 id;
-  attrs = gnome_keyring_attribute_list_new ();
-  gnome_keyring_attribute_list_append_string (attrs, "server", FLICKR_SERVER);
-  gnome_keyring_attribute_list_append_string (attrs, "api-key", priv->info->flickr.api_key);
-
-  result = gnome_keyring_item_create_sync (NULL,
-                                           GNOME_KEYRING_ITEM_GENERIC_SECRET,
-                                           priv->info->display_name,
-                                           attrs, token,
-                                           TRUE, &id);
-
-  if (result == GNOME_KEYRING_RESULT_OK) {
-    gnome_keyring_item_grant_access_rights_sync (NULL,
-                                                 "mojito",
-                                                 LIBEXECDIR "/mojito-core",
-                                                 id, GNOME_KEYRING_ACCESS_READ);
-  } else {
+  result = bisho_keyring_store_sync (pane->info, token);
+  if (result != GNOME_KEYRING_RESULT_OK) {
     g_message ("Cannot update keyring: %s", gnome_keyring_result_to_message (result));
-    update_widgets (pane, LOGGED_OUT, NULL);
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_LOGGED_OUT);
+    return;
   }
 
-  rest_xml_node_unref (node);
+  bisho_pane_set_user (pane, NULL, user_name);
+  bisho_pane_set_state (pane, BISHO_PANE_STATE_LOGGED_IN);
+  bisho_pane_validated (pane);
 
-  service = mojito_client_get_service (generic_pane->mojito, generic_pane->info->name);
-  mojito_client_service_credentials_updated (service);
+  bisho_pane_credentials_updated (pane);
 }
 
 static void
-update_widgets (BishoPaneFlickr *pane, ButtonState state, const char *name)
+bisho_pane_flickr_continue_auth (BishoPane *pane, GHashTable *params)
 {
-  BishoPaneFlickrPrivate *priv = pane->priv;
-
-  g_signal_handlers_disconnect_by_func (priv->button, log_out_clicked, pane);
-  g_signal_handlers_disconnect_by_func (priv->button, continue_clicked, pane);
-  g_signal_handlers_disconnect_by_func (priv->button, log_in_clicked, pane);
-
-  switch (state) {
-  case LOGGED_OUT:
-    bisho_pane_set_user (BISHO_PANE (pane), NULL, NULL);
-    bisho_pane_set_banner (BISHO_PANE (pane), NULL);
-    gtk_widget_set_sensitive (priv->button, TRUE);
-    gtk_button_set_label (GTK_BUTTON (priv->button), _("Log me in"));
-    g_signal_connect (priv->button, "clicked", G_CALLBACK (log_in_clicked), pane);
-    break;
-  case WORKING:
-    bisho_pane_set_banner (BISHO_PANE (pane), NULL);
-    gtk_widget_set_sensitive (priv->button, FALSE);
-    gtk_button_set_label (GTK_BUTTON (priv->button), _("Working..."));
-    break;
-  case CONTINUE_AUTH:
-    gtk_widget_set_sensitive (priv->button, TRUE);
-    bisho_pane_set_banner (BISHO_PANE (pane), _("Once you have logged in to Flickr, press Continue."));
-    gtk_button_set_label (GTK_BUTTON (priv->button), _("Continue"));
-    g_signal_connect (priv->button, "clicked", G_CALLBACK (continue_clicked), pane);
-    break;
-  case LOGGED_IN:
-    bisho_pane_set_banner (BISHO_PANE (pane), _("Log in succeeded. You'll see new items in a couple of minutes."));
-    gtk_widget_set_sensitive (priv->button, TRUE);
-    bisho_pane_set_user (BISHO_PANE (pane), NULL, name);
-    gtk_button_set_label (GTK_BUTTON (priv->button), _("Log me out"));
-    g_signal_connect (priv->button, "clicked", G_CALLBACK (log_out_clicked), pane);
-    break;
+  BishoPaneFlickrPrivate *priv = BISHO_PANE_FLICKR (pane)->priv;
+  BishoPaneOp *op;
+  GError *error = NULL;
+
+  op = bisho_pane_op_new (pane);
+  if (bisho_auth_flickr_get_token (priv->info, priv->proxy, priv->info->flickr.frob,
+                                   NULL, got_token_cb, op, &error)) {
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_WORKING);
+  } else {
+    bisho_pane_op_finish (op);
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_LOGGED_OUT);
+    bisho_pane_set_banner_error (pane, error);
+    g_message ("Cannot get token: %s", error->message);
+    g_error_free (error);
   }
 }
 
 static void
-check_token_cb (RestProxyCall *call, const GError *error, GObject *weak_object, gpointer user_data)
+check_token_cb (const char *token, const char *user_name, const GError *error, gpointer user_data)
 {
-  BishoPaneFlickr *pane = BISHO_PANE_FLICKR (user_data);
-  RestXmlNode *node;
+  BishoPane *pane = bisho_pane_op_finish (user_data);
 
-  if (error) {
-    bisho_pane_set_banner_error (BISHO_PANE (pane), error);
+  if (pane == NULL)
+    return;
+
+  if (error == NULL) {
+    bisho_pane_set_user (pane, NULL, user_name);
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_LOGGED_IN);
+    bisho_pane_validated (pane);
+  } else if (error->domain == BISHO_AUTH_ERROR) {
+    /* The token isn't valid so fake a log out */
     g_message ("Cannot check token: %s", error->message);
+    bisho_pane_flickr_log_out (pane);
   } else {
-    node = get_xml (call);
-    if (node) {
-      got_auth (node, pane);
-      rest_xml_node_unref (node);
-    } else {
-      /* The token isn't valid so fake a log out */
-      log_out_clicked (NULL, pane);
-    }
+    bisho_pane_set_banner_error (pane, error);
+    g_message ("Cannot check token: %s", error->message);
   }
 }
 
@@ -314,33 +192,44 @@ find_key_cb (GnomeKeyringResult result,
              const char *string,
              gpointer user_data)
 {
-  BishoPaneFlickr *pane = BISHO_PANE_FLICKR (user_data);
-  BishoPaneFlickrPrivate *priv = pane->priv;
+  BishoPane *pane = bisho_pane_op_finish (user_data);
+  BishoPaneFlickrPrivate *priv;
+  BishoPaneOp *op;
+  GError *error = NULL;
+
+  if (pane == NULL)
+    return;
 
-  if (result == GNOME_KEYRING_RESULT_OK) {
-    GError *error = NULL;
-    RestProxyCall *call;
+  priv = BISHO_PANE_FLICKR (pane)->priv;
 
-    flickr_proxy_set_token (FLICKR_PROXY (priv->proxy), string);
+  if (result != GNOME_KEYRING_RESULT_OK) {
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_LOGGED_OUT);
+    return;
+  }
 
-    call = rest_proxy_new_call (priv->proxy);
-    rest_proxy_call_set_function (call, "flickr.auth.checkToken");
+  flickr_proxy_set_token (FLICKR_PROXY (priv->proxy), string);
 
-    if (rest_proxy_call_async (call, check_token_cb, NULL, pane, &error)) {
-      update_widgets (pane, WORKING, NULL);
-    } else {
-      bisho_pane_set_banner_error (BISHO_PANE (pane), error);
-      g_message ("Cannot check token: %s", error->message);
-      g_error_free (error);
-    }
+  op = bisho_pane_op_new (pane);
+  if (bisho_auth_flickr_check_token (priv->info, priv->proxy, NULL,
+                                     check_token_cb, op, &error)) {
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_WORKING);
   } else {
-    update_widgets (pane, LOGGED_OUT, NULL);
+    bisho_pane_op_finish (op);
+    bisho_pane_set_banner_error (pane, error);
+    g_message ("Cannot check token: %s", error->message);
+    g_error_free (error);
   }
 }
 
 static void
 bisho_pane_flickr_class_init (BishoPaneFlickrClass *klass)
 {
+  BishoPaneClass *pane_class = BISHO_PANE_CLASS (klass);
+
+  pane_class->log_in = bisho_pane_flickr_log_in;
+  pane_class->continue_auth = bisho_pane_flickr_continue_auth;
+  pane_class->log_out = bisho_pane_flickr_log_out;
+
   g_type_class_add_private (klass, sizeof (BishoPaneFlickrPrivate));
 }
 
@@ -370,8 +259,9 @@ bisho_pane_flickr_new (MojitoClient *client, ServiceInfo *info)
   priv = pane->priv;
   priv->info = info;
 
-  priv->proxy = flickr_proxy_new (info->flickr.api_key, info->flickr.shared_secret);
-  rest_proxy_set_user_agent (priv->proxy, "Bisho/" VERSION);
+  priv->proxy = bisho_auth_new_proxy (info);
+
+  bisho_timeline_add_host (info->name, info->flickr.base_url ?: FLICKR_API_URL);
 
   priv->browser_info = g_new0 (BrowserInfo, 1);
   priv->browser_info->pane = pane;
@@ -387,16 +277,10 @@ bisho_pane_flickr_new (MojitoClient *client, ServiceInfo *info)
   gtk_container_add (GTK_CONTAINER (align), box);
 
   priv->button = gtk_button_new ();
-  gtk_widget_show (priv->button);
-  bisho_pane_follow_connected (BISHO_PANE (pane), priv->button);
   gtk_box_pack_start (GTK_BOX (box), priv->button, FALSE, FALSE, 0);
+  bisho_pane_set_button (BISHO_PANE (pane), priv->button);
 
-  update_widgets (pane, LOGGED_OUT, NULL);
-
-  gnome_keyring_find_password (&flickr_schema, find_key_cb, pane, NULL,
-                               "server", FLICKR_SERVER,
-                               "api-key", info->flickr.api_key,
-                               NULL);
+  bisho_keyring_find (info, find_key_cb, bisho_pane_op_new (BISHO_PANE (pane)));
 
   return (GtkWidget *)pane;
 }
@@ -18,33 +18,28 @@
  */
 
 #include <config.h>
+#include <string.h>
 #include <glib/gi18n.h>
 #include <gtk/gtk.h>
 #include <gnome-keyring.h>
 #include <libsoup/soup.h>
 #include <rest/oauth-proxy.h>
 #include "service-info.h"
-#include "bisho-utils.h"
 #include "bisho-webkit.h"
+#include "bisho-timeline.h"
+#include "bisho-metrics.h"
+#include "bisho-keyring.h"
+#include "bisho-auth.h"
 #include "bisho-pane-oauth.h"
 
-/* TODO: use mojito-keyring */
-static const GnomeKeyringPasswordSchema oauth_schema = {
-  GNOME_KEYRING_ITEM_GENERIC_SECRET,
-  {
-    { "server", GNOME_KEYRING_ATTRIBUTE_TYPE_STRING },
-    { "consumer-key", GNOME_KEYRING_ATTRIBUTE_TYPE_STRING },
-    { NULL, 0 }
-  }
-};
-
 typedef enum {
-  LOGGED_OUT,
-  WORKING,
-  CONTINUE_AUTH_10,
-  CONTINUE_AUTH_10a,
-  LOGGED_IN,
-} ButtonState;
+  PREFETCH_NONE,
+  PREFETCH_PENDING,
+  PREFETCH_READY,
+} PrefetchState;
+
+/* How long a prefetched request token is trusted, in seconds */
+#define PREFETCH_TTL 120
 
 struct _BishoPaneOauthPrivate {
   RestProxy *proxy;
@@ -52,185 +47,327 @@ struct _BishoPaneOauthPrivate {
   GtkWidget *pin_entry;
   GtkWidget *button;
   BrowserInfo *browser_info;
+  char *cookie_domains[2];
+  /* The user has to copy a code from the site to continue */
+  gboolean need_pin;
+  /* Request token fetched when the pane was expanded */
+  PrefetchState prefetch;
+  /* Log in was clicked while the prefetch was in flight */
+  BishoPaneOp *prefetch_op;
+  /* The pane was collapsed while the prefetch was in flight */
+  gboolean prefetch_discard;
+  guint prefetch_timeout;
 };
 
 #define GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), BISHO_TYPE_PANE_OAUTH, BishoPaneOauthPrivate))
 G_DEFINE_TYPE (BishoPaneOauth, bisho_pane_oauth, BISHO_TYPE_PANE);
 
-static void update_widgets (BishoPaneOauth *pane, ButtonState state);
-
-static char *
-create_url (ServiceInfo *info, const char *token)
-{
-  SoupURI *base, *uri;
-  char *s;
-
-  g_assert (info);
-  g_assert (token);
-
-  base = soup_uri_new (info->oauth.base_url);
-  uri = soup_uri_new_with_base (base, info->oauth.authorize_function);
-  soup_uri_free (base);
-
-  soup_uri_set_query_from_fields (uri,
-                                  "oauth_token", token,
-                                  "oauth_callback", info->oauth.callback ?: "",
-                                  NULL);
-
-  s = soup_uri_to_string (uri, FALSE);
-  soup_uri_free (uri);
-  return s;
-}
-
 G_GNUC_UNUSED static const char * unused_for_now[] = {
   N_("You don't seem to have a network connection, this won't work."),
   N_("You could check that the computer's clock is correct."),
   N_("You could try again.")
 };
 
+/*
+ * The embedded browser can only finish the flow on its own if the service
+ * redirects to a real callback, not "oob".
+ */
+static gboolean
+use_embedded_browser (ServiceInfo *info)
+{
+  return info->oauth.embedded_browser &&
+    info->oauth.callback &&
+    strcmp (info->oauth.callback, "oob") != 0;
+}
+
 static void
-request_token_cb (OAuthProxy   *proxy,
+request_token_cb (const char   *token,
+                  const char   *user_name,
                   const GError *error,
-                  GObject      *weak_object,
                   gpointer      user_data)
 {
-  BishoPaneOauth *pane = BISHO_PANE_OAUTH (user_data);
-  BishoPaneOauthPrivate *priv = pane->priv;
-  ServiceInfo *info = BISHO_PANE (pane)->info;
+  BishoPane *generic_pane = bisho_pane_op_finish (user_data);
+  BishoPaneOauth *pane;
+  BishoPaneOauthPrivate *priv;
+  ServiceInfo *info;
   char *url;
 
+  if (generic_pane == NULL)
+    return;
+
+  pane = BISHO_PANE_OAUTH (generic_pane);
+  priv = pane->priv;
+  info = generic_pane->info;
+
   if (error) {
-    update_widgets (pane, LOGGED_OUT);
+    bisho_pane_set_state (generic_pane, BISHO_PANE_STATE_LOGGED_OUT);
 
     g_message ("Error from %s: %s", info->name, error->message);
-    bisho_pane_set_banner_error (BISHO_PANE (pane), error);
+    bisho_pane_set_banner_error (generic_pane, error);
     return;
   }
 
-  url = create_url (info, oauth_proxy_get_token (OAUTH_PROXY (priv->proxy)));
-  gtk_show_uri (gtk_widget_get_screen (GTK_WIDGET (pane)), url, GDK_CURRENT_TIME, NULL);
+  url = bisho_auth_oauth_build_authorize_url (info, token);
 
-  if (info->oauth.callback == NULL) {
-    update_widgets (pane, CONTINUE_AUTH_10);
-  } else {
-    /* TODO: insert check for 1.0a? */
-    if (strcmp (info->oauth.callback, "oob") == 0) {
-      update_widgets (pane, CONTINUE_AUTH_10a);
-    } else {
-      update_widgets (pane, CONTINUE_AUTH_10);
-      /* TODO: should be
-         update_widgets (pane, WORKING);
-         but myspace breaks this at the moment */
-    }
+  if (!bisho_pane_open_url (generic_pane, url)) {
+    if (use_embedded_browser (info))
+      bisho_webkit_open_url (gtk_widget_get_screen (GTK_WIDGET (pane)), priv->browser_info, url);
+    else
+      gtk_show_uri (gtk_widget_get_screen (GTK_WIDGET (pane)), url, GDK_CURRENT_TIME, NULL);
   }
+  g_free (url);
+
+  /*
+   * With the embedded browser the verifier is read from the callback URL in
+   * session_handler().  Otherwise an "oob" callback means the user is given a
+   * code to enter.
+   */
+  /* TODO: insert check for 1.0a? */
+  priv->need_pin = !use_embedded_browser (info) &&
+    info->oauth.callback && strcmp (info->oauth.callback, "oob") == 0;
+
+  /* TODO: for a real callback this should stay WORKING, but myspace breaks
+     this at the moment */
+  bisho_pane_set_state (generic_pane, BISHO_PANE_STATE_CONTINUE_AUTH);
 }
 
 static void
-log_in_clicked (GtkWidget *button, gpointer user_data)
+discard_prefetch (BishoPaneOauth *pane)
+{
+  BishoPaneOauthPrivate *priv = pane->priv;
+
+  if (priv->prefetch_timeout) {
+    g_source_remove (priv->prefetch_timeout);
+    priv->prefetch_timeout = 0;
+  }
+
+  if (priv->prefetch == PREFETCH_READY) {
+    oauth_proxy_set_token (OAUTH_PROXY (priv->proxy), NULL);
+    oauth_proxy_set_token_secret (OAUTH_PROXY (priv->proxy), NULL);
+    priv->prefetch = PREFETCH_NONE;
+  } else if (priv->prefetch == PREFETCH_PENDING) {
+    priv->prefetch_discard = TRUE;
+  }
+}
+
+static gboolean
+prefetch_expired_cb (gpointer user_data)
 {
   BishoPaneOauth *pane = BISHO_PANE_OAUTH (user_data);
+
+  pane->priv->prefetch_timeout = 0;
+  discard_prefetch (pane);
+
+  return FALSE;
+}
+
+static void
+prefetch_token_cb (const char   *token,
+                   const char   *user_name,
+                   const GError *error,
+                   gpointer      user_data)
+{
+  BishoPaneOauth *pane = BISHO_PANE_OAUTH (user_data);
+  BishoPaneOauthPrivate *priv = pane->priv;
+  BishoPaneOp *op;
+
+  priv->prefetch = PREFETCH_NONE;
+
+  if (priv->prefetch_op) {
+    /* The user is already waiting for this token */
+    op = priv->prefetch_op;
+    priv->prefetch_op = NULL;
+    priv->prefetch_discard = FALSE;
+    request_token_cb (token, user_name, error, op);
+    return;
+  }
+
+  if (error || priv->prefetch_discard ||
+      bisho_pane_get_state (BISHO_PANE (pane)) != BISHO_PANE_STATE_LOGGED_OUT) {
+    priv->prefetch_discard = FALSE;
+    return;
+  }
+
+  priv->prefetch = PREFETCH_READY;
+  priv->prefetch_timeout = g_timeout_add_seconds (PREFETCH_TTL, prefetch_expired_cb, pane);
+}
+
+static void
+start_prefetch (BishoPaneOauth *pane)
+{
   BishoPaneOauthPrivate *priv = pane->priv;
   ServiceInfo *info = BISHO_PANE (pane)->info;
+
+  if (priv->prefetch == PREFETCH_PENDING) {
+    /* Still in flight from the last time the pane was expanded */
+    priv->prefetch_discard = FALSE;
+    return;
+  }
+
+  if (priv->prefetch != PREFETCH_NONE ||
+      bisho_pane_get_state (BISHO_PANE (pane)) != BISHO_PANE_STATE_LOGGED_OUT)
+    return;
+
+  if (bisho_auth_oauth_request_token (info, priv->proxy, G_OBJECT (pane),
+                                      prefetch_token_cb, pane, NULL)) {
+    priv->prefetch = PREFETCH_PENDING;
+  }
+}
+
+static void
+bisho_pane_oauth_expanded (BishoPane *_pane, gboolean expanded)
+{
+  BishoPaneOauth *pane = BISHO_PANE_OAUTH (_pane);
+
+  if (expanded)
+    start_prefetch (pane);
+  else
+    discard_prefetch (pane);
+}
+
+/* Count @outcome of a log in, for all services and for this one */
+static void
+count_prefetch (BishoPaneOauth *pane, const char *outcome)
+{
+  char *name;
+
+  name = g_strconcat ("oauth.prefetch.", outcome, NULL);
+  bisho_metrics_count (name);
+  g_free (name);
+
+  name = g_strconcat ("oauth.", BISHO_PANE (pane)->info->name, ".prefetch.", outcome, NULL);
+  bisho_metrics_count (name);
+  g_free (name);
+}
+
+/*
+ * Use the prefetched request token if there is one.  Returns TRUE if the log
+ * in has been taken care of.
+ */
+static gboolean
+claim_prefetch (BishoPaneOauth *pane)
+{
+  BishoPaneOauthPrivate *priv = pane->priv;
+
+  switch (priv->prefetch) {
+  case PREFETCH_READY:
+    count_prefetch (pane, "hit");
+    g_source_remove (priv->prefetch_timeout);
+    priv->prefetch_timeout = 0;
+    priv->prefetch = PREFETCH_NONE;
+    request_token_cb (oauth_proxy_get_token (OAUTH_PROXY (priv->proxy)), NULL, NULL,
+                      bisho_pane_op_new (BISHO_PANE (pane)));
+    return TRUE;
+  case PREFETCH_PENDING:
+    /* Still has to wait for the token, so not a hit */
+    count_prefetch (pane, "pending");
+    priv->prefetch_discard = FALSE;
+    if (priv->prefetch_op)
+      bisho_pane_op_finish (priv->prefetch_op);
+    priv->prefetch_op = bisho_pane_op_new (BISHO_PANE (pane));
+    bisho_pane_set_state (BISHO_PANE (pane), BISHO_PANE_STATE_WORKING);
+    return TRUE;
+  case PREFETCH_NONE:
+    break;
+  }
+
+  count_prefetch (pane, "miss");
+  return FALSE;
+}
+
+static void
+bisho_pane_oauth_log_in (BishoPane *_pane)
+{
+  BishoPaneOauth *pane = BISHO_PANE_OAUTH (_pane);
+  BishoPaneOauthPrivate *priv = pane->priv;
+  ServiceInfo *info = _pane->info;
+  BishoPaneOp *op;
   GError *error = NULL;
 
-  if (oauth_proxy_request_token_async (OAUTH_PROXY (priv->proxy),
-                                       info->oauth.request_token_function,
-                                       info->oauth.callback,
-                                       request_token_cb,
-                                       NULL,
-                                       pane,
-                                       &error)) {
-    update_widgets (pane, WORKING);
+  if (claim_prefetch (pane))
+    return;
+
+  op = bisho_pane_op_new (_pane);
+  if (bisho_auth_oauth_request_token (info, priv->proxy, NULL,
+                                      request_token_cb, op, &error)) {
+    bisho_pane_set_state (_pane, BISHO_PANE_STATE_WORKING);
   } else {
-    update_widgets (pane, LOGGED_OUT);
+    bisho_pane_op_finish (op);
+    bisho_pane_set_state (_pane, BISHO_PANE_STATE_LOGGED_OUT);
 
     g_message ("Error from %s: %s", info->name, error->message);
-    bisho_pane_set_banner_error (BISHO_PANE (pane), error);
+    bisho_pane_set_banner_error (_pane, error);
     g_error_free (error);
     return;
   }
 }
 
-
 static void
 delete_done_cb (GnomeKeyringResult result, gpointer user_data)
 {
-  BishoPaneOauth *pane = BISHO_PANE_OAUTH (user_data);
-  MojitoClientService *service;
-  BishoPane *generic_pane = BISHO_PANE (pane);
+  BishoPane *pane = bisho_pane_op_finish (user_data);
+
+  if (pane == NULL)
+    return;
 
   if (result == GNOME_KEYRING_RESULT_OK){
-    update_widgets (pane, LOGGED_OUT);
-    service = mojito_client_get_service (generic_pane->mojito, generic_pane->info->name);
-    mojito_client_service_credentials_updated (service);
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_LOGGED_OUT);
+    bisho_pane_credentials_updated (pane);
   } else {
-    update_widgets (pane, LOGGED_IN);
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_LOGGED_IN);
   }
 }
 
 static void
-log_out_clicked (GtkButton *button, gpointer user_data)
+bisho_pane_oauth_log_out (BishoPane *pane)
 {
-  BishoPaneOauth *pane = BISHO_PANE_OAUTH (user_data);
-  ServiceInfo *info = BISHO_PANE (pane)->info;
+  bisho_pane_set_state (pane, BISHO_PANE_STATE_WORKING);
 
-  update_widgets (pane, WORKING);
+  bisho_webkit_clear_cookies (BISHO_PANE_OAUTH (pane)->priv->browser_info);
 
-  gnome_keyring_delete_password (&oauth_schema, delete_done_cb, user_data, NULL,
-                                 "server", info->oauth.base_url,
-                                 "consumer-key", info->oauth.consumer_key,
-                                 NULL);
+  bisho_keyring_delete (pane->info, delete_done_cb, bisho_pane_op_new (pane));
 }
 
 static void
-access_token_cb (OAuthProxy   *proxy,
+access_token_cb (const char   *token,
+                 const char   *user_name,
                  const GError *error,
-                 GObject      *weak_object,
                  gpointer      user_data)
 {
-  BishoPaneOauth *pane = BISHO_PANE_OAUTH (user_data);
-  ServiceInfo *info = BISHO_PANE (pane)->info;
-  BishoPaneOauthPrivate *priv = pane->priv;
-  MojitoClientService *service;
-  BishoPane *generic_pane = BISHO_PANE (pane);
+  BishoPane *generic_pane = bisho_pane_op_finish (user_data);
+  BishoPaneOauthPrivate *priv;
+  ServiceInfo *info;
+  GnomeKeyringResult result;
   char *encoded;
 
+  if (generic_pane == NULL)
+    return;
+
+  priv = BISHO_PANE_OAUTH (generic_pane)->priv;
+  info = generic_pane->info;
+
   if (error) {
-    update_widgets (pane, LOGGED_OUT);
+    bisho_pane_set_state (generic_pane, BISHO_PANE_STATE_LOGGED_OUT);
     g_message ("Error from %s: %s", info->name, error->message);
-    bisho_pane_set_banner_error (BISHO_PANE (pane), error);
+    bisho_pane_set_banner_error (generic_pane, error);
     return;
   }
 
-  encoded = bisho_utils_encode_tokens
+  encoded = bisho_auth_encode_tokens
     (oauth_proxy_get_token (OAUTH_PROXY (priv->proxy)),
      oauth_proxy_get_token_secret (OAUTH_PROXY (priv->proxy)));
 
   /* TODO async */
-  GnomeKeyringResult result;
-  GnomeKeyringAttributeList *attrs;
-  guint32 id;
-  attrs = gnome_keyring_attribute_list_new ();
-  gnome_keyring_attribute_list_append_string (attrs, "server", info->oauth.base_url);
-  gnome_keyring_attribute_list_append_string (attrs, "consumer-key", info->oauth.consumer_key);
-
-  result = gnome_keyring_item_create_sync (NULL,
-                                           GNOME_KEYRING_ITEM_GENERIC_SECRET,
-                                           info->display_name,
-                                           attrs, encoded,
-                                           TRUE, &id);
+  result = bisho_keyring_store_sync (info, encoded);
+  g_free (encoded);
 
   if (result == GNOME_KEYRING_RESULT_OK) {
-    gnome_keyring_item_grant_access_rights_sync (NULL,
-                                                 "mojito",
-                                                 LIBEXECDIR "/mojito-core",
-                                                 id, GNOME_KEYRING_ACCESS_READ);
-    update_widgets (pane, LOGGED_IN);
-    service = mojito_client_get_service (generic_pane->mojito, info->name);
-    mojito_client_service_credentials_updated (service);
+    bisho_pane_set_state (generic_pane, BISHO_PANE_STATE_LOGGED_IN);
+    bisho_pane_validated (generic_pane);
+    bisho_pane_credentials_updated (generic_pane);
   } else {
     g_message ("Cannot update keyring: %s", gnome_keyring_result_to_message (result));
-    update_widgets (pane, LOGGED_OUT);
+    bisho_pane_set_state (generic_pane, BISHO_PANE_STATE_LOGGED_OUT);
   }
 }
 
@@ -239,7 +376,8 @@ bisho_pane_oauth_continue_auth (BishoPane *_pane, GHashTable *params)
 {
   BishoPaneOauth *pane = BISHO_PANE_OAUTH (_pane);
   BishoPaneOauthPrivate *priv = pane->priv;
-  ServiceInfo *info = BISHO_PANE (pane)->info;
+  ServiceInfo *info = _pane->info;
+  BishoPaneOp *op;
   GError *error = NULL;
   const char *verifier;
 
@@ -252,111 +390,64 @@ bisho_pane_oauth_continue_auth (BishoPane *_pane, GHashTable *params)
    * the parameters we've been passed.
    */
   if (oauth_proxy_is_oauth10a (OAUTH_PROXY (priv->proxy))) {
+    verifier = params ? g_hash_table_lookup (params, "oauth_verifier") : NULL;
+
     /* If 1.0a then a callback must have been specified */
-    if (strcmp (info->oauth.callback, "oob") == 0) {
+    if (verifier == NULL && strcmp (info->oauth.callback, "oob") == 0)
       verifier = gtk_entry_get_text (GTK_ENTRY (priv->pin_entry));
-      gtk_widget_hide (priv->pin_label);
-      gtk_widget_hide (priv->pin_entry);
-    } else {
-      verifier = g_hash_table_lookup (params, "oauth_verifier");
-    }
   } else {
     verifier = NULL;
   }
 
-  if (oauth_proxy_access_token_async (OAUTH_PROXY (priv->proxy),
-                                      info->oauth.access_token_function,
-                                      verifier,
-                                      access_token_cb,
-                                      NULL,
-                                      pane,
-                                      &error)) {
-    update_widgets (pane, WORKING);
+  op = bisho_pane_op_new (_pane);
+  if (bisho_auth_oauth_access_token (info, priv->proxy, verifier, NULL,
+                                     access_token_cb, op, &error)) {
+    bisho_pane_set_state (_pane, BISHO_PANE_STATE_WORKING);
   } else {
-    update_widgets (pane, LOGGED_OUT);
+    bisho_pane_op_finish (op);
+    bisho_pane_set_state (_pane, BISHO_PANE_STATE_LOGGED_OUT);
     g_message ("Error from %s: %s", info->name, error->message);
-    bisho_pane_set_banner_error (BISHO_PANE (pane), error);
+    bisho_pane_set_banner_error (_pane, error);
+    g_error_free (error);
     return;
   }
 }
 
-static void
-continue_clicked (GtkWidget *button, gpointer user_data)
-{
-  bisho_pane_oauth_continue_auth (BISHO_PANE (user_data), NULL);
-}
-
 static void
 session_handler (gpointer data)
 {
   BrowserInfo *browser_info = (BrowserInfo *)data;
-  bisho_pane_oauth_continue_auth (browser_info->pane, NULL);
-}
-
-static void
-update_widgets (BishoPaneOauth *pane, ButtonState state)
-{
-  BishoPaneOauthPrivate *priv;
-  ServiceInfo *info;
+  GHashTable *params = NULL;
+  const char *query;
 
-  g_assert (BISHO_IS_PANE_OAUTH (pane));
-  priv = pane->priv;
-  info = BISHO_PANE (pane)->info;
-
-  g_signal_handlers_disconnect_by_func (priv->button, log_out_clicked, pane);
-  g_signal_handlers_disconnect_by_func (priv->button, continue_clicked, pane);
-  g_signal_handlers_disconnect_by_func (priv->button, log_in_clicked, pane);
-
-  switch (state) {
-  case LOGGED_OUT:
-    bisho_pane_set_banner (BISHO_PANE (pane), NULL);
-    gtk_widget_show (priv->button);
-    gtk_button_set_label (GTK_BUTTON (priv->button), _("Log me in"));
-    g_signal_connect (priv->button, "clicked", G_CALLBACK (log_in_clicked), pane);
-    break;
-  case WORKING:
-    bisho_pane_set_banner (BISHO_PANE (pane), NULL);
-    gtk_widget_hide (priv->button);
-    gtk_button_set_label (GTK_BUTTON (priv->button), _("Working..."));
-    break;
-  case CONTINUE_AUTH_10:
-    {
-      char *s;
+  query = strchr (browser_info->session_url, '?');
+  if (query)
+    params = soup_form_decode (query + 1);
 
-      gtk_widget_show (priv->button);
+  bisho_pane_oauth_continue_auth (browser_info->pane, params);
 
-      s = g_strdup_printf (_("Once you have logged in to %s, press Continue."),
-                           info->display_name);
-      bisho_pane_set_banner (BISHO_PANE (pane), s);
-      g_free (s);
-
-      gtk_button_set_label (GTK_BUTTON (priv->button), _("Continue"));
-      g_signal_connect (priv->button, "clicked", G_CALLBACK (continue_clicked), pane);
-    }
-    break;
-  case CONTINUE_AUTH_10a:
-    {
-      char *s;
+  if (params)
+    g_hash_table_destroy (params);
+}
 
-      gtk_widget_show (priv->pin_label);
-      gtk_widget_show (priv->pin_entry);
-      gtk_widget_show (priv->button);
+/* The code entry is only wanted while waiting for the user to copy it over */
+static void
+bisho_pane_oauth_state_changed (BishoPane *_pane, BishoPaneState state)
+{
+  BishoPaneOauthPrivate *priv = BISHO_PANE_OAUTH (_pane)->priv;
+  char *s;
 
-      s = g_strdup_printf (_("Once you have logged in to %s, enter the code they give you and press Continue."),
-                           info->display_name);
-      bisho_pane_set_banner (BISHO_PANE (pane), s);
-      g_free (s);
+  if (state == BISHO_PANE_STATE_CONTINUE_AUTH && priv->need_pin) {
+    gtk_widget_show (priv->pin_label);
+    gtk_widget_show (priv->pin_entry);
 
-      gtk_button_set_label (GTK_BUTTON (priv->button), _("Continue"));
-      g_signal_connect (priv->button, "clicked", G_CALLBACK (continue_clicked), pane);
-    }
-    break;
-  case LOGGED_IN:
-    bisho_pane_set_banner (BISHO_PANE (pane), _("Log in succeeded. You'll see new items in a couple of minutes."));
-    gtk_widget_show (priv->button);
-    gtk_button_set_label (GTK_BUTTON (priv->button), _("Log me out"));
-    g_signal_connect (priv->button, "clicked", G_CALLBACK (log_out_clicked), pane);
-    break;
+    s = g_strdup_printf (_("Once you have logged in to %s, enter the code they give you and press Continue."),
+                         _pane->info->display_name);
+    bisho_pane_set_banner (_pane, s);
+    g_free (s);
+  } else {
+    gtk_widget_hide (priv->pin_label);
+    gtk_widget_hide (priv->pin_entry);
   }
 }
 
@@ -365,12 +456,15 @@ find_key_cb (GnomeKeyringResult result,
              const char *string,
              gpointer user_data)
 {
-  BishoPaneOauth *pane = BISHO_PANE_OAUTH (user_data);
+  BishoPane *pane = bisho_pane_op_finish (user_data);
+
+  if (pane == NULL)
+    return;
 
   if (result == GNOME_KEYRING_RESULT_OK)
-    update_widgets (pane, LOGGED_IN);
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_LOGGED_IN);
   else
-    update_widgets (pane, LOGGED_OUT);
+    bisho_pane_set_state (pane, BISHO_PANE_STATE_LOGGED_OUT);
 }
 
 static void
@@ -378,7 +472,6 @@ bisho_pane_oauth_init (BishoPaneOauth *pane)
 {
   BishoPaneOauthPrivate *priv;
   GtkWidget *content, *align, *box;
-  ServiceInfo *info = BISHO_PANE (pane)->info;
 
   pane->priv = GET_PRIVATE (pane);
 
@@ -407,6 +500,26 @@ bisho_pane_oauth_init (BishoPaneOauth *pane)
   gtk_box_pack_start (GTK_BOX (box), priv->button, FALSE, FALSE, 0);
 }
 
+/*
+ * Guess the domain login cookies are set on from the API host, which is
+ * usually one level below it: api.twitter.com logs in on .twitter.com.
+ * Services where that is wrong can list CookieDomains in their keys file.
+ */
+static char *
+get_cookie_domain (const char *host)
+{
+  const char *parent;
+
+  if (g_hostname_is_ip_address (host))
+    return g_strdup (host);
+
+  parent = strchr (host, '.');
+  if (parent && strchr (parent + 1, '.'))
+    return g_strdup (parent + 1);
+
+  return g_strdup (host);
+}
+
 static void
 bisho_pane_oauth_constructed (GObject *object)
 {
@@ -414,24 +527,62 @@ bisho_pane_oauth_constructed (GObject *object)
   BishoPaneOauthPrivate *priv = pane->priv;
   ServiceInfo *info = BISHO_PANE (pane)->info;
 
-  bisho_pane_follow_connected (BISHO_PANE (pane), priv->button);
+  bisho_pane_set_button (BISHO_PANE (pane), priv->button);
 
   /* Setup browser_info */
   priv->browser_info->pane = pane;
   priv->browser_info->stop_url = info->oauth.callback;
   priv->browser_info->session_handler = session_handler;
 
-  priv->proxy = oauth_proxy_new (info->oauth.consumer_key,
-                                info->oauth.consumer_secret,
-                                info->oauth.base_url, FALSE);
-  rest_proxy_set_user_agent (priv->proxy, "Bisho/" VERSION);
+  if (info->oauth.cookie_domains) {
+    priv->browser_info->cookie_domains = (const char **) info->oauth.cookie_domains;
+  } else if (info->oauth.base_url) {
+    SoupURI *uri = soup_uri_new (info->oauth.base_url);
+    if (uri) {
+      priv->cookie_domains[0] = get_cookie_domain (uri->host);
+      priv->browser_info->cookie_domains = (const char **) priv->cookie_domains;
+      soup_uri_free (uri);
+    }
+  }
+
+  priv->proxy = bisho_auth_new_proxy (info);
+
+  bisho_timeline_add_host (info->name, info->oauth.base_url);
 
-  update_widgets (pane, WORKING);
+  bisho_pane_set_state (BISHO_PANE (pane), BISHO_PANE_STATE_WORKING);
+
+  bisho_keyring_find (info, find_key_cb, bisho_pane_op_new (BISHO_PANE (pane)));
+}
+
+static void
+bisho_pane_oauth_dispose (GObject *object)
+{
+  BishoPaneOauthPrivate *priv = BISHO_PANE_OAUTH (object)->priv;
+
+  /* The expiry timeout holds a plain pointer to the pane */
+  if (priv->prefetch_timeout) {
+    g_source_remove (priv->prefetch_timeout);
+    priv->prefetch_timeout = 0;
+  }
+
+  if (priv->prefetch_op) {
+    bisho_pane_op_finish (priv->prefetch_op);
+    priv->prefetch_op = NULL;
+  }
+
+  g_free (priv->cookie_domains[0]);
+  priv->cookie_domains[0] = NULL;
+
+  if (priv->browser_info) {
+    /* The browser window's handlers use the info, so close it first */
+    if (priv->browser_info->main_window)
+      gtk_widget_destroy (priv->browser_info->main_window);
+    g_free (priv->browser_info->main_title);
+    g_free (priv->browser_info);
+    priv->browser_info = NULL;
+  }
 
-  gnome_keyring_find_password (&oauth_schema, find_key_cb, pane, NULL,
-                               "server", info->oauth.base_url,
-                               "consumer-key", info->oauth.consumer_key,
-                               NULL);
+  G_OBJECT_CLASS (bisho_pane_oauth_parent_class)->dispose (object);
 }
 
 static void
@@ -441,7 +592,12 @@ bisho_pane_oauth_class_init (BishoPaneOauthClass *klass)
   BishoPaneClass *pane_class = BISHO_PANE_CLASS (klass);
 
   o_class->constructed = bisho_pane_oauth_constructed;
+  o_class->dispose = bisho_pane_oauth_dispose;
+  pane_class->log_in = bisho_pane_oauth_log_in;
   pane_class->continue_auth = bisho_pane_oauth_continue_auth;
+  pane_class->log_out = bisho_pane_oauth_log_out;
+  pane_class->expanded = bisho_pane_oauth_expanded;
+  pane_class->state_changed = bisho_pane_oauth_state_changed;
 
   g_type_class_add_private (klass, sizeof (BishoPaneOauthPrivate));
 }
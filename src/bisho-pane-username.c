@@ -18,12 +18,23 @@
  */
 
 #include <config.h>
+#include <string.h>
 #include <glib/gi18n.h>
 #include <gconf/gconf-client.h>
 #include <gtk/gtk.h>
 #include "bisho-pane-username.h"
+#include "bisho-verify.h"
+#include "bisho-metrics.h"
+#include "bisho-watchdog.h"
 
 #define DATA_GCONF_KEY "bisho:gconf-key"
+/* The last part of the GConf key, such as "user" */
+#define DATA_KEY "bisho:key"
+/* The entry's value as last read from or written to GConf */
+#define DATA_SAVED "bisho:saved"
+
+/* How long to wait after the last edit before saving */
+#define COMMIT_DELAY 1000
 
 struct _BishoPaneUsernamePrivate {
   GConfClient *gconf;
@@ -31,54 +42,343 @@ struct _BishoPaneUsernamePrivate {
   GtkWidget *entry;
   char *key;
   guint rows;
+  GSList *entries;
+  /* The pending save, if any */
+  guint commit_id;
+  /* Watching the service's GConf directory */
+  guint notify_id;
+  /* The check in flight, if any, and where its result is shown */
+  GCancellable *verify;
+  GtkWidget *verify_label;
 };
 
 #define GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), BISHO_TYPE_PANE_USERNAME, BishoPaneUsernamePrivate))
 G_DEFINE_TYPE (BishoPaneUsername, bisho_pane_username, BISHO_TYPE_PANE);
 
+/* The service is usable once every entry has been filled in */
+static void
+update_state (BishoPaneUsername *pane)
+{
+  GSList *l;
+
+  for (l = pane->priv->entries; l; l = l->next) {
+    if (gtk_entry_get_text (GTK_ENTRY (l->data))[0] == '\0') {
+      bisho_pane_set_state (BISHO_PANE (pane), BISHO_PANE_STATE_LOGGED_OUT);
+      return;
+    }
+  }
+
+  bisho_pane_set_state (BISHO_PANE (pane), BISHO_PANE_STATE_LOGGED_IN);
+}
+
 static gboolean
-on_entry_left (GtkWidget *widget, GdkEventFocus *event, gpointer user_data)
+is_dirty (GtkWidget *entry)
 {
-  BishoPaneUsername *pane = BISHO_PANE_USERNAME (user_data);
-  ServiceInfo *info = NULL;
+  const char *saved;
+
+  saved = g_object_get_data (G_OBJECT (entry), DATA_SAVED);
+  return strcmp (saved ?: "", gtk_entry_get_text (GTK_ENTRY (entry))) != 0;
+}
+
+/*
+ * Save every changed entry in one change set, so that listeners see the user
+ * name and password change together.
+ */
+static void
+commit (BishoPaneUsername *pane)
+{
+  BishoPaneUsernamePrivate *priv = pane->priv;
+  ServiceInfo *info = BISHO_PANE (pane)->info;
+  GConfChangeSet *changes;
+  GSList *l;
   const char *key;
   char *message;
+  gint64 start;
+  gboolean saved;
+  GError *error = NULL;
 
-  g_object_get (pane, "service", &info, NULL);
-  g_assert (info);
+  if (priv->commit_id) {
+    g_source_remove (priv->commit_id);
+    priv->commit_id = 0;
+  }
+
+  changes = gconf_change_set_new ();
+  for (l = priv->entries; l; l = l->next) {
+    key = g_object_get_data (G_OBJECT (l->data), DATA_GCONF_KEY);
+    if (is_dirty (l->data))
+      gconf_change_set_set_string (changes, key,
+                                   gtk_entry_get_text (GTK_ENTRY (l->data)));
+  }
+
+  if (gconf_change_set_size (changes) == 0) {
+    gconf_change_set_unref (changes);
+    return;
+  }
+
+  start = g_get_monotonic_time ();
+  bisho_watchdog_span_begin ("gconf.write");
+  saved = gconf_client_commit_change_set (priv->gconf, changes, TRUE, &error);
+  bisho_watchdog_span_end ();
+  bisho_metrics_observe_since ("gconf.write", start);
 
-  key = g_object_get_data (G_OBJECT (widget), DATA_GCONF_KEY);
-  g_assert (key);
+  /* Committed keys are removed from the set, so what's left has failed */
+  for (l = priv->entries; l; l = l->next) {
+    key = g_object_get_data (G_OBJECT (l->data), DATA_GCONF_KEY);
+    if (is_dirty (l->data) && !gconf_change_set_check_value (changes, key, NULL))
+      g_object_set_data_full (G_OBJECT (l->data), DATA_SAVED,
+                              g_strdup (gtk_entry_get_text (GTK_ENTRY (l->data))),
+                              g_free);
+  }
+  gconf_change_set_unref (changes);
 
-  gconf_client_set_string (pane->priv->gconf, key,
-                           gtk_entry_get_text (GTK_ENTRY (widget)),
-                           NULL);
+  if (!saved) {
+    g_message ("Cannot save %s login: %s", info->name, error->message);
+    g_error_free (error);
+    message = g_strdup_printf (_("Sorry, the %s login could not be saved."),
+                               info->display_name);
+    bisho_pane_set_banner (BISHO_PANE (pane), message);
+    g_free (message);
+    return;
+  }
 
   message = g_strdup_printf (_("%s login changed."), info->display_name);
   bisho_pane_set_banner (BISHO_PANE (pane), message);
   g_free (message);
 
+  update_state (pane);
+}
+
+static const char *
+get_entry_text (BishoPaneUsername *pane, const char *key)
+{
+  GSList *l;
+
+  for (l = pane->priv->entries; l; l = l->next) {
+    if (strcmp (g_object_get_data (G_OBJECT (l->data), DATA_KEY), key) == 0)
+      return gtk_entry_get_text (GTK_ENTRY (l->data));
+  }
+
+  return NULL;
+}
+
+static void
+cancel_verify (BishoPaneUsername *pane)
+{
+  BishoPaneUsernamePrivate *priv = pane->priv;
+
+  if (priv->verify) {
+    g_cancellable_cancel (priv->verify);
+    g_object_unref (priv->verify);
+    priv->verify = NULL;
+  }
+
+  gtk_widget_hide (priv->verify_label);
+}
+
+static void
+verify_cb (BishoVerifyResult result, gpointer user_data)
+{
+  BishoPaneUsername *pane = BISHO_PANE_USERNAME (user_data);
+  BishoPaneUsernamePrivate *priv = pane->priv;
+  ServiceInfo *info = BISHO_PANE (pane)->info;
+  char *s;
+
+  g_object_unref (priv->verify);
+  priv->verify = NULL;
+
+  switch (result) {
+  case BISHO_VERIFY_OK:
+    s = g_strdup_printf (_("%s accepted these details."), info->display_name);
+    bisho_pane_validated (BISHO_PANE (pane));
+    break;
+  case BISHO_VERIFY_REJECTED:
+    if (info->auth == AUTH_USERNAME_PASSWORD)
+      s = g_strdup_printf (_("%s didn't accept this username or password."),
+                           info->display_name);
+    else
+      s = g_strdup_printf (_("%s doesn't know this username."), info->display_name);
+    break;
+  case BISHO_VERIFY_UNKNOWN:
+  default:
+    s = g_strdup_printf (_("Cannot check these details with %s right now."),
+                         info->display_name);
+    break;
+  }
+
+  gtk_label_set_text (GTK_LABEL (priv->verify_label), s);
+  gtk_widget_show (priv->verify_label);
+  g_free (s);
+}
+
+/* Check the details with the service, if it says how */
+static void
+start_verify (BishoPaneUsername *pane)
+{
+  BishoPaneUsernamePrivate *priv = pane->priv;
+  ServiceInfo *info = BISHO_PANE (pane)->info;
+  const char *user, *password;
+
+  cancel_verify (pane);
+
+  if (!bisho_verify_is_supported (info))
+    return;
+
+  user = get_entry_text (pane, "user");
+  password = get_entry_text (pane, "password");
+  if (user == NULL || user[0] == '\0' || (password && password[0] == '\0'))
+    return;
+
+  gtk_label_set_text (GTK_LABEL (priv->verify_label), _("Checking..."));
+  gtk_widget_show (priv->verify_label);
+
+  priv->verify = g_cancellable_new ();
+  bisho_verify (info, user, password, priv->verify, verify_cb, pane);
+}
+
+static gboolean
+commit_timeout_cb (gpointer user_data)
+{
+  BishoPaneUsername *pane = BISHO_PANE_USERNAME (user_data);
+
+  pane->priv->commit_id = 0;
+  commit (pane);
+  start_verify (pane);
+
   return FALSE;
 }
 
+/* Save and check once the user stops typing */
+static void
+on_entry_changed (GtkEditable *editable, gpointer user_data)
+{
+  BishoPaneUsername *pane = BISHO_PANE_USERNAME (user_data);
+
+  /* The details being checked are out of date */
+  cancel_verify (pane);
+
+  if (pane->priv->commit_id)
+    g_source_remove (pane->priv->commit_id);
+
+  pane->priv->commit_id = g_timeout_add (COMMIT_DELAY, commit_timeout_cb, pane);
+}
+
+/*
+ * Show changes made elsewhere, unless the user is editing the entry, in which
+ * case their edit wins when it is saved.
+ */
+static void
+on_gconf_changed (GConfClient *client, guint cnxn_id,
+                  GConfEntry *gconf_entry, gpointer user_data)
+{
+  BishoPaneUsername *pane = BISHO_PANE_USERNAME (user_data);
+  GConfValue *value;
+  const char *text;
+  GtkWidget *entry;
+  gboolean dirty;
+  GSList *l;
+
+  for (l = pane->priv->entries; l; l = l->next) {
+    if (strcmp (g_object_get_data (G_OBJECT (l->data), DATA_GCONF_KEY),
+                gconf_entry_get_key (gconf_entry)) == 0)
+      break;
+  }
+  if (l == NULL)
+    return;
+
+  entry = l->data;
+  value = gconf_entry_get_value (gconf_entry);
+  text = value && value->type == GCONF_VALUE_STRING ? gconf_value_get_string (value) : "";
+
+  dirty = is_dirty (entry);
+  g_object_set_data_full (G_OBJECT (entry), DATA_SAVED, g_strdup (text), g_free);
+  if (dirty)
+    return;
+
+  g_signal_handlers_block_by_func (entry, on_entry_changed, pane);
+  gtk_entry_set_text (GTK_ENTRY (entry), text);
+  g_signal_handlers_unblock_by_func (entry, on_entry_changed, pane);
+
+  update_state (pane);
+}
+
+static void
+bisho_pane_username_expanded (BishoPane *pane, gboolean expanded)
+{
+  if (!expanded)
+    commit (BISHO_PANE_USERNAME (pane));
+}
+
 static void
 bisho_pane_username_init (BishoPaneUsername *self)
 {
+  GtkWidget *box;
+
   self->priv = GET_PRIVATE (self);
   self->priv->gconf = gconf_client_get_default ();
 
+  box = gtk_vbox_new (FALSE, 6);
+  gtk_widget_show (box);
+  gtk_container_add (GTK_CONTAINER (BISHO_PANE (self)->content), box);
+
   self->priv->table = gtk_table_new (0, 0, FALSE);
   g_object_set (self->priv->table,
                 "row-spacing", 6,
                 "column-spacing", 6,
                 NULL);
   gtk_widget_show (self->priv->table);
-  gtk_container_add (GTK_CONTAINER (BISHO_PANE (self)->content), self->priv->table);
+  gtk_box_pack_start (GTK_BOX (box), self->priv->table, FALSE, FALSE, 0);
+
+  /* Not shown until there is something to say */
+  self->priv->verify_label = gtk_label_new (NULL);
+  gtk_misc_set_alignment (GTK_MISC (self->priv->verify_label), 0.0, 0.5);
+  gtk_box_pack_start (GTK_BOX (box), self->priv->verify_label, FALSE, FALSE, 0);
+}
+
+static void
+bisho_pane_username_dispose (GObject *object)
+{
+  BishoPaneUsername *pane = BISHO_PANE_USERNAME (object);
+
+  /* Don't lose the last edits */
+  if (pane->priv->commit_id)
+    commit (pane);
+
+  if (pane->priv->notify_id) {
+    gconf_client_notify_remove (pane->priv->gconf, pane->priv->notify_id);
+    pane->priv->notify_id = 0;
+  }
+
+  if (pane->priv->verify) {
+    g_cancellable_cancel (pane->priv->verify);
+    g_object_unref (pane->priv->verify);
+    pane->priv->verify = NULL;
+  }
+
+  G_OBJECT_CLASS (bisho_pane_username_parent_class)->dispose (object);
+}
+
+static void
+bisho_pane_username_finalize (GObject *object)
+{
+  BishoPaneUsernamePrivate *priv = BISHO_PANE_USERNAME (object)->priv;
+
+  g_slist_free (priv->entries);
+  g_object_unref (priv->gconf);
+
+  G_OBJECT_CLASS (bisho_pane_username_parent_class)->finalize (object);
 }
 
 static void
 bisho_pane_username_class_init (BishoPaneUsernameClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  BishoPaneClass *pane_class = BISHO_PANE_CLASS (klass);
+
+  object_class->dispose = bisho_pane_username_dispose;
+  object_class->finalize = bisho_pane_username_finalize;
+
+  pane_class->expanded = bisho_pane_username_expanded;
+
   g_type_class_add_private (klass, sizeof (BishoPaneUsernamePrivate));
 }
 
@@ -97,8 +397,9 @@ bisho_pane_username_add_entry (BishoPaneUsername *pane, const char *label, const
 {
   BishoPaneUsernamePrivate *priv;
   GtkWidget *label_w, *entry;
-  char *gconf_key, *value;
+  char *gconf_key, *gconf_dir, *value;
   ServiceInfo *info;
+  gint64 start;
 
   g_return_if_fail (BISHO_IS_PANE_USERNAME (pane));
   g_return_if_fail (label);
@@ -116,19 +417,34 @@ bisho_pane_username_add_entry (BishoPaneUsername *pane, const char *label, const
   entry = gtk_entry_new ();
   gtk_entry_set_visibility (GTK_ENTRY (entry), visible);
   gtk_entry_set_width_chars (GTK_ENTRY (entry), 30);
-  g_signal_connect (entry, "focus-out-event", G_CALLBACK (on_entry_left), pane);
   gtk_widget_show (entry);
   gtk_table_attach (GTK_TABLE (priv->table), entry,
                     1, 2, priv->rows, priv->rows + 1, GTK_FILL, GTK_FILL, 0, 0);
 
-  gconf_key = g_strdup_printf ("/apps/mojito/services/%s/%s", info->name, key);
+  gconf_key = g_strdup_printf (SERVICE_INFO_GCONF_DIR "/%s/%s", info->name, key);
   g_object_set_data_full (G_OBJECT (entry), DATA_GCONF_KEY, gconf_key, g_free);
+  g_object_set_data_full (G_OBJECT (entry), DATA_KEY, g_strdup (key), g_free);
 
+  /* BishoWindow has preloaded the directory, so this is normally cached */
+  start = g_get_monotonic_time ();
+  bisho_watchdog_span_begin ("gconf.read");
   value = gconf_client_get_string (priv->gconf, gconf_key, NULL);
-  if (value) {
+  bisho_watchdog_span_end ();
+  bisho_metrics_observe_since ("gconf.read", start);
+  if (value)
     gtk_entry_set_text (GTK_ENTRY (entry), value);
-    g_free (value);
-  }
+  g_object_set_data_full (G_OBJECT (entry), DATA_SAVED, value, g_free);
+  g_signal_connect (entry, "changed", G_CALLBACK (on_entry_changed), pane);
 
   priv->rows++;
+  priv->entries = g_slist_append (priv->entries, entry);
+
+  if (priv->notify_id == 0) {
+    gconf_dir = g_strdup_printf (SERVICE_INFO_GCONF_DIR "/%s", info->name);
+    priv->notify_id = gconf_client_notify_add (priv->gconf, gconf_dir,
+                                               on_gconf_changed, pane, NULL, NULL);
+    g_free (gconf_dir);
+  }
+
+  update_state (pane);
 }
@@ -21,20 +21,85 @@
 #include <glib/gi18n.h>
 #include <gtk/gtk.h>
 #include "bisho-pane.h"
+#include "bisho-accounts.h"
+#include "bisho-timeline.h"
+#include "bisho-probes.h"
 #include "mux-label.h"
 
 #if ! HAVE_DECL_GTK_INFO_BAR_NEW
 #include "gtkinfobar.h"
 #endif
 
+#define GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), BISHO_TYPE_PANE, BishoPanePrivate))
 G_DEFINE_ABSTRACT_TYPE (BishoPane, bisho_pane, GTK_TYPE_VBOX);
 
+struct _BishoPanePrivate {
+  /* The log in/continue/log out button, if the pane has one */
+  GtkWidget *button;
+  /* Bumped whenever an operation starts, making older ones stale */
+  guint op_serial;
+  /* When the current state was entered */
+  gint64 state_since;
+  guint state_times[BISHO_PANE_N_STATES][BISHO_PANE_HISTOGRAM_BUCKETS];
+  gboolean expanded;
+  /* Whether mojito is online, as told by bisho_pane_set_online() */
+  gboolean online;
+  /* Widgets only sensitive while online */
+  GSList *connected;
+};
+
+/* An asynchronous step started on behalf of a pane */
+struct _BishoPaneOp {
+  BishoPane *pane;
+  guint serial;
+};
+
+typedef struct {
+  const char *name;
+  /* The button's label, and whether it can be pressed */
+  const char *button;
+  gboolean sensitive;
+  /* The banner, with %s for the service's name */
+  const char *banner;
+} StateInfo;
+
+static const StateInfo states[BISHO_PANE_N_STATES] = {
+  { "logged-out", N_("Log me in"), TRUE, NULL },
+  { "working", N_("Working..."), FALSE, NULL },
+  { "continue-auth", N_("Continue"), TRUE,
+    N_("Once you have logged in to %s, press Continue.") },
+  { "logged-in", N_("Log me out"), TRUE,
+    N_("Log in succeeded. You'll see new items in a couple of minutes.") },
+};
+
+/*
+ * The transitions allowed from each state.  Credentials can only be found to
+ * work by checking them, and only lost by logging out, so there is no direct
+ * path between CONTINUE_AUTH and LOGGED_IN.
+ */
+static const gboolean transitions[BISHO_PANE_N_STATES][BISHO_PANE_N_STATES] = {
+  /*                    LOGGED_OUT WORKING CONTINUE_AUTH LOGGED_IN */
+  /* LOGGED_OUT */    { TRUE,      TRUE,   TRUE,         TRUE },
+  /* WORKING */       { TRUE,      TRUE,   TRUE,         TRUE },
+  /* CONTINUE_AUTH */ { TRUE,      TRUE,   TRUE,         FALSE },
+  /* LOGGED_IN */     { TRUE,      TRUE,   FALSE,        TRUE },
+};
+
 enum {
   PROP_0,
   PROP_SERVICE,
   PROP_MOJITO
 };
 
+enum {
+  STATE_CHANGED,
+  OPEN_URL,
+  CREDENTIALS_UPDATED,
+  LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL];
+
 static void
 bisho_pane_get_property (GObject *object, guint property_id,
                          GValue *value, GParamSpec *pspec)
@@ -101,6 +166,16 @@ bisho_pane_set_property (GObject *object, guint property_id,
   }
 }
 
+static void
+bisho_pane_finalize (GObject *object)
+{
+  BishoPane *pane = BISHO_PANE (object);
+
+  g_slist_free (pane->priv->connected);
+
+  G_OBJECT_CLASS (bisho_pane_parent_class)->finalize (object);
+}
+
 static void
 bisho_pane_class_init (BishoPaneClass *klass)
 {
@@ -109,6 +184,7 @@ bisho_pane_class_init (BishoPaneClass *klass)
 
     object_class->get_property = bisho_pane_get_property;
     object_class->set_property = bisho_pane_set_property;
+    object_class->finalize = bisho_pane_finalize;
 
     pspec = g_param_spec_pointer ("service", "service", "service",
                                   G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
@@ -118,6 +194,36 @@ bisho_pane_class_init (BishoPaneClass *klass)
                                  MOJITO_TYPE_CLIENT,
                                  G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
     g_object_class_install_property (object_class, PROP_MOJITO, pspec);
+
+    signals[STATE_CHANGED] = g_signal_new ("state-changed",
+                                           G_TYPE_FROM_CLASS (klass),
+                                           G_SIGNAL_RUN_LAST,
+                                           G_STRUCT_OFFSET (BishoPaneClass, state_changed),
+                                           NULL, NULL,
+                                           g_cclosure_marshal_VOID__UINT,
+                                           G_TYPE_NONE, 1, G_TYPE_UINT);
+
+    /* Emitted when the pane wants the user to visit a page.  Return TRUE to
+       stop the pane from opening a browser itself. */
+    signals[OPEN_URL] = g_signal_new ("open-url",
+                                      G_TYPE_FROM_CLASS (klass),
+                                      G_SIGNAL_RUN_LAST,
+                                      G_STRUCT_OFFSET (BishoPaneClass, open_url),
+                                      g_signal_accumulator_true_handled, NULL,
+                                      NULL,
+                                      G_TYPE_BOOLEAN, 1, G_TYPE_STRING);
+
+    /* Emitted when the credentials in the keyring have been stored or
+       deleted, so that whoever owns the pane can tell mojito. */
+    signals[CREDENTIALS_UPDATED] = g_signal_new ("credentials-updated",
+                                                 G_TYPE_FROM_CLASS (klass),
+                                                 G_SIGNAL_RUN_LAST,
+                                                 G_STRUCT_OFFSET (BishoPaneClass, credentials_updated),
+                                                 NULL, NULL,
+                                                 g_cclosure_marshal_VOID__VOID,
+                                                 G_TYPE_NONE, 0);
+
+    g_type_class_add_private (klass, sizeof (BishoPanePrivate));
 }
 
 static void
@@ -125,6 +231,11 @@ bisho_pane_init (BishoPane *pane)
 {
   GtkWidget *align, *banner_content;
 
+  pane->priv = GET_PRIVATE (pane);
+  pane->priv->state_since = g_get_monotonic_time ();
+  /* Until told otherwise */
+  pane->priv->online = TRUE;
+
   gtk_box_set_spacing (GTK_BOX (pane), 8);
 
   pane->description = mux_label_new ();
@@ -170,10 +281,279 @@ bisho_pane_continue_auth (BishoPane *pane, GHashTable *params)
 {
   BishoPaneClass *pane_class = BISHO_PANE_GET_CLASS (pane);
 
+  BISHO_PROBE2 (pane__continue__auth, pane->info->name, states[pane->state].name);
+
   if (pane_class->continue_auth)
     pane_class->continue_auth (pane, params);
 }
 
+/*
+ * Called when the expander holding the pane is opened or closed, so that panes
+ * can start work the user is likely to ask for.  While offline the expanded
+ * method isn't told about opening until the connection comes back.
+ */
+void
+bisho_pane_set_expanded (BishoPane *pane, gboolean expanded)
+{
+  BishoPaneClass *pane_class;
+
+  g_return_if_fail (BISHO_IS_PANE (pane));
+
+  pane_class = BISHO_PANE_GET_CLASS (pane);
+  pane->priv->expanded = expanded;
+
+  if (pane_class->expanded && (pane->priv->online || !expanded))
+    pane_class->expanded (pane, expanded);
+}
+
+/* Drive the button and banner, for panes that have handed over their button */
+static void
+update_widgets (BishoPane *pane, BishoPaneState state)
+{
+  GtkWidget *button = pane->priv->button;
+  char *s;
+
+  if (button == NULL)
+    return;
+
+  gtk_widget_show (button);
+  gtk_widget_set_sensitive (button, states[state].sensitive && pane->priv->online);
+  gtk_button_set_label (GTK_BUTTON (button), _(states[state].button));
+
+  if (states[state].banner) {
+    s = g_strdup_printf (_(states[state].banner), pane->info->display_name);
+    bisho_pane_set_banner (pane, s);
+    g_free (s);
+  } else {
+    bisho_pane_set_banner (pane, NULL);
+  }
+
+  if (state == BISHO_PANE_STATE_LOGGED_OUT)
+    bisho_pane_set_user (pane, NULL, NULL);
+}
+
+static void
+record_time_in_state (BishoPane *pane, BishoPaneState state)
+{
+  BishoPanePrivate *priv = pane->priv;
+  gint64 now;
+  guint64 ms;
+  guint bucket;
+
+  now = g_get_monotonic_time ();
+  ms = (now - priv->state_since) / 1000;
+  priv->state_since = now;
+
+  bucket = MIN (g_bit_storage (ms) - (ms == 0), BISHO_PANE_HISTOGRAM_BUCKETS - 1);
+  priv->state_times[state][bucket]++;
+
+  g_debug ("%s was %s for %" G_GUINT64_FORMAT "ms",
+           pane->info->name, states[state].name, ms);
+}
+
+void
+bisho_pane_set_state (BishoPane *pane, BishoPaneState state)
+{
+  BishoPaneState old_state;
+
+  g_return_if_fail (BISHO_IS_PANE (pane));
+  g_return_if_fail (state < BISHO_PANE_N_STATES);
+
+  old_state = pane->state;
+
+  if (!transitions[old_state][state]) {
+    g_warning ("%s cannot go from %s to %s", pane->info->name,
+               states[old_state].name, states[state].name);
+    return;
+  }
+
+  if (state != old_state)
+    record_time_in_state (pane, old_state);
+
+  pane->state = state;
+
+  update_widgets (pane, state);
+
+  /* Keep the account cache used by bisho --status up to date */
+  if (state == BISHO_PANE_STATE_LOGGED_OUT && old_state != BISHO_PANE_STATE_LOGGED_OUT)
+    bisho_accounts_forget (pane->info->name);
+
+  g_signal_emit (pane, signals[STATE_CHANGED], 0, state);
+}
+
+/*
+ * Record in the account cache that the service has just accepted the
+ * credentials, as the user shown.  Only call this after actually checking
+ * them, as it writes the cache.
+ */
+void
+bisho_pane_validated (BishoPane *pane)
+{
+  g_return_if_fail (BISHO_IS_PANE (pane));
+
+  bisho_accounts_validated (pane->info->name,
+                            GTK_WIDGET_VISIBLE (pane->user_name) ?
+                            gtk_label_get_text (GTK_LABEL (pane->user_name)) : NULL);
+}
+
+BishoPaneState
+bisho_pane_get_state (BishoPane *pane)
+{
+  g_return_val_if_fail (BISHO_IS_PANE (pane), BISHO_PANE_STATE_LOGGED_OUT);
+
+  return pane->state;
+}
+
+/* Whether the user has to do something: finish logging in, or read an error */
+gboolean
+bisho_pane_needs_attention (BishoPane *pane)
+{
+  g_return_val_if_fail (BISHO_IS_PANE (pane), FALSE);
+
+  if (pane->state == BISHO_PANE_STATE_CONTINUE_AUTH)
+    return TRUE;
+
+  return GTK_WIDGET_VISIBLE (pane->banner) &&
+    gtk_info_bar_get_message_type (GTK_INFO_BAR (pane->banner)) == GTK_MESSAGE_WARNING;
+}
+
+const char *
+bisho_pane_state_to_string (BishoPaneState state)
+{
+  g_return_val_if_fail (state < BISHO_PANE_N_STATES, NULL);
+
+  return states[state].name;
+}
+
+/*
+ * How long the pane has stayed in @state, as BISHO_PANE_HISTOGRAM_BUCKETS
+ * counts.  The current stay isn't included until the state is left.
+ */
+const guint *
+bisho_pane_get_state_histogram (BishoPane *pane, BishoPaneState state)
+{
+  g_return_val_if_fail (BISHO_IS_PANE (pane), NULL);
+  g_return_val_if_fail (state < BISHO_PANE_N_STATES, NULL);
+
+  return pane->priv->state_times[state];
+}
+
+static void
+button_clicked_cb (GtkButton *button, gpointer user_data)
+{
+  BishoPane *pane = BISHO_PANE (user_data);
+  BishoPaneClass *pane_class = BISHO_PANE_GET_CLASS (pane);
+
+  /* Whatever was in flight no longer matters */
+  pane->priv->op_serial++;
+
+  switch (pane->state) {
+  case BISHO_PANE_STATE_LOGGED_OUT:
+    bisho_timeline_reset (pane->info->name);
+    if (pane_class->log_in)
+      pane_class->log_in (pane);
+    break;
+  case BISHO_PANE_STATE_CONTINUE_AUTH:
+    bisho_pane_continue_auth (pane, NULL);
+    break;
+  case BISHO_PANE_STATE_LOGGED_IN:
+    bisho_timeline_reset (pane->info->name);
+    if (pane_class->log_out)
+      pane_class->log_out (pane);
+    break;
+  case BISHO_PANE_STATE_WORKING:
+    break;
+  }
+}
+
+/*
+ * Hand the pane's button over to the state machine, which then sets its label
+ * and the banner on every transition, and calls the log_in, continue_auth and
+ * log_out methods when it is pressed.
+ */
+void
+bisho_pane_set_button (BishoPane *pane, GtkWidget *button)
+{
+  g_return_if_fail (BISHO_IS_PANE (pane));
+  g_return_if_fail (GTK_IS_BUTTON (button));
+  g_return_if_fail (pane->priv->button == NULL);
+
+  pane->priv->button = button;
+  g_signal_connect (button, "clicked", G_CALLBACK (button_clicked_cb), pane);
+  bisho_pane_follow_connected (pane, button);
+
+  update_widgets (pane, pane->state);
+}
+
+/*
+ * Start an asynchronous step.  Pass the op as the step's user data, and call
+ * bisho_pane_op_finish() when it completes.
+ */
+BishoPaneOp *
+bisho_pane_op_new (BishoPane *pane)
+{
+  BishoPaneOp *op;
+
+  g_return_val_if_fail (BISHO_IS_PANE (pane), NULL);
+
+  op = g_slice_new (BishoPaneOp);
+  op->pane = pane;
+  op->serial = ++pane->priv->op_serial;
+  g_object_add_weak_pointer (G_OBJECT (pane), (gpointer *)&op->pane);
+
+  return op;
+}
+
+/*
+ * Frees @op, and returns the pane it was started for, or NULL if the pane has
+ * gone or another step has started since, in which case the result should be
+ * dropped.
+ */
+BishoPane *
+bisho_pane_op_finish (BishoPaneOp *op)
+{
+  BishoPane *pane;
+
+  g_return_val_if_fail (op, NULL);
+
+  pane = op->pane;
+  if (pane) {
+    g_object_remove_weak_pointer (G_OBJECT (pane), (gpointer *)&op->pane);
+    if (op->serial != pane->priv->op_serial) {
+      g_debug ("Dropping a stale result for %s", pane->info->name);
+      pane = NULL;
+    }
+  }
+
+  g_slice_free (BishoPaneOp, op);
+  return pane;
+}
+
+/* The pane has stored or deleted the service's credentials */
+void
+bisho_pane_credentials_updated (BishoPane *pane)
+{
+  g_return_if_fail (BISHO_IS_PANE (pane));
+
+  g_signal_emit (pane, signals[CREDENTIALS_UPDATED], 0);
+}
+
+/*
+ * Give anyone listening a chance to handle the URL.  Returns TRUE if they did,
+ * otherwise the pane should open a browser.
+ */
+gboolean
+bisho_pane_open_url (BishoPane *pane, const char *url)
+{
+  gboolean handled = FALSE;
+
+  g_return_val_if_fail (BISHO_IS_PANE (pane), FALSE);
+
+  g_signal_emit (pane, signals[OPEN_URL], 0, url, &handled);
+
+  return handled;
+}
+
 void
 bisho_pane_set_banner (BishoPane *pane, const char *message)
 {
@@ -231,21 +611,70 @@ bisho_pane_set_user (BishoPane *pane, const char *icon, const char *username)
   }
 }
 
+/* The button also depends on the state */
+static void
+update_sensitive (BishoPane *pane, GtkWidget *widget)
+{
+  gboolean sensitive = pane->priv->online;
+
+  if (widget == pane->priv->button)
+    sensitive = sensitive && states[pane->state].sensitive;
+
+  gtk_widget_set_sensitive (widget, sensitive);
+}
+
+/*
+ * Tell the pane whether mojito is online.  BishoWindow asks mojito once and
+ * passes every change on to all the panes.
+ */
+void
+bisho_pane_set_online (BishoPane *pane, gboolean online)
+{
+  BishoPanePrivate *priv;
+  BishoPaneClass *pane_class;
+  gboolean was_online;
+  GSList *l;
+
+  g_return_if_fail (BISHO_IS_PANE (pane));
+
+  priv = pane->priv;
+  was_online = priv->online;
+  priv->online = online;
+
+  for (l = priv->connected; l; l = l->next)
+    update_sensitive (pane, l->data);
+
+  /* Start the work that was put off when the pane was opened */
+  pane_class = BISHO_PANE_GET_CLASS (pane);
+  if (online && !was_online && priv->expanded && pane_class->expanded)
+    pane_class->expanded (pane, TRUE);
+}
+
+gboolean
+bisho_pane_get_online (BishoPane *pane)
+{
+  g_return_val_if_fail (BISHO_IS_PANE (pane), FALSE);
+
+  return pane->priv->online;
+}
+
 static void
-on_online_changed (MojitoClient *client, gboolean online, gpointer user_data)
+connected_destroy_cb (GtkWidget *widget, gpointer user_data)
 {
-  GtkWidget *widget = GTK_WIDGET (user_data);
+  BishoPane *pane = BISHO_PANE (user_data);
 
-  gtk_widget_set_sensitive (widget, online);
+  pane->priv->connected = g_slist_remove (pane->priv->connected, widget);
 }
 
+/* Make @widget insensitive while offline */
 void
 bisho_pane_follow_connected (BishoPane *pane, GtkWidget *widget)
 {
   g_return_if_fail (BISHO_IS_PANE (pane));
   g_return_if_fail (GTK_IS_WIDGET (widget));
 
-  g_signal_connect (pane->mojito, "online-changed", G_CALLBACK (on_online_changed), widget);
+  pane->priv->connected = g_slist_prepend (pane->priv->connected, widget);
+  g_signal_connect (widget, "destroy", G_CALLBACK (connected_destroy_cb), pane);
 
-  mojito_client_is_online (pane->mojito, on_online_changed, widget);
+  update_sensitive (pane, widget);
 }
@@ -21,11 +21,26 @@ G_BEGIN_DECLS
 
 typedef struct _BishoPane BishoPane;
 typedef struct _BishoPaneClass BishoPaneClass;
+typedef struct _BishoPanePrivate BishoPanePrivate;
+typedef struct _BishoPaneOp BishoPaneOp;
+
+typedef enum {
+  BISHO_PANE_STATE_LOGGED_OUT,
+  BISHO_PANE_STATE_WORKING,
+  BISHO_PANE_STATE_CONTINUE_AUTH,
+  BISHO_PANE_STATE_LOGGED_IN,
+} BishoPaneState;
+
+#define BISHO_PANE_N_STATES (BISHO_PANE_STATE_LOGGED_IN + 1)
+
+/* Bucket 0 counts stays under 1ms, bucket n those of 2^(n-1) to 2^n ms */
+#define BISHO_PANE_HISTOGRAM_BUCKETS 20
 
 struct _BishoPane {
   GtkVBox parent;
   MojitoClient *mojito;
   ServiceInfo *info;
+  BishoPaneState state;
   GtkWidget *description;
   GtkWidget *banner;
   GtkWidget *banner_label;
@@ -34,23 +49,60 @@ struct _BishoPane {
   GtkWidget *user_name;
   GtkWidget *content;
   GtkWidget *disclaimer;
+  BishoPanePrivate *priv;
 };
 
 struct _BishoPaneClass {
   GtkVBoxClass parent_class;
+  void (*log_in) (BishoPane *pane);
   void (*continue_auth) (BishoPane *pane, GHashTable *params);
+  void (*log_out) (BishoPane *pane);
+  void (*expanded) (BishoPane *pane, gboolean expanded);
+
+  /* Signals */
+  void (*state_changed) (BishoPane *pane, BishoPaneState state);
+  gboolean (*open_url) (BishoPane *pane, const char *url);
+  void (*credentials_updated) (BishoPane *pane);
 };
 
 GType bisho_pane_get_type (void) G_GNUC_CONST;
 
 void bisho_pane_continue_auth (BishoPane *pane, GHashTable *params);
 
+void bisho_pane_set_expanded (BishoPane *pane, gboolean expanded);
+
+void bisho_pane_set_state (BishoPane *pane, BishoPaneState state);
+
+void bisho_pane_validated (BishoPane *pane);
+
+BishoPaneState bisho_pane_get_state (BishoPane *pane);
+
+gboolean bisho_pane_needs_attention (BishoPane *pane);
+
+const char * bisho_pane_state_to_string (BishoPaneState state);
+
+const guint * bisho_pane_get_state_histogram (BishoPane *pane, BishoPaneState state);
+
+void bisho_pane_set_button (BishoPane *pane, GtkWidget *button);
+
+BishoPaneOp * bisho_pane_op_new (BishoPane *pane);
+
+BishoPane * bisho_pane_op_finish (BishoPaneOp *op);
+
+void bisho_pane_credentials_updated (BishoPane *pane);
+
+gboolean bisho_pane_open_url (BishoPane *pane, const char *url);
+
 void bisho_pane_set_banner (BishoPane *pane, const char *message);
 
 void bisho_pane_set_banner_error (BishoPane *pane, const GError *error);
 
 void bisho_pane_set_user (BishoPane *pane, const char *icon, const char *username);
 
+void bisho_pane_set_online (BishoPane *pane, gboolean online);
+
+gboolean bisho_pane_get_online (BishoPane *pane);
+
 void bisho_pane_follow_connected (BishoPane *pane, GtkWidget *widget);
 
 G_END_DECLS
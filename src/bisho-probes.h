@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BISHO_PROBES_H__
+#define __BISHO_PROBES_H__
+
+#include <glib.h>
+
+/*
+ * Static probes for perf, bpftrace and SystemTap, built with
+ * --enable-sdt.  Durations are in microseconds.  See tools/bpftrace for
+ * examples.
+ *
+ *   auth__start (service, step)
+ *   auth__done (service, step, duration, failed)
+ *   keyring__start (operation, service)
+ *   keyring__done (operation, service, duration, result)
+ *   ui__construct (service, duration)
+ *   ui__filter (shown, duration)
+ *   pane__continue__auth (service, state)
+ *   webkit__load__committed (service, uri, since_open)
+ *   callback__dispatch (service, duration, handled)
+ *
+ * Without --enable-sdt the arguments are still evaluated but nothing is
+ * emitted.
+ */
+
+#ifdef ENABLE_SDT
+
+#include <sys/sdt.h>
+
+#define BISHO_PROBE2(name, a, b) DTRACE_PROBE2 (bisho, name, a, b)
+#define BISHO_PROBE3(name, a, b, c) DTRACE_PROBE3 (bisho, name, a, b, c)
+#define BISHO_PROBE4(name, a, b, c, d) DTRACE_PROBE4 (bisho, name, a, b, c, d)
+
+#else
+
+#define BISHO_PROBE2(name, a, b) \
+  G_STMT_START { (void) (a); (void) (b); } G_STMT_END
+#define BISHO_PROBE3(name, a, b, c) \
+  G_STMT_START { (void) (a); (void) (b); (void) (c); } G_STMT_END
+#define BISHO_PROBE4(name, a, b, c, d) \
+  G_STMT_START { (void) (a); (void) (b); (void) (c); (void) (d); } G_STMT_END
+
+#endif
+
+#endif /* __BISHO_PROBES_H__ */
@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A prefix index over the services' names and descriptions, for searching as
+ * the user types.  Every word is folded, so that case and accents don't
+ * matter, and kept in one sorted array, so that the words starting with a
+ * prefix are found with a binary search and are next to each other.
+ */
+
+#include <config.h>
+#include <string.h>
+#include "bisho-service-index.h"
+
+typedef struct {
+  const char *word;
+  guint id;
+} Entry;
+
+struct _BishoServiceIndex {
+  /* Array of Entry, sorted by word if sorted is set */
+  GArray *entries;
+  gboolean sorted;
+  GStringChunk *words;
+  guint size;
+};
+
+/* Case fold @s and strip its accents, for comparing */
+static char *
+fold (const char *s)
+{
+  GString *folded;
+  char *casefolded, *normalized, *p;
+  gunichar c;
+
+  casefolded = g_utf8_casefold (s, -1);
+  normalized = g_utf8_normalize (casefolded, -1, G_NORMALIZE_ALL);
+  g_free (casefolded);
+
+  if (normalized == NULL)
+    return g_strdup ("");
+
+  folded = g_string_sized_new (strlen (normalized));
+  for (p = normalized; *p; p = g_utf8_next_char (p)) {
+    c = g_utf8_get_char (p);
+    if (g_unichar_type (c) != G_UNICODE_NON_SPACING_MARK)
+      g_string_append_unichar (folded, c);
+  }
+  g_free (normalized);
+
+  return g_string_free (folded, FALSE);
+}
+
+/* Split folded text at anything that isn't a letter or digit */
+static char **
+split_words (const char *s)
+{
+  GPtrArray *words;
+  char *folded;
+  const char *p, *start = NULL;
+  gboolean alnum;
+
+  words = g_ptr_array_new ();
+  folded = fold (s);
+
+  for (p = folded; ; p = g_utf8_next_char (p)) {
+    alnum = *p && g_unichar_isalnum (g_utf8_get_char (p));
+    if (alnum && start == NULL) {
+      start = p;
+    } else if (!alnum && start) {
+      g_ptr_array_add (words, g_strndup (start, p - start));
+      start = NULL;
+    }
+    if (*p == '\0')
+      break;
+  }
+
+  g_free (folded);
+  g_ptr_array_add (words, NULL);
+  return (char **) g_ptr_array_free (words, FALSE);
+}
+
+static int
+compare_entries (gconstpointer a, gconstpointer b)
+{
+  const Entry *ea = a, *eb = b;
+  int ret;
+
+  ret = strcmp (ea->word, eb->word);
+  if (ret == 0)
+    ret = ea->id < eb->id ? -1 : ea->id > eb->id;
+
+  return ret;
+}
+
+static void
+add_words (BishoServiceIndex *index, guint id, const char *text)
+{
+  Entry entry;
+  char **words;
+  int i;
+
+  if (text == NULL)
+    return;
+
+  words = split_words (text);
+  for (i = 0; words[i]; i++) {
+    entry.word = g_string_chunk_insert_const (index->words, words[i]);
+    entry.id = id;
+    g_array_append_val (index->entries, entry);
+  }
+  g_strfreev (words);
+
+  index->sorted = FALSE;
+}
+
+/* Sort the entries and drop words seen twice for a service */
+static void
+ensure_sorted (BishoServiceIndex *index)
+{
+  Entry *entries;
+  guint i, n = 0;
+
+  if (index->sorted)
+    return;
+
+  g_array_sort (index->entries, compare_entries);
+
+  entries = (Entry *) index->entries->data;
+  for (i = 0; i < index->entries->len; i++) {
+    if (n > 0 && compare_entries (&entries[n - 1], &entries[i]) == 0)
+      continue;
+    entries[n++] = entries[i];
+  }
+  g_array_set_size (index->entries, n);
+
+  index->sorted = TRUE;
+}
+
+/* The first entry that doesn't sort before @prefix */
+static guint
+lower_bound (BishoServiceIndex *index, const char *prefix)
+{
+  Entry *entries = (Entry *) index->entries->data;
+  guint low = 0, high = index->entries->len, mid;
+
+  while (low < high) {
+    mid = low + (high - low) / 2;
+    if (strcmp (entries[mid].word, prefix) < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  return low;
+}
+
+BishoServiceIndex *
+bisho_service_index_new (void)
+{
+  BishoServiceIndex *index;
+
+  index = g_slice_new0 (BishoServiceIndex);
+  index->entries = g_array_new (FALSE, FALSE, sizeof (Entry));
+  index->words = g_string_chunk_new (1024);
+  index->sorted = TRUE;
+
+  return index;
+}
+
+void
+bisho_service_index_free (BishoServiceIndex *index)
+{
+  if (index == NULL)
+    return;
+
+  g_array_free (index->entries, TRUE);
+  g_string_chunk_free (index->words);
+  g_slice_free (BishoServiceIndex, index);
+}
+
+/* Index @info, returning its ID.  IDs count up from zero. */
+guint
+bisho_service_index_add (BishoServiceIndex *index, ServiceInfo *info)
+{
+  g_return_val_if_fail (index, 0);
+  g_return_val_if_fail (info, 0);
+
+  add_words (index, index->size, info->name);
+  add_words (index, index->size, info->display_name);
+  add_words (index, index->size, info->description);
+
+  return index->size++;
+}
+
+guint
+bisho_service_index_get_size (BishoServiceIndex *index)
+{
+  g_return_val_if_fail (index, 0);
+
+  return index->size;
+}
+
+/*
+ * Find the services with a word starting with each word of @query.  Returns
+ * NULL if @query has no words, so everything matches, or a flag for each ID
+ * which should be freed.
+ */
+guint8 *
+bisho_service_index_search (BishoServiceIndex *index, const char *query)
+{
+  Entry *entries;
+  guint8 *matches, *found;
+  char **words;
+  guint i, j, len;
+
+  g_return_val_if_fail (index, NULL);
+
+  words = split_words (query ?: "");
+  if (words[0] == NULL) {
+    g_strfreev (words);
+    return NULL;
+  }
+
+  ensure_sorted (index);
+  entries = (Entry *) index->entries->data;
+
+  matches = g_malloc (MAX (index->size, 1));
+  memset (matches, 1, index->size);
+  found = g_malloc (MAX (index->size, 1));
+
+  for (i = 0; words[i]; i++) {
+    memset (found, 0, index->size);
+
+    len = strlen (words[i]);
+    for (j = lower_bound (index, words[i]);
+         j < index->entries->len && strncmp (entries[j].word, words[i], len) == 0;
+         j++)
+      found[entries[j].id] = 1;
+
+    for (j = 0; j < index->size; j++)
+      matches[j] &= found[j];
+  }
+
+  g_free (found);
+  g_strfreev (words);
+
+  return matches;
+}
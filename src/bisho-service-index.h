@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BISHO_SERVICE_INDEX_H__
+#define __BISHO_SERVICE_INDEX_H__
+
+#include <glib.h>
+#include "service-info.h"
+
+G_BEGIN_DECLS
+
+typedef struct _BishoServiceIndex BishoServiceIndex;
+
+BishoServiceIndex * bisho_service_index_new (void);
+
+void bisho_service_index_free (BishoServiceIndex *index);
+
+guint bisho_service_index_add (BishoServiceIndex *index, ServiceInfo *info);
+
+guint bisho_service_index_get_size (BishoServiceIndex *index);
+
+guint8 * bisho_service_index_search (BishoServiceIndex *index, const char *query);
+
+G_END_DECLS
+
+#endif /* __BISHO_SERVICE_INDEX_H__ */
@@ -0,0 +1,592 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * A scrolling list of services that only has widgets for the rows in view.
+ * Rows are all as tall as a collapsed header, apart from the expanded one,
+ * so the row at any height is found by arithmetic.  Rows that scroll out of
+ * view are kept and reused for the ones that scroll in, and panes are only
+ * made when a service is first expanded.  A filter picks which services are
+ * shown; rows are found by position among those, but keyed by service.
+ */
+
+#include <config.h>
+#include "bisho-service-list.h"
+#include "bisho-exclusive-group.h"
+#include "bisho-pane.h"
+#include "mux-expanding-item.h"
+
+#define ROW_INDEX "bisho-service-list-index"
+#define ROW_PANE "bisho-service-list-pane"
+
+struct _BishoServiceListPrivate {
+  /* Array of ServiceInfo, in the order added */
+  GPtrArray *services;
+  /* The indexes of the services shown, in order, and the position of each
+     service among them or -1 if it is filtered out */
+  GArray *shown;
+  GArray *positions;
+  BishoServiceListFilterFunc filter_func;
+  gpointer filter_data;
+  GDestroyNotify filter_destroy;
+  BishoServiceListPaneFunc pane_func;
+  gpointer pane_data;
+  /* Hash of service name to its pane */
+  GHashTable *panes;
+  /* Hash of service index to the row showing it */
+  GHashTable *rows;
+  /* Rows that aren't showing anything */
+  GSList *spare;
+  BishoExclusiveGroup *group;
+  /* The expanded service, or -1, and its height */
+  int expanded;
+  int expanded_height;
+  /* The height of a collapsed row, or 0 if not known yet */
+  int row_height;
+  /* Hash of icon file name to GdkPixbuf */
+  GHashTable *icons;
+  GtkAdjustment *vadjustment;
+};
+
+#define GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), BISHO_TYPE_SERVICE_LIST, BishoServiceListPrivate))
+
+G_DEFINE_TYPE (BishoServiceList, bisho_service_list, GTK_TYPE_LAYOUT);
+
+#define SHOWN(priv, position) g_array_index ((priv)->shown, int, (position))
+#define POSITION(priv, index) g_array_index ((priv)->positions, int, (index))
+
+/* The position of the expanded service, which is always shown, or -1 */
+static int
+expanded_position (BishoServiceListPrivate *priv)
+{
+  return priv->expanded >= 0 ? POSITION (priv, priv->expanded) : -1;
+}
+
+static int
+row_y (BishoServiceListPrivate *priv, int position)
+{
+  int y = position * priv->row_height;
+  int expanded = expanded_position (priv);
+
+  if (expanded >= 0 && position > expanded)
+    y += priv->expanded_height - priv->row_height;
+
+  return y;
+}
+
+static int
+row_height (BishoServiceListPrivate *priv, int position)
+{
+  return position == expanded_position (priv) ? priv->expanded_height : priv->row_height;
+}
+
+static int
+total_height (BishoServiceListPrivate *priv)
+{
+  return row_y (priv, priv->shown->len);
+}
+
+/* The position at @y, which may be past the end */
+static int
+position_at (BishoServiceListPrivate *priv, int y)
+{
+  int expanded, top;
+
+  if (priv->row_height <= 0)
+    return 0;
+
+  expanded = expanded_position (priv);
+  if (expanded >= 0) {
+    top = row_y (priv, expanded);
+    if (y >= top + priv->expanded_height)
+      return expanded + 1 + (y - top - priv->expanded_height) / priv->row_height;
+    if (y >= top)
+      return expanded;
+  }
+
+  return MAX (y, 0) / priv->row_height;
+}
+
+static gboolean
+filter (BishoServiceList *list, int index)
+{
+  BishoServiceListPrivate *priv = list->priv;
+  ServiceInfo *info;
+
+  if (priv->filter_func == NULL)
+    return TRUE;
+
+  info = g_ptr_array_index (priv->services, index);
+  return priv->filter_func (info, index,
+                            g_hash_table_lookup (priv->panes, info->name),
+                            priv->filter_data);
+}
+
+static GdkPixbuf *
+get_icon (BishoServiceList *list, const char *filename)
+{
+  GdkPixbuf *pixbuf;
+
+  pixbuf = g_hash_table_lookup (list->priv->icons, filename);
+  if (pixbuf == NULL) {
+    pixbuf = gdk_pixbuf_new_from_file (filename, NULL);
+    if (pixbuf)
+      g_hash_table_insert (list->priv->icons, g_strdup (filename), pixbuf);
+  }
+
+  return pixbuf;
+}
+
+static void
+attach_pane (BishoServiceList *list, MuxExpandingItem *row, ServiceInfo *info)
+{
+  BishoServiceListPrivate *priv = list->priv;
+  GtkWidget *pane;
+
+  pane = g_hash_table_lookup (priv->panes, info->name);
+  if (pane == NULL) {
+    pane = priv->pane_func (info, priv->pane_data);
+    if (pane == NULL)
+      return;
+    g_hash_table_insert (priv->panes, info->name, g_object_ref_sink (pane));
+  }
+
+  gtk_widget_show (pane);
+  gtk_box_pack_start (mux_expanding_item_get_content_box (row), pane, FALSE, FALSE, 0);
+  g_object_set_data (G_OBJECT (row), ROW_PANE, pane);
+
+  bisho_pane_set_expanded (BISHO_PANE (pane), TRUE);
+}
+
+/* The pane is kept, so that it can carry on logging in while collapsed */
+static void
+detach_pane (MuxExpandingItem *row)
+{
+  GtkWidget *pane;
+
+  pane = g_object_get_data (G_OBJECT (row), ROW_PANE);
+  if (pane == NULL)
+    return;
+
+  bisho_pane_set_expanded (BISHO_PANE (pane), FALSE);
+  gtk_container_remove (GTK_CONTAINER (mux_expanding_item_get_content_box (row)), pane);
+  g_object_set_data (G_OBJECT (row), ROW_PANE, NULL);
+}
+
+static void
+row_expanded_cb (GObject *object, GParamSpec *param_spec, gpointer user_data)
+{
+  BishoServiceList *list = BISHO_SERVICE_LIST (user_data);
+  BishoServiceListPrivate *priv = list->priv;
+  MuxExpandingItem *row = MUX_EXPANDING_ITEM (object);
+  int index;
+
+  index = GPOINTER_TO_INT (g_object_get_data (object, ROW_INDEX));
+
+  if (mux_expanding_item_get_active (row)) {
+    priv->expanded = index;
+    priv->expanded_height = priv->row_height;
+    attach_pane (list, row, g_ptr_array_index (priv->services, index));
+  } else {
+    detach_pane (row);
+    if (priv->expanded == index)
+      priv->expanded = -1;
+  }
+
+  gtk_widget_queue_resize (GTK_WIDGET (list));
+}
+
+static GtkWidget *
+new_row (BishoServiceList *list)
+{
+  GtkWidget *row;
+  GtkBox *box;
+
+  row = mux_expanding_item_new ();
+
+  box = mux_expanding_item_get_content_box (MUX_EXPANDING_ITEM (row));
+  gtk_container_set_border_width (GTK_CONTAINER (box), 8);
+  gtk_box_set_spacing (box, 8);
+
+  bisho_exclusive_group_add (list->priv->group, MUX_EXPANDING_ITEM (row));
+  g_signal_connect (row, "notify::expanded", G_CALLBACK (row_expanded_cb), list);
+
+  gtk_widget_show_all (row);
+  gtk_layout_put (GTK_LAYOUT (list), row, 0, 0);
+
+  return row;
+}
+
+/* Show service @index in a spare row, or a new one */
+static GtkWidget *
+bind_row (BishoServiceList *list, int index)
+{
+  BishoServiceListPrivate *priv = list->priv;
+  ServiceInfo *info;
+  MuxExpandingItem *m;
+  GtkWidget *row;
+
+  if (priv->spare) {
+    row = priv->spare->data;
+    priv->spare = g_slist_delete_link (priv->spare, priv->spare);
+    gtk_widget_show (row);
+  } else {
+    row = new_row (list);
+  }
+
+  info = g_ptr_array_index (priv->services, index);
+  m = MUX_EXPANDING_ITEM (row);
+
+  if (info->icon) {
+    mux_expanding_item_set_icon_from_pixbuf (m, get_icon (list, info->icon));
+    mux_expanding_item_set_label (m, NULL);
+  } else {
+    mux_expanding_item_set_icon_from_pixbuf (m, NULL);
+    mux_expanding_item_set_label (m, info->display_name);
+  }
+
+  g_object_set_data (G_OBJECT (row), ROW_INDEX, GINT_TO_POINTER (index));
+  g_hash_table_insert (priv->rows, GINT_TO_POINTER (index), row);
+
+  return row;
+}
+
+/*
+ * Bind rows to the services in view, free the rest apart from the expanded
+ * one, and place them.  Only called once the list has been allocated.
+ */
+static void
+update_rows (BishoServiceList *list)
+{
+  BishoServiceListPrivate *priv = list->priv;
+  GtkAllocation *allocation = &GTK_WIDGET (list)->allocation;
+  GtkAllocation child;
+  GtkRequisition requisition;
+  GHashTableIter iter;
+  gpointer key, value;
+  GtkWidget *row;
+  int top, first, last, i, p;
+
+  /* Measure a header the first time round */
+  if (priv->row_height == 0 && priv->shown->len > 0) {
+    i = SHOWN (priv, 0);
+    row = g_hash_table_lookup (priv->rows, GINT_TO_POINTER (i)) ?: bind_row (list, i);
+    gtk_widget_size_request (row, &requisition);
+    priv->row_height = MAX (requisition.height, 1);
+  }
+
+  top = priv->vadjustment ? (int) gtk_adjustment_get_value (priv->vadjustment) : 0;
+  first = MIN (position_at (priv, top), (int) priv->shown->len - 1);
+  last = MIN (position_at (priv, top + allocation->height), (int) priv->shown->len - 1);
+
+  g_hash_table_iter_init (&iter, priv->rows);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    i = GPOINTER_TO_INT (key);
+    p = POSITION (priv, i);
+    if ((p < 0 || p < first || p > last) && i != priv->expanded) {
+      gtk_widget_hide (value);
+      priv->spare = g_slist_prepend (priv->spare, value);
+      g_hash_table_iter_remove (&iter);
+    }
+  }
+
+  for (p = MAX (first, 0); p <= last; p++) {
+    i = SHOWN (priv, p);
+    if (g_hash_table_lookup (priv->rows, GINT_TO_POINTER (i)) == NULL)
+      bind_row (list, i);
+  }
+
+  gtk_layout_set_size (GTK_LAYOUT (list), allocation->width, total_height (priv));
+
+  g_hash_table_iter_init (&iter, priv->rows);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    p = POSITION (priv, GPOINTER_TO_INT (key));
+    gtk_widget_size_request (value, &requisition);
+    child.x = 0;
+    child.y = row_y (priv, p);
+    child.width = allocation->width;
+    child.height = row_height (priv, p);
+    gtk_widget_size_allocate (value, &child);
+  }
+}
+
+static void
+value_changed_cb (GtkAdjustment *adjustment, gpointer user_data)
+{
+  BishoServiceList *list = BISHO_SERVICE_LIST (user_data);
+
+  if (GTK_WIDGET_REALIZED (list))
+    update_rows (list);
+}
+
+static void
+set_vadjustment (BishoServiceList *list, GtkAdjustment *adjustment)
+{
+  BishoServiceListPrivate *priv = list->priv;
+
+  if (priv->vadjustment == adjustment)
+    return;
+
+  if (priv->vadjustment) {
+    g_signal_handlers_disconnect_by_func (priv->vadjustment, value_changed_cb, list);
+    g_object_unref (priv->vadjustment);
+  }
+
+  priv->vadjustment = adjustment ? g_object_ref (adjustment) : NULL;
+
+  if (priv->vadjustment)
+    g_signal_connect (priv->vadjustment, "value-changed", G_CALLBACK (value_changed_cb), list);
+}
+
+static void
+bisho_service_list_set_scroll_adjustments (GtkLayout *layout,
+                                           GtkAdjustment *hadjustment,
+                                           GtkAdjustment *vadjustment)
+{
+  GTK_LAYOUT_CLASS (bisho_service_list_parent_class)->set_scroll_adjustments (layout, hadjustment, vadjustment);
+
+  set_vadjustment (BISHO_SERVICE_LIST (layout), gtk_layout_get_vadjustment (layout));
+}
+
+static void
+bisho_service_list_size_request (GtkWidget *widget, GtkRequisition *requisition)
+{
+  BishoServiceListPrivate *priv = BISHO_SERVICE_LIST (widget)->priv;
+  GHashTableIter iter;
+  gpointer key, value;
+  GtkRequisition child;
+  int i;
+
+  /* This requests every row */
+  GTK_WIDGET_CLASS (bisho_service_list_parent_class)->size_request (widget, requisition);
+
+  g_hash_table_iter_init (&iter, priv->rows);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    i = GPOINTER_TO_INT (key);
+    gtk_widget_get_child_requisition (value, &child);
+    if (i == priv->expanded)
+      priv->expanded_height = child.height;
+    else
+      priv->row_height = MAX (priv->row_height, child.height);
+  }
+}
+
+static void
+bisho_service_list_size_allocate (GtkWidget *widget, GtkAllocation *allocation)
+{
+  GTK_WIDGET_CLASS (bisho_service_list_parent_class)->size_allocate (widget, allocation);
+
+  update_rows (BISHO_SERVICE_LIST (widget));
+}
+
+static void
+bisho_service_list_dispose (GObject *object)
+{
+  BishoServiceList *list = BISHO_SERVICE_LIST (object);
+  BishoServiceListPrivate *priv = list->priv;
+
+  set_vadjustment (list, NULL);
+
+  if (priv->filter_destroy) {
+    priv->filter_destroy (priv->filter_data);
+    priv->filter_destroy = NULL;
+  }
+  priv->filter_func = NULL;
+
+  if (priv->group) {
+    g_object_unref (priv->group);
+    priv->group = NULL;
+  }
+
+  G_OBJECT_CLASS (bisho_service_list_parent_class)->dispose (object);
+}
+
+static void
+bisho_service_list_finalize (GObject *object)
+{
+  BishoServiceListPrivate *priv = BISHO_SERVICE_LIST (object)->priv;
+
+  g_hash_table_destroy (priv->panes);
+  g_hash_table_destroy (priv->rows);
+  g_hash_table_destroy (priv->icons);
+  g_slist_free (priv->spare);
+  g_ptr_array_free (priv->services, TRUE);
+  g_array_free (priv->shown, TRUE);
+  g_array_free (priv->positions, TRUE);
+
+  G_OBJECT_CLASS (bisho_service_list_parent_class)->finalize (object);
+}
+
+static void
+bisho_service_list_class_init (BishoServiceListClass *klass)
+{
+  GObjectClass *o_class = G_OBJECT_CLASS (klass);
+  GtkWidgetClass *w_class = GTK_WIDGET_CLASS (klass);
+  GtkLayoutClass *l_class = GTK_LAYOUT_CLASS (klass);
+
+  g_type_class_add_private (klass, sizeof (BishoServiceListPrivate));
+
+  o_class->dispose = bisho_service_list_dispose;
+  o_class->finalize = bisho_service_list_finalize;
+
+  w_class->size_request = bisho_service_list_size_request;
+  w_class->size_allocate = bisho_service_list_size_allocate;
+
+  l_class->set_scroll_adjustments = bisho_service_list_set_scroll_adjustments;
+}
+
+static void
+bisho_service_list_init (BishoServiceList *self)
+{
+  BishoServiceListPrivate *priv;
+
+  self->priv = priv = GET_PRIVATE (self);
+
+  priv->services = g_ptr_array_new ();
+  priv->shown = g_array_new (FALSE, FALSE, sizeof (int));
+  priv->positions = g_array_new (FALSE, FALSE, sizeof (int));
+  priv->panes = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_object_unref);
+  priv->rows = g_hash_table_new (NULL, NULL);
+  priv->icons = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+  priv->group = bisho_exclusive_group_new ();
+  priv->expanded = -1;
+
+  set_vadjustment (self, gtk_layout_get_vadjustment (GTK_LAYOUT (self)));
+}
+
+GtkWidget *
+bisho_service_list_new (BishoServiceListPaneFunc pane_func, gpointer user_data)
+{
+  BishoServiceList *list;
+
+  g_return_val_if_fail (pane_func, NULL);
+
+  list = g_object_new (BISHO_TYPE_SERVICE_LIST, NULL);
+  list->priv->pane_func = pane_func;
+  list->priv->pane_data = user_data;
+
+  return GTK_WIDGET (list);
+}
+
+void
+bisho_service_list_append (BishoServiceList *list, ServiceInfo *info)
+{
+  BishoServiceListPrivate *priv;
+  int index, position = -1;
+
+  g_return_if_fail (BISHO_IS_SERVICE_LIST (list));
+  g_return_if_fail (info);
+
+  priv = list->priv;
+
+  index = priv->services->len;
+  g_ptr_array_add (priv->services, info);
+
+  if (filter (list, index)) {
+    position = priv->shown->len;
+    g_array_append_val (priv->shown, index);
+  }
+  g_array_append_val (priv->positions, position);
+
+  gtk_widget_queue_resize (GTK_WIDGET (list));
+}
+
+/*
+ * Only show the services that @func returns TRUE for.  It is called when a
+ * service is added and by bisho_service_list_refilter(), with the service's
+ * pane if one has been made yet.
+ */
+void
+bisho_service_list_set_filter_func (BishoServiceList *list,
+                                    BishoServiceListFilterFunc func,
+                                    gpointer user_data,
+                                    GDestroyNotify destroy)
+{
+  BishoServiceListPrivate *priv;
+
+  g_return_if_fail (BISHO_IS_SERVICE_LIST (list));
+
+  priv = list->priv;
+
+  if (priv->filter_destroy)
+    priv->filter_destroy (priv->filter_data);
+
+  priv->filter_func = func;
+  priv->filter_data = user_data;
+  priv->filter_destroy = destroy;
+
+  bisho_service_list_refilter (list);
+}
+
+/* Run the filter over every service again */
+void
+bisho_service_list_refilter (BishoServiceList *list)
+{
+  BishoServiceListPrivate *priv;
+  GtkWidget *row;
+  int i, position;
+
+  g_return_if_fail (BISHO_IS_SERVICE_LIST (list));
+
+  priv = list->priv;
+
+  /* Collapse the expanded service first if it's going */
+  if (priv->expanded >= 0 && !filter (list, priv->expanded)) {
+    row = g_hash_table_lookup (priv->rows, GINT_TO_POINTER (priv->expanded));
+    mux_expanding_item_set_active (MUX_EXPANDING_ITEM (row), FALSE);
+  }
+
+  g_array_set_size (priv->shown, 0);
+  for (i = 0; i < (int) priv->services->len; i++) {
+    if (filter (list, i)) {
+      position = priv->shown->len;
+      g_array_append_val (priv->shown, i);
+    } else {
+      position = -1;
+    }
+    POSITION (priv, i) = position;
+  }
+
+  if (priv->vadjustment)
+    gtk_adjustment_set_value (priv->vadjustment, 0);
+
+  gtk_widget_queue_resize (GTK_WIDGET (list));
+}
+
+/* Call @func with every pane made so far */
+void
+bisho_service_list_foreach_pane (BishoServiceList *list, GFunc func, gpointer user_data)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  g_return_if_fail (BISHO_IS_SERVICE_LIST (list));
+  g_return_if_fail (func);
+
+  g_hash_table_iter_init (&iter, list->priv->panes);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    func (value, user_data);
+}
+
+guint
+bisho_service_list_get_n_shown (BishoServiceList *list)
+{
+  g_return_val_if_fail (BISHO_IS_SERVICE_LIST (list), 0);
+
+  return list->priv->shown->len;
+}
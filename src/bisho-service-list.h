@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __BISHO_SERVICE_LIST_H__
+#define __BISHO_SERVICE_LIST_H__
+
+#include <gtk/gtk.h>
+#include "service-info.h"
+
+G_BEGIN_DECLS
+
+#define BISHO_TYPE_SERVICE_LIST                                         \
+   (bisho_service_list_get_type())
+#define BISHO_SERVICE_LIST(obj)                                         \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj),                                   \
+                               BISHO_TYPE_SERVICE_LIST,                 \
+                               BishoServiceList))
+#define BISHO_SERVICE_LIST_CLASS(klass)                                 \
+  (G_TYPE_CHECK_CLASS_CAST ((klass),                                    \
+                            BISHO_TYPE_SERVICE_LIST,                    \
+                            BishoServiceListClass))
+#define BISHO_IS_SERVICE_LIST(obj)                                      \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj),                                   \
+                               BISHO_TYPE_SERVICE_LIST))
+#define BISHO_IS_SERVICE_LIST_CLASS(klass)                              \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass),                                    \
+                            BISHO_TYPE_SERVICE_LIST))
+#define BISHO_SERVICE_LIST_GET_CLASS(obj)                               \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj),                                    \
+                              BISHO_TYPE_SERVICE_LIST,                  \
+                              BishoServiceListClass))
+
+typedef struct _BishoServiceListPrivate BishoServiceListPrivate;
+typedef struct _BishoServiceList      BishoServiceList;
+typedef struct _BishoServiceListClass BishoServiceListClass;
+
+struct _BishoServiceList {
+  GtkLayout parent;
+  BishoServiceListPrivate *priv;
+};
+
+struct _BishoServiceListClass {
+  GtkLayoutClass parent_class;
+};
+
+/* Make the pane for @info, the first time it is expanded */
+typedef GtkWidget * (*BishoServiceListPaneFunc) (ServiceInfo *info, gpointer user_data);
+
+/*
+ * Whether to show @info, which is service @index in the order added.  @pane is
+ * the service's pane, or NULL if it hasn't been expanded yet.
+ */
+typedef gboolean (*BishoServiceListFilterFunc) (ServiceInfo *info, guint index,
+                                                GtkWidget *pane, gpointer user_data);
+
+GType bisho_service_list_get_type (void) G_GNUC_CONST;
+
+GtkWidget * bisho_service_list_new (BishoServiceListPaneFunc pane_func, gpointer user_data);
+
+void bisho_service_list_append (BishoServiceList *list, ServiceInfo *info);
+
+void bisho_service_list_set_filter_func (BishoServiceList *list,
+                                         BishoServiceListFilterFunc func,
+                                         gpointer user_data,
+                                         GDestroyNotify destroy);
+
+void bisho_service_list_refilter (BishoServiceList *list);
+
+guint bisho_service_list_get_n_shown (BishoServiceList *list);
+
+void bisho_service_list_foreach_pane (BishoServiceList *list, GFunc func, gpointer user_data);
+
+G_END_DECLS
+
+#endif /* __BISHO_SERVICE_LIST_H__ */
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * bisho --list and --status.  These answer from the service descriptions, the
+ * keyring, GConf and the account cache, without GTK or any web service.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <gconf/gconf-client.h>
+#include "service-info.h"
+#include "bisho-keyring.h"
+#include "bisho-accounts.h"
+#include "bisho-metrics.h"
+#include "bisho-status.h"
+
+typedef struct {
+  ServiceInfo *info;
+  gboolean logged_in;
+  char *user_name;
+  glong validated;
+} Status;
+
+static const char *
+auth_name (ServiceAuthType auth)
+{
+  switch (auth) {
+  case AUTH_USERNAME:
+    return "username";
+  case AUTH_USERNAME_PASSWORD:
+    return "password";
+  case AUTH_OAUTH:
+    return "oauth";
+  case AUTH_FLICKR:
+    return "flickr";
+  case AUTH_FACEBOOK:
+    return "facebook";
+  case AUTH_INVALID:
+  default:
+    return "invalid";
+  }
+}
+
+static char *
+get_gconf_string (GConfClient *gconf, ServiceInfo *info, const char *key)
+{
+  char *path, *value;
+  gint64 start;
+
+  path = g_strdup_printf (SERVICE_INFO_GCONF_DIR "/%s/%s", info->name, key);
+  start = g_get_monotonic_time ();
+  value = gconf_client_get_string (gconf, path, NULL);
+  bisho_metrics_observe_since ("gconf.read", start);
+  g_free (path);
+
+  if (value && value[0] == '\0') {
+    g_free (value);
+    value = NULL;
+  }
+
+  return value;
+}
+
+static void
+get_status (GConfClient *gconf, Status *status)
+{
+  ServiceInfo *info = status->info;
+  char *password;
+
+  switch (info->auth) {
+  case AUTH_USERNAME:
+    status->user_name = get_gconf_string (gconf, info, "user");
+    status->logged_in = status->user_name != NULL;
+    break;
+  case AUTH_USERNAME_PASSWORD:
+    status->user_name = get_gconf_string (gconf, info, "user");
+    password = get_gconf_string (gconf, info, "password");
+    status->logged_in = status->user_name && password;
+    g_free (password);
+    break;
+  default:
+    status->logged_in = bisho_keyring_find_sync (info, NULL) == GNOME_KEYRING_RESULT_OK;
+    break;
+  }
+
+  if (status->user_name == NULL)
+    bisho_accounts_lookup (info->name, &status->user_name, &status->validated);
+  else
+    bisho_accounts_lookup (info->name, NULL, &status->validated);
+}
+
+static char *
+format_time (glong seconds)
+{
+  GTimeVal tv = { seconds, 0 };
+
+  return seconds ? g_time_val_to_iso8601 (&tv) : NULL;
+}
+
+static void
+append_json_string (GString *s, const char *value)
+{
+  const char *p;
+
+  if (value == NULL) {
+    g_string_append (s, "null");
+    return;
+  }
+
+  g_string_append_c (s, '"');
+  for (p = value; *p; p++) {
+    switch (*p) {
+    case '"':
+      g_string_append (s, "\\\"");
+      break;
+    case '\\':
+      g_string_append (s, "\\\\");
+      break;
+    case '\n':
+      g_string_append (s, "\\n");
+      break;
+    default:
+      if ((guchar) *p < 0x20)
+        g_string_append_printf (s, "\\u%04x", (guchar) *p);
+      else
+        g_string_append_c (s, *p);
+    }
+  }
+  g_string_append_c (s, '"');
+}
+
+static void
+print_json (GList *statuses, gboolean with_status)
+{
+  GString *s;
+  GList *l;
+  Status *status;
+  char *validated;
+
+  s = g_string_new ("[");
+
+  for (l = statuses; l; l = l->next) {
+    status = l->data;
+
+    g_string_append (s, "\n  { \"name\": ");
+    append_json_string (s, status->info->name);
+    g_string_append (s, ", \"display_name\": ");
+    append_json_string (s, status->info->display_name);
+    g_string_append (s, ", \"auth\": ");
+    append_json_string (s, auth_name (status->info->auth));
+
+    if (with_status) {
+      g_string_append_printf (s, ", \"logged_in\": %s, \"user_name\": ",
+                              status->logged_in ? "true" : "false");
+      append_json_string (s, status->user_name);
+      g_string_append (s, ", \"last_validated\": ");
+      validated = format_time (status->validated);
+      append_json_string (s, validated);
+      g_free (validated);
+    }
+
+    g_string_append_printf (s, " }%s", l->next ? "," : "\n");
+  }
+
+  g_string_append (s, "]\n");
+  g_print ("%s", s->str);
+  g_string_free (s, TRUE);
+}
+
+static void
+print_text (GList *statuses, gboolean with_status)
+{
+  GList *l;
+  Status *status;
+  char *validated;
+
+  for (l = statuses; l; l = l->next) {
+    status = l->data;
+
+    if (!with_status) {
+      g_print ("%-16s %s\n", status->info->name, status->info->display_name);
+      continue;
+    }
+
+    validated = format_time (status->validated);
+    g_print ("%-16s %-10s %s%s%s%s\n",
+             status->info->name,
+             status->logged_in ? "logged-in" : "logged-out",
+             status->user_name ?: "",
+             validated ? " (validated " : "",
+             validated ?: "",
+             validated ? ")" : "");
+    g_free (validated);
+  }
+}
+
+int
+bisho_status_run (gboolean with_status, gboolean json)
+{
+  GConfClient *gconf = NULL;
+  GList *services, *statuses = NULL, *l;
+  Status *status;
+
+  if (with_status) {
+    gconf = gconf_client_get_default ();
+    /* Fetch every service's settings in one go */
+    gconf_client_add_dir (gconf, SERVICE_INFO_GCONF_DIR,
+                          GCONF_CLIENT_PRELOAD_RECURSIVE, NULL);
+  }
+
+  services = service_info_list_all ();
+  for (l = services; l; l = l->next) {
+    status = g_slice_new0 (Status);
+    status->info = l->data;
+    if (with_status)
+      get_status (gconf, status);
+    statuses = g_list_prepend (statuses, status);
+  }
+  statuses = g_list_reverse (statuses);
+
+  if (json)
+    print_json (statuses, with_status);
+  else
+    print_text (statuses, with_status);
+
+  for (l = statuses; l; l = l->next) {
+    status = l->data;
+    g_free (status->user_name);
+    g_slice_free (Status, status);
+  }
+  g_list_free (statuses);
+  g_list_free (services);
+
+  if (gconf) {
+    gconf_client_remove_dir (gconf, SERVICE_INFO_GCONF_DIR, NULL);
+    g_object_unref (gconf);
+  }
+
+  return 0;
+}
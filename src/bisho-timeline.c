@@ -0,0 +1,391 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * A per-service record of the last login flow: every REST call, browser page
+ * load and keyring operation, with when it started and how long it took, so
+ * that a slow login can be explained from within bisho.  Recording is cheap
+ * and always on; the debug window shows it.
+ */
+
+#include <config.h>
+#include <string.h>
+#include "bisho-network.h"
+#include "bisho-timeline.h"
+
+/* Older events are dropped once a flow has this many */
+#define MAX_EVENTS 64
+/* The width of the bars in the text waterfall */
+#define BAR_WIDTH 40
+
+typedef struct {
+  guint id;
+  const char *kind;
+  char *name;
+  gint64 start;
+  /* 0 while the event is still running */
+  gint64 end;
+  gboolean failed;
+} Event;
+
+typedef struct {
+  char *service;
+  /* Queue of Event, oldest first */
+  GQueue events;
+  /* Array of URLs whose warm-up timings belong to the flow */
+  GPtrArray *hosts;
+} Flow;
+
+/* Keyring calls can finish on other threads, so the timelines are locked */
+G_LOCK_DEFINE_STATIC (timeline);
+/* Hash of service name to Flow */
+static GHashTable *flows = NULL;
+/* Hash of ID to the running Event */
+static GHashTable *running = NULL;
+static guint next_id = 1;
+/* Services changed since the last notification */
+static GHashTable *changed = NULL;
+static guint notify_id = 0;
+static BishoTimelineNotify notify_func = NULL;
+static gpointer notify_data = NULL;
+
+static void
+event_free (Event *event)
+{
+  g_free (event->name);
+  g_slice_free (Event, event);
+}
+
+static void
+flow_free (gpointer data)
+{
+  Flow *flow = data;
+
+  g_queue_foreach (&flow->events, (GFunc) event_free, NULL);
+  g_queue_clear (&flow->events);
+  g_ptr_array_free (flow->hosts, TRUE);
+  g_free (flow->service);
+  g_slice_free (Flow, flow);
+}
+
+/* Called with the lock held */
+static Flow *
+get_flow (const char *service)
+{
+  Flow *flow;
+
+  if (flows == NULL) {
+    flows = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, flow_free);
+    running = g_hash_table_new (NULL, NULL);
+    changed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  }
+
+  flow = g_hash_table_lookup (flows, service);
+  if (flow == NULL) {
+    flow = g_slice_new0 (Flow);
+    flow->service = g_strdup (service);
+    g_queue_init (&flow->events);
+    flow->hosts = g_ptr_array_new_with_free_func (g_free);
+    g_hash_table_insert (flows, flow->service, flow);
+  }
+
+  return flow;
+}
+
+static gboolean
+notify_cb (gpointer user_data)
+{
+  GHashTable *services;
+  GHashTableIter iter;
+  gpointer key;
+
+  G_LOCK (timeline);
+  services = changed;
+  changed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  notify_id = 0;
+  G_UNLOCK (timeline);
+
+  if (notify_func) {
+    g_hash_table_iter_init (&iter, services);
+    while (g_hash_table_iter_next (&iter, &key, NULL))
+      notify_func (key, notify_data);
+  }
+
+  g_hash_table_destroy (services);
+
+  return FALSE;
+}
+
+/* Called with the lock held.  Changes are batched into one idle per loop. */
+static void
+queue_notify (const char *service)
+{
+  if (notify_func == NULL)
+    return;
+
+  g_hash_table_replace (changed, g_strdup (service), NULL);
+  if (notify_id == 0)
+    notify_id = g_idle_add (notify_cb, NULL);
+}
+
+/*
+ * Start a new flow for @service, such as when the user presses Log In.  Events
+ * still running carry over, as they are part of the wait that follows.
+ */
+void
+bisho_timeline_reset (const char *service)
+{
+  Flow *flow;
+  GList *l, *next;
+  Event *event;
+
+  g_return_if_fail (service);
+
+  G_LOCK (timeline);
+
+  flow = get_flow (service);
+  for (l = flow->events.head; l; l = next) {
+    next = l->next;
+    event = l->data;
+    if (event->end) {
+      event_free (event);
+      g_queue_delete_link (&flow->events, l);
+    }
+  }
+
+  queue_notify (service);
+
+  G_UNLOCK (timeline);
+}
+
+/*
+ * Note that @service has started doing something.  @kind is a static string
+ * such as "rest" or "keyring", and @name says what, such as the REST function
+ * or the URL loaded.  Returns an ID to pass to bisho_timeline_end().
+ */
+guint
+bisho_timeline_begin (const char *service, const char *kind, const char *name)
+{
+  Flow *flow;
+  Event *event;
+
+  g_return_val_if_fail (service, 0);
+  g_return_val_if_fail (kind, 0);
+
+  event = g_slice_new0 (Event);
+  event->kind = kind;
+  event->name = g_strdup (name ?: "");
+  event->start = g_get_monotonic_time ();
+
+  G_LOCK (timeline);
+
+  flow = get_flow (service);
+
+  if (g_queue_get_length (&flow->events) == MAX_EVENTS) {
+    Event *oldest = g_queue_pop_head (&flow->events);
+    g_hash_table_remove (running, GUINT_TO_POINTER (oldest->id));
+    event_free (oldest);
+  }
+
+  event->id = next_id++;
+  g_queue_push_tail (&flow->events, event);
+  g_hash_table_insert (running, GUINT_TO_POINTER (event->id), event);
+
+  queue_notify (service);
+
+  G_UNLOCK (timeline);
+
+  return event->id;
+}
+
+/* Note that the event @id has finished.  Unknown IDs are ignored. */
+void
+bisho_timeline_end (guint id, gboolean failed)
+{
+  GHashTableIter iter;
+  gpointer value;
+  Event *event;
+  Flow *flow;
+
+  G_LOCK (timeline);
+
+  event = running ? g_hash_table_lookup (running, GUINT_TO_POINTER (id)) : NULL;
+  if (event) {
+    g_hash_table_remove (running, GUINT_TO_POINTER (id));
+    event->end = g_get_monotonic_time ();
+    event->failed = failed;
+
+    g_hash_table_iter_init (&iter, flows);
+    while (g_hash_table_iter_next (&iter, NULL, &value)) {
+      flow = value;
+      if (g_queue_find (&flow->events, event)) {
+        queue_notify (flow->service);
+        break;
+      }
+    }
+  }
+
+  G_UNLOCK (timeline);
+}
+
+/* Show the connection warm-up for @url, see bisho-network.c, with @service */
+void
+bisho_timeline_add_host (const char *service, const char *url)
+{
+  Flow *flow;
+  guint i;
+
+  g_return_if_fail (service);
+
+  /* Panes may not know their host, as with an OAuth service without BaseURL */
+  if (url == NULL)
+    return;
+
+  G_LOCK (timeline);
+
+  flow = get_flow (service);
+  for (i = 0; i < flow->hosts->len; i++) {
+    if (strcmp (g_ptr_array_index (flow->hosts, i), url) == 0)
+      break;
+  }
+  if (i == flow->hosts->len)
+    g_ptr_array_add (flow->hosts, g_strdup (url));
+
+  G_UNLOCK (timeline);
+}
+
+static void
+append_phase (GString *s, const char *name, gint64 usec)
+{
+  if (usec < 0)
+    g_string_append_printf (s, "  %s -", name);
+  else
+    g_string_append_printf (s, "  %s %.1fms", name, usec / 1000.0);
+}
+
+static void
+append_flow (GString *s, Flow *flow, gint64 now)
+{
+  const BishoNetworkTiming *timing;
+  GList *l;
+  Event *event;
+  gint64 first = 0, last = 0, end, span;
+  guint i, from, to;
+
+  for (l = flow->events.head; l; l = l->next) {
+    event = l->data;
+    end = event->end ?: now;
+    if (first == 0 || event->start < first)
+      first = event->start;
+    if (end > last)
+      last = end;
+  }
+  span = MAX (last - first, 1);
+
+  g_string_append_printf (s, "%s: %u events, %.1fms\n", flow->service,
+                          g_queue_get_length (&flow->events),
+                          first ? span / 1000.0 : 0.0);
+
+  for (i = 0; i < flow->hosts->len; i++) {
+    timing = bisho_network_get_timing (g_ptr_array_index (flow->hosts, i));
+    if (timing == NULL)
+      continue;
+
+    g_string_append_printf (s, "  network  %s:%u", timing->host, timing->port);
+    append_phase (s, "dns", timing->dns);
+    g_string_append (s, " (warm-up)\n");
+  }
+
+  for (l = flow->events.head; l; l = l->next) {
+    event = l->data;
+    end = event->end ?: now;
+
+    from = (event->start - first) * BAR_WIDTH / span;
+    to = MAX ((end - first) * BAR_WIDTH / span, from + 1);
+    to = MIN (to, BAR_WIDTH);
+
+    g_string_append_printf (s, "  %-8s +%9.1fms ", event->kind,
+                            (event->start - first) / 1000.0);
+    if (event->end)
+      g_string_append_printf (s, "%9.1fms%s ", (end - event->start) / 1000.0,
+                              event->failed ? "!" : " ");
+    else
+      g_string_append (s, "  running  ");
+
+    g_string_append_c (s, '|');
+    for (i = 0; i < BAR_WIDTH; i++)
+      g_string_append_c (s, i >= from && i < to ? (event->end ? '#' : '.') : ' ');
+    g_string_append_printf (s, "| %s\n", event->name);
+  }
+}
+
+static gint
+compare_flows (gconstpointer a, gconstpointer b)
+{
+  return strcmp (((const Flow *) a)->service, ((const Flow *) b)->service);
+}
+
+/*
+ * Render the last flow of @service, or of every service if @service is NULL,
+ * as a text waterfall.  Failed events are marked with "!".
+ */
+char *
+bisho_timeline_to_text (const char *service)
+{
+  GString *s;
+  GList *list = NULL, *l;
+  Flow *flow;
+  gint64 now;
+
+  s = g_string_new (NULL);
+  now = g_get_monotonic_time ();
+
+  G_LOCK (timeline);
+
+  if (flows) {
+    if (service) {
+      flow = g_hash_table_lookup (flows, service);
+      if (flow)
+        list = g_list_prepend (list, flow);
+    } else {
+      list = g_list_sort (g_hash_table_get_values (flows), compare_flows);
+    }
+  }
+
+  for (l = list; l; l = l->next) {
+    append_flow (s, l->data, now);
+    if (l->next)
+      g_string_append_c (s, '\n');
+  }
+
+  G_UNLOCK (timeline);
+
+  g_list_free (list);
+
+  return g_string_free (s, FALSE);
+}
+
+/* Call @notify whenever a timeline changes.  Only one function is kept. */
+void
+bisho_timeline_set_notify (BishoTimelineNotify notify, gpointer user_data)
+{
+  G_LOCK (timeline);
+  notify_func = notify;
+  notify_data = user_data;
+  G_UNLOCK (timeline);
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __BISHO_TIMELINE_H__
+#define __BISHO_TIMELINE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Called from the main loop after a service's timeline has changed */
+typedef void (*BishoTimelineNotify) (const char *service, gpointer user_data);
+
+void bisho_timeline_reset (const char *service);
+
+guint bisho_timeline_begin (const char *service, const char *kind, const char *name);
+
+void bisho_timeline_end (guint id, gboolean failed);
+
+void bisho_timeline_add_host (const char *service, const char *url);
+
+char * bisho_timeline_to_text (const char *service);
+
+void bisho_timeline_set_notify (BishoTimelineNotify notify, gpointer user_data);
+
+G_END_DECLS
+
+#endif /* __BISHO_TIMELINE_H__ */
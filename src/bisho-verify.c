@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks a user name, and password if the service has one, against the
+ * endpoint named by the URL key in the [Verify] group of the service's
+ * description.  {user} in the URL is replaced by the user name, and the
+ * password is sent with basic authentication.  A 2xx response means the
+ * details work, 401, 403 and 404 that they don't.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <libsoup/soup.h>
+#include "bisho-verify.h"
+#include "bisho-metrics.h"
+
+/* Seconds to wait for an answer */
+#define TIMEOUT 15
+
+typedef struct {
+  BishoVerifyCallback callback;
+  gpointer user_data;
+  GCancellable *cancellable;
+  gulong cancelled_id;
+  SoupMessage *msg;
+  gint64 start;
+} VerifyData;
+
+static SoupSession *session = NULL;
+
+static SoupSession *
+get_session (void)
+{
+  if (session == NULL)
+    session = soup_session_async_new_with_options (SOUP_SESSION_TIMEOUT, TIMEOUT,
+                                                   SOUP_SESSION_USER_AGENT, "Bisho/" VERSION,
+                                                   NULL);
+
+  return session;
+}
+
+static char *
+build_url (ServiceInfo *info, const char *user_name)
+{
+  char **split, *escaped, *url;
+
+  escaped = soup_uri_encode (user_name ?: "", "/?#&=+@:;");
+  split = g_strsplit (info->verify_url, "{user}", -1);
+  url = g_strjoinv (escaped, split);
+  g_strfreev (split);
+  g_free (escaped);
+
+  return url;
+}
+
+static void
+cancelled_cb (GCancellable *cancellable, gpointer user_data)
+{
+  VerifyData *data = user_data;
+
+  soup_session_cancel_message (get_session (), data->msg, SOUP_STATUS_CANCELLED);
+}
+
+static void
+message_cb (SoupSession *session, SoupMessage *msg, gpointer user_data)
+{
+  VerifyData *data = user_data;
+  BishoVerifyResult result;
+
+  if (data->cancellable) {
+    g_signal_handler_disconnect (data->cancellable, data->cancelled_id);
+    if (g_cancellable_is_cancelled (data->cancellable))
+      goto done;
+  }
+
+  bisho_metrics_observe_since ("verify", data->start);
+
+  switch (msg->status_code) {
+  case SOUP_STATUS_UNAUTHORIZED:
+  case SOUP_STATUS_FORBIDDEN:
+  case SOUP_STATUS_NOT_FOUND:
+    result = BISHO_VERIFY_REJECTED;
+    break;
+  default:
+    result = SOUP_STATUS_IS_SUCCESSFUL (msg->status_code) ?
+      BISHO_VERIFY_OK : BISHO_VERIFY_UNKNOWN;
+    break;
+  }
+
+  if (result == BISHO_VERIFY_UNKNOWN)
+    g_message ("Cannot verify login: %d %s", msg->status_code, msg->reason_phrase);
+
+  data->callback (result, data->user_data);
+
+ done:
+  if (data->cancellable)
+    g_object_unref (data->cancellable);
+  g_slice_free (VerifyData, data);
+}
+
+gboolean
+bisho_verify_is_supported (ServiceInfo *info)
+{
+  g_return_val_if_fail (info, FALSE);
+
+  return info->verify_url != NULL;
+}
+
+/*
+ * Check the details in the background.  Cancelling @cancellable abandons the
+ * request, and @callback is then not called.
+ */
+void
+bisho_verify (ServiceInfo *info,
+              const char *user_name, const char *password,
+              GCancellable *cancellable,
+              BishoVerifyCallback callback, gpointer user_data)
+{
+  VerifyData *data;
+  SoupMessage *msg;
+  char *url, *credentials, *encoded, *header;
+
+  g_return_if_fail (bisho_verify_is_supported (info));
+  g_return_if_fail (callback);
+
+  if (cancellable && g_cancellable_is_cancelled (cancellable))
+    return;
+
+  url = build_url (info, user_name);
+  msg = soup_message_new (SOUP_METHOD_GET, url);
+  g_free (url);
+
+  if (msg == NULL) {
+    g_message ("Invalid verification URL for %s", info->name);
+    callback (BISHO_VERIFY_UNKNOWN, user_data);
+    return;
+  }
+
+  if (password) {
+    credentials = g_strdup_printf ("%s:%s", user_name ?: "", password);
+    encoded = g_base64_encode ((guchar *) credentials, strlen (credentials));
+    header = g_strconcat ("Basic ", encoded, NULL);
+    soup_message_headers_replace (msg->request_headers, "Authorization", header);
+    g_free (header);
+    g_free (encoded);
+    g_free (credentials);
+  }
+
+  data = g_slice_new0 (VerifyData);
+  data->callback = callback;
+  data->user_data = user_data;
+  data->msg = msg;
+  data->start = g_get_monotonic_time ();
+
+  if (cancellable) {
+    data->cancellable = g_object_ref (cancellable);
+    data->cancelled_id = g_signal_connect (cancellable, "cancelled",
+                                           G_CALLBACK (cancelled_cb), data);
+  }
+
+  soup_session_queue_message (get_session (), msg, message_cb, data);
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BISHO_VERIFY_H__
+#define __BISHO_VERIFY_H__
+
+#include <gio/gio.h>
+#include "service-info.h"
+
+G_BEGIN_DECLS
+
+typedef enum {
+  /* The service accepted the details */
+  BISHO_VERIFY_OK,
+  /* The service doesn't know the user, or refused the password */
+  BISHO_VERIFY_REJECTED,
+  /* The service couldn't be asked, or gave an answer we don't understand */
+  BISHO_VERIFY_UNKNOWN,
+} BishoVerifyResult;
+
+/* Not called if the check was cancelled */
+typedef void (*BishoVerifyCallback) (BishoVerifyResult result, gpointer user_data);
+
+gboolean bisho_verify_is_supported (ServiceInfo *info);
+
+void bisho_verify (ServiceInfo *info,
+                   const char *user_name, const char *password,
+                   GCancellable *cancellable,
+                   BishoVerifyCallback callback, gpointer user_data);
+
+G_END_DECLS
+
+#endif /* __BISHO_VERIFY_H__ */
@@ -0,0 +1,327 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A debugging watchdog for main loop stalls, enabled by setting
+ * BISHO_WATCHDOG to a threshold in milliseconds.  The main loop ticks a
+ * heartbeat, and a thread watches for the heartbeat stopping for longer than
+ * the threshold.  Each stall is blamed on the innermost span the main thread
+ * had open, as marked by bisho_watchdog_span_begin() around calls that may
+ * block, or failing that on a backtrace of the main thread.  A report of the
+ * sites ranked by total stall time is logged on exit.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#ifdef HAVE_EXECINFO_H
+#include <execinfo.h>
+#endif
+#include "bisho-watchdog.h"
+#include "bisho-metrics.h"
+
+#define DEFAULT_THRESHOLD 100
+#define MAX_SPANS 16
+#define MAX_FRAMES 32
+/* Frames of the backtrace used to name a site */
+#define SITE_FRAMES 4
+
+typedef struct {
+  char *site;
+  guint count;
+  gint64 total;
+  gint64 max;
+} Site;
+
+static gboolean enabled = FALSE;
+static gint64 threshold = 0;
+static GThread *thread = NULL;
+static gboolean stopping = FALSE;
+static guint tick_id = 0;
+
+/* Written by the main loop, read by the watchdog */
+G_LOCK_DEFINE_STATIC (beat);
+static gint64 last_beat = 0;
+
+/* The main thread's open spans; only the innermost is read by the watchdog */
+static const char *spans[MAX_SPANS];
+static int n_spans = 0;
+static gpointer current_span = NULL;
+
+/* Hash of site name to Site, only touched by the watchdog */
+static GHashTable *sites = NULL;
+
+#ifdef HAVE_EXECINFO_H
+static pthread_t main_thread;
+static void *frames[MAX_FRAMES];
+static volatile int n_frames = 0;
+static volatile gint captured = 0;
+
+/* SIGUSR2, delivered to the main thread by the watchdog */
+static void
+capture_backtrace (int signum)
+{
+  n_frames = backtrace (frames, MAX_FRAMES);
+  g_atomic_int_set (&captured, 1);
+}
+
+static char *
+get_backtrace_site (void)
+{
+  GString *s;
+  char **symbols;
+  int i, waited;
+
+  g_atomic_int_set (&captured, 0);
+  if (pthread_kill (main_thread, SIGUSR2) != 0)
+    return NULL;
+
+  for (waited = 0; !g_atomic_int_get (&captured); waited++) {
+    if (waited == 20)
+      return NULL;
+    g_usleep (500);
+  }
+
+  /* Skip the signal handler and the trampoline */
+  symbols = backtrace_symbols (frames, n_frames);
+  if (symbols == NULL)
+    return NULL;
+
+  s = g_string_new (NULL);
+  for (i = 2; i < n_frames && i < 2 + SITE_FRAMES; i++) {
+    if (s->len)
+      g_string_append (s, " < ");
+    g_string_append (s, symbols[i]);
+  }
+  free (symbols);
+
+  return g_string_free (s, FALSE);
+}
+#endif
+
+static char *
+get_site (void)
+{
+  const char *span;
+  char *site = NULL;
+
+  span = g_atomic_pointer_get (&current_span);
+  if (span)
+    return g_strdup (span);
+
+#ifdef HAVE_EXECINFO_H
+  site = get_backtrace_site ();
+#endif
+
+  return site ? site : g_strdup ("unknown");
+}
+
+static void
+record_stall (const char *site_name, gint64 duration)
+{
+  Site *site;
+
+  site = g_hash_table_lookup (sites, site_name);
+  if (site == NULL) {
+    site = g_slice_new0 (Site);
+    site->site = g_strdup (site_name);
+    g_hash_table_insert (sites, site->site, site);
+  }
+
+  site->count++;
+  site->total += duration;
+  site->max = MAX (site->max, duration);
+
+  bisho_metrics_count ("mainloop.stalls");
+  bisho_metrics_observe ("mainloop.stall", duration);
+  g_message ("Main loop stalled for %" G_GINT64_FORMAT "ms in %s", duration, site_name);
+}
+
+static gpointer
+watchdog_thread (gpointer user_data)
+{
+  gint64 beat, now;
+  char *site = NULL;
+  gint64 stall_start = 0;
+
+  while (!g_atomic_int_get (&stopping)) {
+    g_usleep (threshold * 1000 / 4);
+
+    G_LOCK (beat);
+    beat = last_beat;
+    G_UNLOCK (beat);
+    now = g_get_monotonic_time () / 1000;
+
+    if (site && beat != stall_start) {
+      /* The main loop came back */
+      record_stall (site, beat - stall_start);
+      g_free (site);
+      site = NULL;
+    } else if (site == NULL && now - beat > threshold) {
+      /* Caught in the act, so see where it is stuck */
+      stall_start = beat;
+      site = get_site ();
+    }
+  }
+
+  g_free (site);
+  return NULL;
+}
+
+static gboolean
+tick_cb (gpointer user_data)
+{
+  G_LOCK (beat);
+  last_beat = g_get_monotonic_time () / 1000;
+  G_UNLOCK (beat);
+
+  return TRUE;
+}
+
+static void
+site_free (gpointer data)
+{
+  Site *site = data;
+
+  g_free (site->site);
+  g_slice_free (Site, site);
+}
+
+void
+bisho_watchdog_start (void)
+{
+  const char *env;
+  GError *error = NULL;
+
+  env = g_getenv ("BISHO_WATCHDOG");
+  if (env == NULL || enabled)
+    return;
+
+  threshold = g_ascii_strtoll (env, NULL, 10);
+  if (threshold <= 0)
+    threshold = DEFAULT_THRESHOLD;
+
+  sites = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, site_free);
+
+#ifdef HAVE_EXECINFO_H
+  {
+    struct sigaction action;
+
+    /*
+     * The first call to backtrace() loads libgcc and may allocate, neither of
+     * which is safe in a signal handler, so get it over with now.
+     */
+    n_frames = backtrace (frames, MAX_FRAMES);
+
+    /* Restart whatever the main thread was blocked in */
+    memset (&action, 0, sizeof (action));
+    action.sa_handler = capture_backtrace;
+    action.sa_flags = SA_RESTART;
+    sigemptyset (&action.sa_mask);
+    sigaction (SIGUSR2, &action, NULL);
+
+    main_thread = pthread_self ();
+  }
+#endif
+
+  tick_cb (NULL);
+  tick_id = g_timeout_add_full (G_PRIORITY_HIGH, threshold / 4, tick_cb, NULL, NULL);
+
+  thread = g_thread_try_new ("bisho-watchdog", watchdog_thread, NULL, &error);
+  if (thread == NULL) {
+    g_message ("Cannot start the watchdog: %s", error->message);
+    g_error_free (error);
+    g_source_remove (tick_id);
+    return;
+  }
+
+  enabled = TRUE;
+  g_message ("Watching for main loop stalls over %" G_GINT64_FORMAT "ms", threshold);
+}
+
+static int
+compare_sites (gconstpointer a, gconstpointer b)
+{
+  const Site *x = a, *y = b;
+
+  return x->total < y->total ? 1 : x->total > y->total ? -1 : 0;
+}
+
+/* Stop the watchdog and log the stall sites, worst first */
+void
+bisho_watchdog_stop (void)
+{
+  GList *list, *l;
+  Site *site;
+  int rank = 1;
+
+  if (!enabled)
+    return;
+
+  g_atomic_int_set (&stopping, TRUE);
+  g_thread_join (thread);
+  g_source_remove (tick_id);
+  enabled = FALSE;
+
+  list = g_list_sort (g_hash_table_get_values (sites), compare_sites);
+
+  if (list == NULL)
+    g_message ("No main loop stalls over %" G_GINT64_FORMAT "ms", threshold);
+
+  for (l = list; l; l = l->next) {
+    site = l->data;
+    g_message ("Stall #%d: %" G_GINT64_FORMAT "ms total, %u times, worst %"
+               G_GINT64_FORMAT "ms: %s",
+               rank++, site->total, site->count, site->max, site->site);
+  }
+
+  g_list_free (list);
+  g_hash_table_destroy (sites);
+  sites = NULL;
+}
+
+/*
+ * Mark the main thread as entering a call that may block, so that a stall is
+ * blamed on @name.  @name must stay valid, so use a literal or an interned
+ * string.  Spans nest, and each must be closed with bisho_watchdog_span_end().
+ */
+void
+bisho_watchdog_span_begin (const char *name)
+{
+  if (!enabled)
+    return;
+
+  if (n_spans < MAX_SPANS)
+    spans[n_spans] = name;
+  n_spans++;
+
+  g_atomic_pointer_set (&current_span, (gpointer) spans[MIN (n_spans, MAX_SPANS) - 1]);
+}
+
+void
+bisho_watchdog_span_end (void)
+{
+  if (!enabled || n_spans == 0)
+    return;
+
+  n_spans--;
+
+  g_atomic_pointer_set (&current_span,
+                        n_spans ? (gpointer) spans[MIN (n_spans, MAX_SPANS) - 1] : NULL);
+}
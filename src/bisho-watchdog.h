@@ -1,8 +1,6 @@
 /*
  * Copyright (C) 2009 Intel Corporation.
  *
- * Author: Ross Burton <ross@linux.intel.com>
- *
  * This program is free software; you can redistribute it and/or modify it under
  * the terms of the GNU General Public License as published by the Free Software
  * Foundation; either version 2 of the License, or (at your option) any later
@@ -17,18 +15,21 @@
  * this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
-#ifndef __BISHO_UTILS_H__
-#define __BISHO_UTILS_H__
+#ifndef __BISHO_WATCHDOG_H__
+#define __BISHO_WATCHDOG_H__
 
-#include <gtk/gtk.h>
-#include "mux-expanding-item.h"
+#include <glib.h>
 
 G_BEGIN_DECLS
 
-void bisho_utils_make_exclusive_expander (MuxExpandingItem *item);
+void bisho_watchdog_start (void);
+
+void bisho_watchdog_stop (void);
+
+void bisho_watchdog_span_begin (const char *name);
 
-char * bisho_utils_encode_tokens (const char *token, const char *secret);
+void bisho_watchdog_span_end (void);
 
 G_END_DECLS
 
-#endif /* __BISHO_UTILS_H__ */
+#endif /* __BISHO_WATCHDOG_H__ */
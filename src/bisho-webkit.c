@@ -17,7 +17,159 @@
  * this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
+#include <glib/gstdio.h>
+#include <gconf/gconf-client.h>
 #include "bisho-webkit.h"
+#include "bisho-metrics.h"
+#include "bisho-watchdog.h"
+#include "bisho-timeline.h"
+#include "bisho-probes.h"
+
+#define REMEMBER_LOGINS_KEY "/apps/bisho/remember_logins"
+
+static gboolean
+remember_logins (void)
+{
+  GConfClient *gconf;
+  gboolean remember;
+  gint64 start;
+
+  start = g_get_monotonic_time ();
+  bisho_watchdog_span_begin ("gconf.read");
+  gconf = gconf_client_get_default ();
+  remember = gconf_client_get_bool (gconf, REMEMBER_LOGINS_KEY, NULL);
+  g_object_unref (gconf);
+  bisho_watchdog_span_end ();
+  bisho_metrics_observe_since ("gconf.read", start);
+
+  return remember;
+}
+
+static char *
+get_cookie_filename (BrowserInfo *info)
+{
+  char *filename, *path;
+
+  filename = g_strconcat (info->pane->info->name, ".txt", NULL);
+  path = g_build_filename (g_get_user_config_dir (), "bisho", "cookies", filename, NULL);
+  g_free (filename);
+
+  return path;
+}
+
+/* Returns TRUE if the cookie belongs to one of the service's domains */
+static gboolean
+cookie_in_scope (BrowserInfo *info, SoupCookie *cookie)
+{
+  const char *host = cookie->domain;
+  gsize host_len, len;
+  int i;
+
+  if (host[0] == '.')
+    host++;
+  host_len = strlen (host);
+
+  for (i = 0; info->cookie_domains[i]; i++) {
+    len = strlen (info->cookie_domains[i]);
+    if (host_len < len)
+      continue;
+    if (g_ascii_strcasecmp (host + host_len - len, info->cookie_domains[i]) != 0)
+      continue;
+    if (host_len == len || host[host_len - len - 1] == '.')
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/*
+ * Replace the session's cookie jar with one for this service, seeded from the
+ * cookies we remembered last time.
+ */
+static void
+attach_cookie_jar (BrowserInfo *info)
+{
+  SoupSession *session;
+  SoupCookieJar *stored;
+  GSList *cookies, *l;
+  char *path;
+
+  if (info->cookie_jar || info->cookie_domains == NULL || !remember_logins ())
+    return;
+
+  session = webkit_get_default_session ();
+  info->default_jar = soup_session_get_feature (session, SOUP_TYPE_COOKIE_JAR);
+  if (info->default_jar) {
+    g_object_ref (info->default_jar);
+    soup_session_remove_feature (session, info->default_jar);
+  }
+
+  info->cookie_jar = soup_cookie_jar_new ();
+
+  path = get_cookie_filename (info);
+  if (g_file_test (path, G_FILE_TEST_EXISTS)) {
+    stored = soup_cookie_jar_text_new (path, TRUE);
+    cookies = soup_cookie_jar_all_cookies (stored);
+    /* The jar takes ownership of the cookies */
+    for (l = cookies; l; l = l->next)
+      soup_cookie_jar_add_cookie (info->cookie_jar, l->data);
+    g_slist_free (cookies);
+    g_object_unref (stored);
+  }
+  g_free (path);
+
+  soup_session_add_feature (session, SOUP_SESSION_FEATURE (info->cookie_jar));
+}
+
+/*
+ * Put the session's own cookie jar back, and write out the
+ * persistent cookies for the service's domains.  Anything else the login
+ * pages set is dropped.
+ */
+static void
+detach_cookie_jar (BrowserInfo *info)
+{
+  SoupSession *session;
+  SoupCookieJar *stored;
+  GSList *cookies, *l;
+  char *path, *dir;
+
+  if (info->cookie_jar == NULL)
+    return;
+
+  session = webkit_get_default_session ();
+  soup_session_remove_feature (session, SOUP_SESSION_FEATURE (info->cookie_jar));
+  if (info->default_jar) {
+    soup_session_add_feature (session, info->default_jar);
+    g_object_unref (info->default_jar);
+    info->default_jar = NULL;
+  }
+
+  path = get_cookie_filename (info);
+  dir = g_path_get_dirname (path);
+  g_mkdir_with_parents (dir, 0700);
+  g_free (dir);
+  g_unlink (path);
+
+  stored = soup_cookie_jar_text_new (path, FALSE);
+  cookies = soup_cookie_jar_all_cookies (info->cookie_jar);
+  for (l = cookies; l; l = l->next) {
+    if (cookie_in_scope (info, l->data))
+      soup_cookie_jar_add_cookie (stored, l->data);
+    else
+      soup_cookie_free (l->data);
+  }
+  g_slist_free (cookies);
+  g_object_unref (stored);
+
+  if (g_file_test (path, G_FILE_TEST_EXISTS))
+    g_chmod (path, 0600);
+  g_free (path);
+
+  g_object_unref (info->cookie_jar);
+  info->cookie_jar = NULL;
+}
 
 static void
 update_title (GtkWindow* window, BrowserInfo *info)
@@ -48,20 +200,91 @@ progress_change_cb (WebKitWebView* page, gint progress, gpointer data)
   update_title (GTK_WINDOW (info->main_window), info);
 }
 
+static gboolean
+is_stop_url (BrowserInfo *info, const char *uri)
+{
+  return uri && info->stop_url && g_strrstr (uri, info->stop_url);
+}
+
+static void
+end_load (BrowserInfo *info, gboolean failed)
+{
+  bisho_timeline_end (info->load_event, failed);
+  info->load_event = 0;
+}
+
+static void
+session_finished (WebKitWebView* page, BrowserInfo *info, const char *uri)
+{
+  end_load (info, FALSE);
+  webkit_web_view_stop_loading (page);
+  gtk_widget_hide (GTK_WIDGET (info->main_window));
+  detach_cookie_jar (info);
+  if (info->session_handler != NULL){
+      info->session_url = (char *) uri;
+      info->session_handler (info);
+  }
+}
+
 static void
 load_commit_cb (WebKitWebView* page, WebKitWebFrame* frame, gpointer data)
 {
   BrowserInfo *info = (BrowserInfo*) data;
   const gchar* uri = webkit_web_frame_get_uri(frame);
 
-  if (g_strrstr (uri, info->stop_url)){
-    webkit_web_view_stop_loading (page);
-    gtk_widget_hide (GTK_WIDGET (info->main_window));
-    if (info->session_handler != NULL){
-        info->session_url = uri;
-        info->session_handler (info);
+  BISHO_PROBE3 (webkit__load__committed, info->pane->info->name, uri,
+                g_get_monotonic_time () - info->open_time);
+
+  if (is_stop_url (info, uri))
+    session_finished (page, info, uri);
+}
+
+static void
+load_finished_cb (WebKitWebView *page, WebKitWebFrame *frame, gpointer data)
+{
+  BrowserInfo *info = (BrowserInfo*) data;
+
+  if (frame == webkit_web_view_get_main_frame (page))
+    end_load (info, FALSE);
+}
+
+static gboolean
+load_error_cb (WebKitWebView *page, WebKitWebFrame *frame, const char *uri,
+               GError *error, gpointer data)
+{
+  BrowserInfo *info = (BrowserInfo*) data;
+
+  if (frame == webkit_web_view_get_main_frame (page))
+    end_load (info, TRUE);
+
+  return FALSE;
+}
+
+/*
+ * Catch the stop URL before it is loaded.  Callbacks such as x-bisho: are not
+ * something WebKit can load, so they never reach load-committed.
+ */
+static gboolean
+navigation_cb (WebKitWebView *page, WebKitWebFrame *frame,
+               WebKitNetworkRequest *request,
+               WebKitWebNavigationAction *action,
+               WebKitWebPolicyDecision *decision,
+               gpointer data)
+{
+  BrowserInfo *info = (BrowserInfo*) data;
+  const gchar* uri = webkit_network_request_get_uri (request);
+
+  if (!is_stop_url (info, uri)) {
+    if (frame == webkit_web_view_get_main_frame (page)) {
+      end_load (info, FALSE);
+      info->load_event = bisho_timeline_begin (info->pane->info->name, "browser", uri);
     }
+    return FALSE;
   }
+
+  webkit_web_policy_decision_ignore (decision);
+  session_finished (page, info, uri);
+  return TRUE;
 }
 
 static GtkWidget*
@@ -71,13 +294,19 @@ create_browser (BrowserInfo *info)
   WebKitWebView *web_view;
   gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolled_window), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
 
+  bisho_watchdog_span_begin ("webkit.create");
   info->web_view = WEBKIT_WEB_VIEW (webkit_web_view_new ());
+  bisho_watchdog_span_end ();
+  bisho_metrics_count ("webkit.views");
   web_view = info->web_view;
   gtk_container_add (GTK_CONTAINER (scrolled_window), GTK_WIDGET (web_view));
 
   g_signal_connect (G_OBJECT (web_view), "title-changed", G_CALLBACK (title_change_cb), info);
   g_signal_connect (G_OBJECT (web_view), "load-progress-changed", G_CALLBACK (progress_change_cb), info);
   g_signal_connect (G_OBJECT (web_view), "load-committed", G_CALLBACK (load_commit_cb), info);
+  g_signal_connect (G_OBJECT (web_view), "load-finished", G_CALLBACK (load_finished_cb), info);
+  g_signal_connect (G_OBJECT (web_view), "load-error", G_CALLBACK (load_error_cb), info);
+  g_signal_connect (G_OBJECT (web_view), "navigation-policy-decision-requested", G_CALLBACK (navigation_cb), info);
 
   return scrolled_window;
 }
@@ -95,14 +324,29 @@ create_window (GdkScreen *screen)
   return window;
 }
 
+static void
+window_destroy_cb (GtkWidget *widget, gpointer data)
+{
+  BrowserInfo *info = (BrowserInfo*) data;
+  end_load (info, FALSE);
+  detach_cookie_jar (info);
+  info->main_window = NULL;
+}
+
 /* Create an authentication browser */
 void
 bisho_webkit_open_url (GdkScreen *screen, BrowserInfo *info, const char *url)
 {
   GtkWidget* vbox = gtk_vbox_new (FALSE, 0);
+
+  info->open_time = g_get_monotonic_time ();
+
   gtk_box_pack_start (GTK_BOX (vbox), create_browser (info), TRUE, TRUE, 0);
 
+  attach_cookie_jar (info);
+
   info->main_window = create_window (screen);
+  g_signal_connect (info->main_window, "destroy", G_CALLBACK (window_destroy_cb), info);
   gtk_container_add (GTK_CONTAINER (info->main_window), vbox);
 
   webkit_web_view_open (info->web_view, url);
@@ -111,3 +355,26 @@ bisho_webkit_open_url (GdkScreen *screen, BrowserInfo *info, const char *url)
   gtk_widget_show_all (info->main_window);
 }
 
+
+/* Forget any cookies remembered for this service */
+void
+bisho_webkit_clear_cookies (BrowserInfo *info)
+{
+  GSList *cookies, *l;
+  char *path;
+
+  g_return_if_fail (info);
+
+  if (info->cookie_jar) {
+    cookies = soup_cookie_jar_all_cookies (info->cookie_jar);
+    for (l = cookies; l; l = l->next) {
+      soup_cookie_jar_delete_cookie (info->cookie_jar, l->data);
+      soup_cookie_free (l->data);
+    }
+    g_slist_free (cookies);
+  }
+
+  path = get_cookie_filename (info);
+  g_unlink (path);
+  g_free (path);
+}
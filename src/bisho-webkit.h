@@ -21,6 +21,7 @@
 #define __BISHO_WEBKIT_H__
 
 #include <gtk/gtk.h>
+#include <libsoup/soup.h>
 #include <webkit/webkit.h>
 #include "bisho-pane.h"
 
@@ -35,10 +36,21 @@ typedef struct {
   char *stop_url;
   char *session_url;
   void (*session_handler)(gpointer);
+  /* NULL-terminated list of domains whose cookies may be remembered */
+  const char **cookie_domains;
+  SoupCookieJar *cookie_jar;
+  /* The session's own jar, put back when the service's jar is removed */
+  SoupSessionFeature *default_jar;
+  /* When the browser was opened, for the probes */
+  gint64 open_time;
+  /* The timeline event for the page being loaded */
+  guint load_event;
 } BrowserInfo;
 
 void bisho_webkit_open_url (GdkScreen *screen, BrowserInfo *info, const char* url);
 
+void bisho_webkit_clear_cookies (BrowserInfo *info);
+
 G_BEGIN_DECLS
 
 #endif /* __BISHO_WEBKIT_H__ */
@@ -18,64 +18,125 @@
  */
 
 #include <glib/gi18n.h>
+#include <string.h>
 #include <gtk/gtk.h>
+#include <gdk/gdkkeysyms.h>
+#include <gconf/gconf-client.h>
 #include <mojito-client/mojito-client.h>
-#include "mux-expanding-item.h"
 #include "bisho-window.h"
-#include "bisho-utils.h"
+#include "bisho-debug-window.h"
+#include "bisho-service-list.h"
+#include "bisho-service-index.h"
+#include "bisho-accounts.h"
+#include "bisho-network.h"
 #include "service-info.h"
+#include "bisho-probes.h"
 #include "bisho-pane-oauth.h"
 #include "bisho-pane-flickr.h"
 #include "bisho-pane-facebook.h"
 #include "bisho-pane-username.h"
 
+/* How long to gather credential changes before telling mojito, in ms */
+#define CREDENTIALS_DELAY 500
+
 struct _BishoWindowPrivate {
   MojitoClient *client;
+  GConfClient *gconf;
   GtkWidget *master_box;
-  /* Hash of string (identifier) to pane widget */
+  GtkWidget *list;
+  /* Hash of string (identifier) to pane widget, for the panes made so far */
   GHashTable *panes;
+  /* The services in the order added to the list, and which match the search */
+  BishoServiceIndex *index;
+  guint8 *matches;
+  guint n_matches;
+  /* Set of the service names in the account cache, while filtering on it */
+  GHashTable *known;
+  GtkWidget *search;
+  GtkToggleToolButton *logged_in_button;
+  GtkToggleToolButton *attention_button;
+  /* Whether mojito is online, assumed until it says */
+  gboolean online;
+  /* Hash of service name to MojitoClientService, made when first needed */
+  GHashTable *services;
+  /* Set of the service names whose credentials changed, to tell mojito */
+  GHashTable *updated;
+  guint updated_id;
+  GtkWidget *debug_window;
 };
 
 #define GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), BISHO_TYPE_WINDOW, BishoWindowPrivate))
 
 G_DEFINE_TYPE (BishoWindow, bisho_window, GTK_TYPE_WINDOW);
 
+/* Tell mojito about every service whose credentials changed */
 static void
-construct_ui (BishoWindow *window, const char *service_name)
+flush_updates (BishoWindow *window)
 {
-  ServiceInfo *info;
-  GtkWidget *expander, *pane;
-  GtkBox *box;
-  MuxExpandingItem *m;
+  BishoWindowPrivate *priv = window->priv;
+  MojitoClientService *service;
+  GHashTableIter iter;
+  gpointer key;
+
+  if (priv->updated_id) {
+    g_source_remove (priv->updated_id);
+    priv->updated_id = 0;
+  }
 
-  g_assert (window);
-  g_assert (service_name);
+  g_hash_table_iter_init (&iter, priv->updated);
+  while (g_hash_table_iter_next (&iter, &key, NULL)) {
+    service = g_hash_table_lookup (priv->services, key);
+    if (service == NULL) {
+      service = mojito_client_get_service (priv->client, key);
+      g_hash_table_insert (priv->services, g_strdup (key), service);
+    }
+    mojito_client_service_credentials_updated (service);
+    g_hash_table_iter_remove (&iter);
+  }
+}
 
-  info = get_info_for_service (service_name);
-  if (info == NULL)
-    return;
+static gboolean
+updated_timeout_cb (gpointer user_data)
+{
+  BishoWindow *window = BISHO_WINDOW (user_data);
 
-  expander = mux_expanding_item_new ();
-  m = MUX_EXPANDING_ITEM (expander);
+  window->priv->updated_id = 0;
+  flush_updates (window);
 
-  bisho_utils_make_exclusive_expander (m);
-  if (info->icon) {
-    mux_expanding_item_set_icon_from_file (m, info->icon);
-  } else {
-    mux_expanding_item_set_label (m, info->display_name);
-  }
+  return FALSE;
+}
+
+/*
+ * Gather the changes for a moment, so that logging out of several services
+ * or one service twice only makes mojito refetch once for each.
+ */
+static void
+credentials_updated_cb (BishoPane *pane, gpointer user_data)
+{
+  BishoWindow *window = BISHO_WINDOW (user_data);
+  BishoWindowPrivate *priv = window->priv;
+
+  g_hash_table_replace (priv->updated, g_strdup (pane->info->name), NULL);
+
+  if (priv->updated_id == 0)
+    priv->updated_id = g_timeout_add (CREDENTIALS_DELAY, updated_timeout_cb, window);
+}
+
+/* Make the pane for a service, the first time it is expanded */
+static GtkWidget *
+create_pane (ServiceInfo *info, gpointer user_data)
+{
+  BishoWindow *window = BISHO_WINDOW (user_data);
+  GtkWidget *pane = NULL;
+  gint64 start;
 
-  box = mux_expanding_item_get_content_box (m);
-  gtk_container_set_border_width (GTK_CONTAINER (box), 8);
-  gtk_box_set_spacing (box, 8);
+  start = g_get_monotonic_time ();
 
   switch (info->auth) {
   case AUTH_USERNAME:
     pane = bisho_pane_username_new (info);
     bisho_pane_username_add_entry
       (BISHO_PANE_USERNAME (pane), _("Username:"), "user", TRUE);
-    gtk_widget_show (pane);
-    gtk_box_pack_start (GTK_BOX (box), pane, FALSE, FALSE, 0);
     break;
   case AUTH_USERNAME_PASSWORD:
     pane = bisho_pane_username_new (info);
@@ -83,25 +144,17 @@ construct_ui (BishoWindow *window, const char *service_name)
       (BISHO_PANE_USERNAME (pane), _("Username:"), "user", TRUE);
     bisho_pane_username_add_entry
       (BISHO_PANE_USERNAME (pane), _("Password:"), "password", FALSE);
-    gtk_widget_show (pane);
-    gtk_box_pack_start (GTK_BOX (box), pane, FALSE, FALSE, 0);
     break;
   case AUTH_OAUTH:
     pane = bisho_pane_oauth_new (window->priv->client, info);
-    gtk_widget_show (pane);
-    gtk_box_pack_start (GTK_BOX (box), pane, FALSE, FALSE, 0);
     g_hash_table_insert (window->priv->panes, info->name, pane);
     break;
   case AUTH_FLICKR:
     pane = bisho_pane_flickr_new (window->priv->client, info);
-    gtk_widget_show (pane);
-    gtk_box_pack_start (GTK_BOX (box), pane, FALSE, FALSE, 0);
     g_hash_table_insert (window->priv->panes, info->name, pane);
     break;
   case AUTH_FACEBOOK:
     pane = bisho_pane_facebook_new (window->priv->client, info);
-    gtk_widget_show (pane);
-    gtk_box_pack_start (GTK_BOX (box), pane, FALSE, FALSE, 0);
     g_hash_table_insert (window->priv->panes, info->name, pane);
     break;
   case AUTH_INVALID:
@@ -109,8 +162,127 @@ construct_ui (BishoWindow *window, const char *service_name)
     break;
   }
 
-  gtk_widget_show_all (expander);
-  gtk_box_pack_start (GTK_BOX (window->priv->master_box), expander, FALSE, FALSE, 0);
+  if (pane) {
+    bisho_pane_set_online (BISHO_PANE (pane), window->priv->online);
+    g_signal_connect_object (pane, "credentials-updated",
+                             G_CALLBACK (credentials_updated_cb), window, 0);
+  }
+
+  BISHO_PROBE2 (ui__construct, info->name, g_get_monotonic_time () - start);
+
+  return pane;
+}
+
+static gboolean
+is_logged_in (BishoWindow *window, ServiceInfo *info, GtkWidget *pane)
+{
+  if (pane)
+    return bisho_pane_get_state (BISHO_PANE (pane)) == BISHO_PANE_STATE_LOGGED_IN;
+
+  return g_hash_table_lookup (window->priv->known, info->name) != NULL;
+}
+
+static gboolean
+filter_service (ServiceInfo *info, guint index, GtkWidget *pane, gpointer user_data)
+{
+  BishoWindow *window = BISHO_WINDOW (user_data);
+  BishoWindowPrivate *priv = window->priv;
+
+  if (priv->matches && index < priv->n_matches && !priv->matches[index])
+    return FALSE;
+
+  if (gtk_toggle_tool_button_get_active (priv->logged_in_button) &&
+      !is_logged_in (window, info, pane))
+    return FALSE;
+
+  /* Only a pane can be part way through logging in */
+  if (gtk_toggle_tool_button_get_active (priv->attention_button) &&
+      !(pane && bisho_pane_needs_attention (BISHO_PANE (pane))))
+    return FALSE;
+
+  return TRUE;
+}
+
+/*
+ * Filter the list on what is known now.  Panes changing state don't refilter,
+ * so that a pane doesn't vanish while it is being used.
+ */
+static void
+refilter (BishoWindow *window)
+{
+  BishoWindowPrivate *priv = window->priv;
+  gint64 start;
+  char **services;
+  int i;
+
+  start = g_get_monotonic_time ();
+
+  g_hash_table_remove_all (priv->known);
+  if (gtk_toggle_tool_button_get_active (priv->logged_in_button)) {
+    services = bisho_accounts_list ();
+    for (i = 0; services && services[i]; i++)
+      g_hash_table_insert (priv->known, services[i], services[i]);
+    /* The set owns the strings now */
+    g_free (services);
+  }
+
+  g_free (priv->matches);
+  priv->matches = bisho_service_index_search (priv->index,
+                                              gtk_entry_get_text (GTK_ENTRY (priv->search)));
+  priv->n_matches = bisho_service_index_get_size (priv->index);
+
+  bisho_service_list_refilter (BISHO_SERVICE_LIST (priv->list));
+
+  BISHO_PROBE2 (ui__filter,
+                bisho_service_list_get_n_shown (BISHO_SERVICE_LIST (priv->list)),
+                g_get_monotonic_time () - start);
+}
+
+static void
+search_changed_cb (GtkEditable *editable, gpointer user_data)
+{
+  refilter (BISHO_WINDOW (user_data));
+}
+
+static gboolean
+search_key_press_cb (GtkWidget *widget, GdkEventKey *event, gpointer user_data)
+{
+  if (event->keyval == GDK_Escape) {
+    gtk_entry_set_text (GTK_ENTRY (widget), "");
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+static void
+filter_toggled_cb (GtkToggleToolButton *button, gpointer user_data)
+{
+  refilter (BISHO_WINDOW (user_data));
+}
+
+/*
+ * Look the service's hosts up now, as its pane isn't made until it is
+ * expanded and by then the user is waiting.
+ */
+static void
+prefetch_hosts (ServiceInfo *info)
+{
+  switch (info->auth) {
+  case AUTH_OAUTH:
+    bisho_network_prefetch (info->oauth.base_url);
+    break;
+  case AUTH_FLICKR:
+    bisho_network_prefetch (info->flickr.base_url ?: FLICKR_API_URL);
+    bisho_network_prefetch (FLICKR_AUTH_URL);
+    break;
+  case AUTH_FACEBOOK:
+    bisho_network_prefetch (info->facebook.base_url ?: FACEBOOK_API_URL);
+    bisho_network_prefetch (FACEBOOK_LOGIN_URL);
+    break;
+  default:
+    break;
+  }
 }
 
 static void
@@ -119,17 +291,124 @@ client_get_services_cb (MojitoClient *client,
                         gpointer      userdata)
 {
   BishoWindow *window = BISHO_WINDOW (userdata);
+  ServiceInfo *info;
   const GList *l;
 
   for (l = services; l; l = l->next) {
-    construct_ui (window, l->data);
+    info = get_info_for_service (l->data);
+    if (info) {
+      bisho_service_index_add (window->priv->index, info);
+      bisho_service_list_append (BISHO_SERVICE_LIST (window->priv->list), info);
+      prefetch_hosts (info);
+    }
+  }
+
+  /* Search the new services too */
+  if (window->priv->matches)
+    refilter (window);
+}
+
+static void
+set_pane_online (gpointer data, gpointer user_data)
+{
+  bisho_pane_set_online (BISHO_PANE (data), GPOINTER_TO_INT (user_data));
+}
+
+/* Both the answer to the first query and every change after it */
+static void
+client_online_cb (MojitoClient *client, gboolean online, gpointer user_data)
+{
+  BishoWindow *window = BISHO_WINDOW (user_data);
+
+  online = !!online;
+  if (online == window->priv->online)
+    return;
+
+  window->priv->online = online;
+  bisho_service_list_foreach_pane (BISHO_SERVICE_LIST (window->priv->list),
+                                   set_pane_online, GINT_TO_POINTER (online));
+}
+
+static void
+toggle_debug_window (BishoWindow *window)
+{
+  BishoWindowPrivate *priv = window->priv;
+
+  if (priv->debug_window) {
+    gtk_widget_destroy (priv->debug_window);
+    return;
+  }
+
+  priv->debug_window = bisho_debug_window_new ();
+  g_object_add_weak_pointer (G_OBJECT (priv->debug_window), (gpointer *)&priv->debug_window);
+  gtk_window_set_transient_for (GTK_WINDOW (priv->debug_window), GTK_WINDOW (window));
+  gtk_widget_show (priv->debug_window);
+}
+
+static gboolean
+bisho_window_key_press_event (GtkWidget *widget, GdkEventKey *event)
+{
+  guint modifiers = gtk_accelerator_get_default_mod_mask ();
+
+  if ((event->state & modifiers) == (GDK_CONTROL_MASK | GDK_SHIFT_MASK) &&
+      (event->keyval == GDK_D || event->keyval == GDK_d)) {
+    toggle_debug_window (BISHO_WINDOW (widget));
+    return TRUE;
+  }
+
+  return GTK_WIDGET_CLASS (bisho_window_parent_class)->key_press_event (widget, event);
+}
+
+static void
+bisho_window_dispose (GObject *object)
+{
+  BishoWindow *window = BISHO_WINDOW (object);
+
+  if (window->priv->debug_window)
+    gtk_widget_destroy (window->priv->debug_window);
+
+  if (window->priv->client)
+    g_signal_handlers_disconnect_by_func (window->priv->client, client_online_cb, window);
+
+  /* Don't leave mojito with stale credentials */
+  flush_updates (window);
+
+  G_OBJECT_CLASS (bisho_window_parent_class)->dispose (object);
+
+  /* After the panes have gone, as they watch the directory */
+  if (window->priv->gconf) {
+    gconf_client_remove_dir (window->priv->gconf, SERVICE_INFO_GCONF_DIR, NULL);
+    g_object_unref (window->priv->gconf);
+    window->priv->gconf = NULL;
   }
 }
 
+static void
+bisho_window_finalize (GObject *object)
+{
+  BishoWindowPrivate *priv = BISHO_WINDOW (object)->priv;
+
+  bisho_service_index_free (priv->index);
+  g_free (priv->matches);
+  g_hash_table_destroy (priv->known);
+  g_hash_table_destroy (priv->updated);
+  g_hash_table_destroy (priv->services);
+  g_hash_table_destroy (priv->panes);
+
+  G_OBJECT_CLASS (bisho_window_parent_class)->finalize (object);
+}
+
 static void
 bisho_window_class_init (BishoWindowClass *klass)
 {
+  GObjectClass *o_class = G_OBJECT_CLASS (klass);
+  GtkWidgetClass *w_class = GTK_WIDGET_CLASS (klass);
+
   g_type_class_add_private (klass, sizeof (BishoWindowPrivate));
+
+  o_class->dispose = bisho_window_dispose;
+  o_class->finalize = bisho_window_finalize;
+  w_class->key_press_event = bisho_window_key_press_event;
 }
 
 static void
@@ -138,11 +417,26 @@ bisho_window_init (BishoWindow *self)
 #define PACK_IN_TOOL(wid,icon)	{ GtkWidget *tbox; tbox = gtk_hbox_new (FALSE, 0); gtk_box_pack_start ((GtkBox *)tbox, gtk_image_new_from_icon_name(icon, GTK_ICON_SIZE_BUTTON), FALSE, FALSE, 0); wid = (GtkWidget *)gtk_tool_button_new (tbox, NULL); }
 
   GdkScreen *screen;
-  GtkWidget *box, *toolbar, *label, *quit;
-  GtkToolItem *sep;
+  GtkWidget *box, *toolbar, *label, *quit, *scrolled;
+  GtkToolItem *sep, *item;
+  const char *debug;
 
   self->priv = GET_PRIVATE (self);
 
+  self->priv->panes = g_hash_table_new (g_str_hash, g_str_equal);
+  self->priv->index = bisho_service_index_new ();
+  self->priv->known = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  self->priv->services = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+  self->priv->updated = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  /*
+   * Fetch the settings for every username pane in one go, and watch them.
+   * The panes share this client, so they read from its cache.
+   */
+  self->priv->gconf = gconf_client_get_default ();
+  gconf_client_add_dir (self->priv->gconf, SERVICE_INFO_GCONF_DIR,
+                        GCONF_CLIENT_PRELOAD_RECURSIVE, NULL);
+
   gtk_window_set_title (GTK_WINDOW (self), _("My Web Accounts"));
   gtk_window_set_icon_name (GTK_WINDOW (self), "bisho");
   gtk_window_set_decorated (GTK_WINDOW (self), FALSE);
@@ -161,11 +455,34 @@ bisho_window_init (BishoWindow *self)
   gtk_widget_show (toolbar);
   gtk_box_pack_start (GTK_BOX (box), toolbar, FALSE, FALSE, 0);
 
+  self->priv->search = gtk_entry_new ();
+  gtk_widget_set_tooltip_text (self->priv->search, _("Search for a service"));
+  g_signal_connect (self->priv->search, "changed", G_CALLBACK (search_changed_cb), self);
+  g_signal_connect (self->priv->search, "key-press-event", G_CALLBACK (search_key_press_cb), NULL);
+  item = gtk_tool_item_new ();
+  gtk_container_add (GTK_CONTAINER (item), self->priv->search);
+  gtk_widget_show_all (GTK_WIDGET (item));
+  gtk_toolbar_insert ((GtkToolbar *)toolbar, item, -1);
+
+  item = gtk_toggle_tool_button_new ();
+  gtk_tool_button_set_label (GTK_TOOL_BUTTON (item), _("Logged in"));
+  g_signal_connect (item, "toggled", G_CALLBACK (filter_toggled_cb), self);
+  gtk_widget_show (GTK_WIDGET (item));
+  gtk_toolbar_insert ((GtkToolbar *)toolbar, item, -1);
+  self->priv->logged_in_button = GTK_TOGGLE_TOOL_BUTTON (item);
+
+  item = gtk_toggle_tool_button_new ();
+  gtk_tool_button_set_label (GTK_TOOL_BUTTON (item), _("Needs attention"));
+  g_signal_connect (item, "toggled", G_CALLBACK (filter_toggled_cb), self);
+  gtk_widget_show (GTK_WIDGET (item));
+  gtk_toolbar_insert ((GtkToolbar *)toolbar, item, -1);
+  self->priv->attention_button = GTK_TOGGLE_TOOL_BUTTON (item);
+
   sep = gtk_separator_tool_item_new ();
   gtk_separator_tool_item_set_draw (GTK_SEPARATOR_TOOL_ITEM (sep), FALSE);
   gtk_tool_item_set_expand (GTK_TOOL_ITEM (sep), TRUE);
   gtk_widget_show (GTK_WIDGET (sep));
-  gtk_toolbar_insert ((GtkToolbar *)toolbar, sep, 0);
+  gtk_toolbar_insert ((GtkToolbar *)toolbar, sep, -1);
 
   PACK_IN_TOOL (quit, "gtk-close");
   gtk_widget_set_tooltip_text (quit, _("Quit"));
@@ -184,11 +501,28 @@ bisho_window_init (BishoWindow *self)
   gtk_widget_show (label);
   gtk_box_pack_start (GTK_BOX (self->priv->master_box), label, FALSE, FALSE, 0);
 
-  self->priv->panes = g_hash_table_new (g_str_hash, g_str_equal);
+  scrolled = gtk_scrolled_window_new (NULL, NULL);
+  gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolled),
+                                  GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+  gtk_widget_show (scrolled);
+  gtk_box_pack_start (GTK_BOX (self->priv->master_box), scrolled, TRUE, TRUE, 0);
+
+  self->priv->list = bisho_service_list_new (create_pane, self);
+  bisho_service_list_set_filter_func (BISHO_SERVICE_LIST (self->priv->list),
+                                      filter_service, self, NULL);
+  gtk_widget_show (self->priv->list);
+  gtk_container_add (GTK_CONTAINER (scrolled), self->priv->list);
 
+  self->priv->online = TRUE;
   self->priv->client = mojito_client_new ();
+  g_signal_connect (self->priv->client, "online-changed", G_CALLBACK (client_online_cb), self);
+  mojito_client_is_online (self->priv->client, client_online_cb, self);
   /* TODO move to a separate populate() function? */
   mojito_client_get_services (self->priv->client, client_get_services_cb, self);
+
+  debug = g_getenv ("BISHO_DEBUG");
+  if (debug && strstr (debug, "timeline"))
+    toggle_debug_window (self);
 }
 
 GtkWidget *
@@ -201,10 +535,15 @@ void
 bisho_window_callback (BishoWindow *window, const char *id, GHashTable *params)
 {
   BishoPane *pane;
+  gint64 start;
+
+  start = g_get_monotonic_time ();
 
   pane = g_hash_table_lookup (window->priv->panes, id);
   if (pane)
     bisho_pane_continue_auth (pane, params);
+
+  BISHO_PROBE3 (callback__dispatch, id, g_get_monotonic_time () - start, pane != NULL);
 }
 
 MojitoClient *
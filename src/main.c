@@ -23,11 +23,32 @@
 #include <unique/unique.h>
 #include <libsoup/soup.h>
 #include "bisho-window.h"
+#include "bisho-status.h"
+#include "bisho-accounts-service.h"
+#include "bisho-metrics.h"
+#include "bisho-watchdog.h"
 
 enum {
   COMMAND_CALLBACK = 1
 };
 
+static gboolean list = FALSE;
+static gboolean status = FALSE;
+static gboolean json = FALSE;
+static gboolean accounts_service = FALSE;
+
+static const GOptionEntry entries[] = {
+  { "list", 'l', 0, G_OPTION_ARG_NONE, &list,
+    N_("List the services that can be configured"), NULL },
+  { "status", 's', 0, G_OPTION_ARG_NONE, &status,
+    N_("Show which services are logged in"), NULL },
+  { "json", 'j', 0, G_OPTION_ARG_NONE, &json,
+    N_("Print --list or --status as JSON"), NULL },
+  { "accounts-service", 0, 0, G_OPTION_ARG_NONE, &accounts_service,
+    N_("Publish the account status on the session bus"), NULL },
+  { NULL }
+};
+
 static void
 handle_uri (BishoWindow *window, const char *s)
 {
@@ -81,9 +102,19 @@ unique_message_cb (UniqueApp *app,
   return UNIQUE_RESPONSE_OK;
 }
 
+/* Keep the window alive after the main loop, so it can be destroyed there */
+static gboolean
+delete_event_cb (GtkWidget *widget, GdkEvent *event, gpointer user_data)
+{
+  gtk_main_quit ();
+  return TRUE;
+}
+
 int
 main (int argc, char **argv)
 {
+  GOptionContext *context;
+  GError *error = NULL;
   UniqueApp *app;
   GtkWidget *window;
 
@@ -93,9 +124,32 @@ main (int argc, char **argv)
   bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
   textdomain (GETTEXT_PACKAGE);
 
-  gtk_init (&argc, &argv);
+  /*
+   * Parse our own options first so that --list, --status and
+   * --accounts-service can run without starting GTK.  Anything else is left for gtk_init().
+   */
+  context = g_option_context_new (_("- configure your web services"));
+  g_option_context_set_translation_domain (context, GETTEXT_PACKAGE);
+  g_option_context_set_ignore_unknown_options (context, TRUE);
+  g_option_context_add_main_entries (context, entries, GETTEXT_PACKAGE);
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_error_free (error);
+    return 1;
+  }
+  g_option_context_free (context);
 
-  /* TODO: use GOption to parse arguments */
+  if (list || status) {
+    g_type_init ();
+    return bisho_status_run (status, json);
+  }
+
+  if (accounts_service) {
+    g_type_init ();
+    return bisho_accounts_service_run ();
+  }
+
+  gtk_init (&argc, &argv);
 
   app = unique_app_new_with_commands ("com.intel.Bisho", NULL,
                                       "callback", COMMAND_CALLBACK,
@@ -118,18 +172,27 @@ main (int argc, char **argv)
       goto done;
   }
 
+  bisho_metrics_init ();
+  bisho_metrics_export ();
+  bisho_watchdog_start ();
+
   window = bisho_window_new ();
 
   unique_app_watch_window (app, GTK_WINDOW (window));
 
   g_signal_connect (app, "message-received", G_CALLBACK (unique_message_cb), window);
 
-  g_signal_connect (window, "delete-event", gtk_main_quit, NULL);
+  g_signal_connect (window, "delete-event", G_CALLBACK (delete_event_cb), NULL);
 
   gtk_widget_show (window);
 
   gtk_main ();
 
+  /* Let the panes save anything pending */
+  gtk_widget_destroy (window);
+
+  bisho_watchdog_stop ();
+
  done:
   g_object_unref (app);
 
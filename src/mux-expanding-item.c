@@ -188,6 +188,16 @@ mux_expanding_item_set_icon_from_file (MuxExpandingItem *item, const char *filen
   gtk_image_set_from_file (GTK_IMAGE (priv->icon), filename);
 }
 
+void
+mux_expanding_item_set_icon_from_pixbuf (MuxExpandingItem *item, GdkPixbuf *pixbuf)
+{
+  MuxExpandingItemPrivate *priv;
+
+  priv = GET_PRIVATE (item);
+
+  gtk_image_set_from_pixbuf (GTK_IMAGE (priv->icon), pixbuf);
+}
+
 GtkBox *
 mux_expanding_item_get_button_box (MuxExpandingItem *item)
 {
@@ -17,6 +17,11 @@
  */
 
 /*
+ * A paragraph of wrapped text with links, drawn from a single PangoLayout.
+ * The text lives in a GtkTextBuffer so that callers can insert text and link
+ * tags into it, but there is no text view: the layout is rebuilt from the
+ * buffer when it changes, and the label hit-tests the links itself.
+ *
  * TODO: GTK+ in git has support for hyperlinks in labels which makes this
  * entire class redundant.  When we have that version of GTK+, drop this.
  */
@@ -26,41 +31,559 @@
 #include <gtk/gtk.h>
 #include "mux-label.h"
 
-G_DEFINE_TYPE (MuxLabel, mux_label, GTK_TYPE_TEXT_VIEW);
+/* The space around the text, as the text view this replaced had */
+#define MARGIN 6
+
+/*
+ * The tags made for markup are interned by their attributes and shared by
+ * every label, so setting markup again doesn't grow the tag table.  A tag
+ * that no label is using is dropped once there are more than this many.
+ */
+#define MAX_UNUSED_TAGS 16
+
+typedef struct {
+  GtkTextTag *tag;
+  /* The number of labels whose markup uses the tag */
+  guint users;
+} InternedTag;
+
+typedef struct {
+  GtkTextTag *tag;
+  /* Byte range of the link in the layout's text */
+  guint start;
+  guint end;
+} Link;
+
+typedef struct {
+  GtkTextBuffer *buffer;
+  PangoLayout *layout;
+  /* Whether the layout needs rebuilding from the buffer */
+  gboolean dirty;
+  /* The width the layout was last wrapped to, or -1 */
+  int width;
+  /* Input-only window for the clicks and the link cursor */
+  GdkWindow *event_window;
+  /* Array of Link, in the order they appear */
+  GArray *links;
+  /* The link under the pointer, or NULL */
+  GtkTextTag *hover;
+  /* The markup last set, so that setting it again is free */
+  char *markup;
+  /* Set of InternedTag used by the current markup */
+  GHashTable *tags;
+  /* List of the link tags made for this label */
+  GSList *link_tags;
+} MuxLabelPrivate;
+
+#define GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), MUX_TYPE_LABEL, MuxLabelPrivate))
+
+G_DEFINE_TYPE (MuxLabel, mux_label, GTK_TYPE_WIDGET);
+
+/* The tag table all labels share */
+static GtkTextTagTable *tag_table = NULL;
+/* Hash of attribute signature to InternedTag */
+static GHashTable *interned = NULL;
+static guint n_unused = 0;
+
+static void
+interned_tag_free (gpointer data)
+{
+  InternedTag *interned_tag = data;
+
+  gtk_text_tag_table_remove (tag_table, interned_tag->tag);
+  g_object_unref (interned_tag->tag);
+  g_slice_free (InternedTag, interned_tag);
+}
+
+static gboolean
+is_unused (gpointer key, gpointer value, gpointer user_data)
+{
+  return ((InternedTag *) value)->users == 0;
+}
+
+static void
+release_tag (gpointer key, gpointer value, gpointer user_data)
+{
+  InternedTag *interned_tag = key;
+
+  if (--interned_tag->users == 0)
+    n_unused++;
+}
+
+/* Let go of a set of tags that a label's markup no longer uses */
+static void
+release_tags (GHashTable *tags)
+{
+  g_hash_table_foreach (tags, release_tag, NULL);
+  g_hash_table_remove_all (tags);
+
+  if (n_unused > MAX_UNUSED_TAGS) {
+    g_hash_table_foreach_remove (interned, is_unused, NULL);
+    n_unused = 0;
+  }
+}
+
+/* Layout */
+
+static void
+add_attr (PangoAttrList *attrs, PangoAttribute *attr, guint start, guint end)
+{
+  attr->start_index = start;
+  attr->end_index = end;
+  pango_attr_list_insert (attrs, attr);
+}
+
+/* Turn the properties that @tag sets into attributes over a byte range */
+static void
+add_tag_attrs (PangoAttrList *attrs, GtkTextTag *tag, guint start, guint end)
+{
+  gboolean family_set, style_set, variant_set, weight_set, stretch_set;
+  gboolean size_set, scale_set, fg_set, bg_set, underline_set;
+  gboolean strikethrough_set, rise_set;
+  char *family;
+  PangoStyle style;
+  PangoVariant variant;
+  int weight, size, rise;
+  PangoStretch stretch;
+  gdouble scale;
+  GdkColor *fg, *bg;
+  PangoUnderline underline;
+  gboolean strikethrough;
+
+  g_object_get (tag,
+                "family-set", &family_set, "family", &family,
+                "style-set", &style_set, "style", &style,
+                "variant-set", &variant_set, "variant", &variant,
+                "weight-set", &weight_set, "weight", &weight,
+                "stretch-set", &stretch_set, "stretch", &stretch,
+                "size-set", &size_set, "size", &size,
+                "scale-set", &scale_set, "scale", &scale,
+                "foreground-set", &fg_set, "foreground-gdk", &fg,
+                "background-set", &bg_set, "background-gdk", &bg,
+                "underline-set", &underline_set, "underline", &underline,
+                "strikethrough-set", &strikethrough_set, "strikethrough", &strikethrough,
+                "rise-set", &rise_set, "rise", &rise,
+                NULL);
+
+  if (family_set && family)
+    add_attr (attrs, pango_attr_family_new (family), start, end);
+  if (style_set)
+    add_attr (attrs, pango_attr_style_new (style), start, end);
+  if (variant_set)
+    add_attr (attrs, pango_attr_variant_new (variant), start, end);
+  if (weight_set)
+    add_attr (attrs, pango_attr_weight_new (weight), start, end);
+  if (stretch_set)
+    add_attr (attrs, pango_attr_stretch_new (stretch), start, end);
+  if (size_set)
+    add_attr (attrs, pango_attr_size_new (size), start, end);
+  if (scale_set)
+    add_attr (attrs, pango_attr_scale_new (scale), start, end);
+  if (fg_set && fg)
+    add_attr (attrs, pango_attr_foreground_new (fg->red, fg->green, fg->blue), start, end);
+  if (bg_set && bg)
+    add_attr (attrs, pango_attr_background_new (bg->red, bg->green, bg->blue), start, end);
+  if (underline_set)
+    add_attr (attrs, pango_attr_underline_new (underline), start, end);
+  if (strikethrough_set)
+    add_attr (attrs, pango_attr_strikethrough_new (strikethrough), start, end);
+  if (rise_set)
+    add_attr (attrs, pango_attr_rise_new (rise), start, end);
+
+  g_free (family);
+  if (fg)
+    gdk_color_free (fg);
+  if (bg)
+    gdk_color_free (bg);
+}
+
+/* Rebuild the layout's text, attributes and links from the buffer */
+static void
+update_layout (MuxLabel *label)
+{
+  MuxLabelPrivate *priv = GET_PRIVATE (label);
+  GtkTextIter iter, next, end;
+  PangoAttrList *attrs;
+  GSList *tags, *l;
+  char *text;
+  guint start_byte, end_byte;
+  Link link;
+
+  if (!priv->dirty)
+    return;
+  priv->dirty = FALSE;
+
+  gtk_text_buffer_get_bounds (priv->buffer, &iter, &end);
+  text = gtk_text_buffer_get_text (priv->buffer, &iter, &end, TRUE);
+
+  attrs = pango_attr_list_new ();
+  g_array_set_size (priv->links, 0);
+  priv->hover = NULL;
+
+  start_byte = 0;
+  while (!gtk_text_iter_equal (&iter, &end)) {
+    next = iter;
+    gtk_text_iter_forward_to_tag_toggle (&next, NULL);
+    end_byte = g_utf8_offset_to_pointer (text, gtk_text_iter_get_offset (&next)) - text;
+
+    tags = gtk_text_iter_get_tags (&iter);
+    for (l = tags; l; l = l->next) {
+      add_tag_attrs (attrs, l->data, start_byte, end_byte);
+
+      if (g_slist_find (priv->link_tags, l->data)) {
+        link.tag = l->data;
+        link.start = start_byte;
+        link.end = end_byte;
+        g_array_append_val (priv->links, link);
+      }
+    }
+    g_slist_free (tags);
+
+    iter = next;
+    start_byte = end_byte;
+  }
+
+  pango_layout_set_text (priv->layout, text, -1);
+  pango_layout_set_attributes (priv->layout, attrs);
+  pango_attr_list_unref (attrs);
+  g_free (text);
+}
+
+static void
+buffer_changed_cb (GtkTextBuffer *buffer, gpointer user_data)
+{
+  MuxLabel *label = MUX_LABEL (user_data);
+  MuxLabelPrivate *priv = GET_PRIVATE (label);
+
+  /* Any change, including our own, means the markup has to be set again */
+  g_free (priv->markup);
+  priv->markup = NULL;
+
+  priv->dirty = TRUE;
+  gtk_widget_queue_resize (GTK_WIDGET (label));
+}
+
+static void
+buffer_tag_cb (GtkTextBuffer *buffer, GtkTextTag *tag,
+               GtkTextIter *start, GtkTextIter *end, gpointer user_data)
+{
+  buffer_changed_cb (buffer, user_data);
+}
+
+/* Returns the link tag at @x, @y in widget coordinates, or NULL */
+static GtkTextTag *
+get_link_at (MuxLabel *label, int x, int y)
+{
+  MuxLabelPrivate *priv = GET_PRIVATE (label);
+  int index, trailing;
+  guint i;
+  Link *link;
+
+  update_layout (label);
+
+  if (priv->links->len == 0)
+    return NULL;
+
+  if (!pango_layout_xy_to_index (priv->layout,
+                                 (x - MARGIN) * PANGO_SCALE,
+                                 (y - MARGIN) * PANGO_SCALE,
+                                 &index, &trailing))
+    return NULL;
+
+  for (i = 0; i < priv->links->len; i++) {
+    link = &g_array_index (priv->links, Link, i);
+    if (index >= (int) link->start && index < (int) link->end)
+      return link->tag;
+  }
+
+  return NULL;
+}
+
+/* Widget */
+
+static void
+mux_label_size_request (GtkWidget *widget, GtkRequisition *requisition)
+{
+  MuxLabelPrivate *priv = GET_PRIVATE (widget);
+  int height;
+
+  update_layout (MUX_LABEL (widget));
+
+  /*
+   * Like a wrapping GtkLabel, ask for little width and for the height the text
+   * needs at the width last allocated.  A new width queues another request.
+   */
+  if (priv->width > 0)
+    pango_layout_set_width (priv->layout, MAX (priv->width - 2 * MARGIN, 1) * PANGO_SCALE);
+  else
+    pango_layout_set_width (priv->layout, -1);
+  pango_layout_get_pixel_size (priv->layout, NULL, &height);
+
+  requisition->width = 2 * MARGIN;
+  requisition->height = height + 2 * MARGIN;
+}
+
+static void
+mux_label_size_allocate (GtkWidget *widget, GtkAllocation *allocation)
+{
+  MuxLabelPrivate *priv = GET_PRIVATE (widget);
+
+  widget->allocation = *allocation;
+
+  if (priv->event_window)
+    gdk_window_move_resize (priv->event_window,
+                            allocation->x, allocation->y,
+                            allocation->width, allocation->height);
+
+  if (allocation->width != priv->width) {
+    priv->width = allocation->width;
+    gtk_widget_queue_resize (widget);
+  }
+}
+
+static gboolean
+mux_label_expose_event (GtkWidget *widget, GdkEventExpose *event)
+{
+  MuxLabelPrivate *priv = GET_PRIVATE (widget);
+
+  update_layout (MUX_LABEL (widget));
+
+  gtk_paint_layout (widget->style, widget->window, GTK_WIDGET_STATE (widget),
+                    FALSE, &event->area, widget, "label",
+                    widget->allocation.x + MARGIN,
+                    widget->allocation.y + MARGIN,
+                    priv->layout);
+
+  return FALSE;
+}
+
+static void
+mux_label_realize (GtkWidget *widget)
+{
+  MuxLabelPrivate *priv = GET_PRIVATE (widget);
+  GdkWindowAttr attributes;
+
+  GTK_WIDGET_SET_FLAGS (widget, GTK_REALIZED);
+
+  widget->window = gtk_widget_get_parent_window (widget);
+  g_object_ref (widget->window);
+
+  attributes.window_type = GDK_WINDOW_CHILD;
+  attributes.x = widget->allocation.x;
+  attributes.y = widget->allocation.y;
+  attributes.width = widget->allocation.width;
+  attributes.height = widget->allocation.height;
+  attributes.wclass = GDK_INPUT_ONLY;
+  attributes.event_mask = gtk_widget_get_events (widget) |
+    GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK |
+    GDK_POINTER_MOTION_MASK | GDK_LEAVE_NOTIFY_MASK;
+
+  priv->event_window = gdk_window_new (widget->window, &attributes, GDK_WA_X | GDK_WA_Y);
+  gdk_window_set_user_data (priv->event_window, widget);
+
+  widget->style = gtk_style_attach (widget->style, widget->window);
+}
+
+static void
+mux_label_unrealize (GtkWidget *widget)
+{
+  MuxLabelPrivate *priv = GET_PRIVATE (widget);
+
+  if (priv->event_window) {
+    gdk_window_set_user_data (priv->event_window, NULL);
+    gdk_window_destroy (priv->event_window);
+    priv->event_window = NULL;
+  }
+
+  GTK_WIDGET_CLASS (mux_label_parent_class)->unrealize (widget);
+}
+
+static void
+mux_label_map (GtkWidget *widget)
+{
+  GTK_WIDGET_CLASS (mux_label_parent_class)->map (widget);
+  gdk_window_show (GET_PRIVATE (widget)->event_window);
+}
+
+static void
+mux_label_unmap (GtkWidget *widget)
+{
+  gdk_window_hide (GET_PRIVATE (widget)->event_window);
+  GTK_WIDGET_CLASS (mux_label_parent_class)->unmap (widget);
+}
+
+static void
+set_hover (MuxLabel *label, GtkTextTag *tag)
+{
+  MuxLabelPrivate *priv = GET_PRIVATE (label);
+  GdkCursor *cursor;
+
+  if (priv->hover == tag)
+    return;
+  priv->hover = tag;
+
+  if (priv->event_window == NULL)
+    return;
+
+  if (tag) {
+    cursor = gdk_cursor_new_for_display (gtk_widget_get_display (GTK_WIDGET (label)), GDK_HAND2);
+    gdk_window_set_cursor (priv->event_window, cursor);
+    gdk_cursor_unref (cursor);
+  } else {
+    gdk_window_set_cursor (priv->event_window, NULL);
+  }
+}
+
+static gboolean
+mux_label_motion_notify_event (GtkWidget *widget, GdkEventMotion *event)
+{
+  set_hover (MUX_LABEL (widget), get_link_at (MUX_LABEL (widget), event->x, event->y));
+  return FALSE;
+}
+
+static gboolean
+mux_label_leave_notify_event (GtkWidget *widget, GdkEventCrossing *event)
+{
+  set_hover (MUX_LABEL (widget), NULL);
+  return FALSE;
+}
+
+/* Hand button events on a link to the tag, as GtkTextView would */
+static gboolean
+mux_label_button_event (GtkWidget *widget, GdkEventButton *event)
+{
+  MuxLabelPrivate *priv = GET_PRIVATE (widget);
+  GtkTextTag *tag;
+  GtkTextIter iter;
+  const char *text;
+  int index, trailing;
+  gboolean handled = FALSE;
+
+  tag = get_link_at (MUX_LABEL (widget), event->x, event->y);
+  if (tag == NULL)
+    return FALSE;
+
+  pango_layout_xy_to_index (priv->layout,
+                            ((int) event->x - MARGIN) * PANGO_SCALE,
+                            ((int) event->y - MARGIN) * PANGO_SCALE,
+                            &index, &trailing);
+  text = pango_layout_get_text (priv->layout);
+  gtk_text_buffer_get_iter_at_offset (priv->buffer, &iter,
+                                      g_utf8_pointer_to_offset (text, text + index));
+
+  g_signal_emit_by_name (tag, "event", widget, event, &iter, &handled);
+
+  return handled;
+}
 
 static void
 mux_label_style_set (GtkWidget *widget, GtkStyle *previous)
 {
-  GTK_WIDGET_CLASS (mux_label_parent_class)->style_set (widget, previous);
+  MuxLabelPrivate *priv = GET_PRIVATE (widget);
+
+  if (GTK_WIDGET_CLASS (mux_label_parent_class)->style_set)
+    GTK_WIDGET_CLASS (mux_label_parent_class)->style_set (widget, previous);
+
+  if (priv->layout) {
+    pango_layout_context_changed (priv->layout);
+    gtk_widget_queue_resize (widget);
+  }
+}
+
+static void
+mux_label_dispose (GObject *object)
+{
+  MuxLabel *label = MUX_LABEL (object);
+  MuxLabelPrivate *priv = GET_PRIVATE (label);
+  GSList *l;
+
+  if (priv->tags) {
+    release_tags (priv->tags);
+    g_hash_table_destroy (priv->tags);
+    priv->tags = NULL;
+  }
+
+  g_free (priv->markup);
+  priv->markup = NULL;
+
+  /* The link tags are the label's own, so take them out of the shared table */
+  for (l = priv->link_tags; l; l = l->next) {
+    gtk_text_tag_table_remove (tag_table, l->data);
+  }
+  g_slist_free (priv->link_tags);
+  priv->link_tags = NULL;
+
+  if (priv->buffer) {
+    g_signal_handlers_disconnect_by_func (priv->buffer, buffer_changed_cb, label);
+    g_signal_handlers_disconnect_by_func (priv->buffer, buffer_tag_cb, label);
+    g_object_unref (priv->buffer);
+    priv->buffer = NULL;
+  }
+
+  if (priv->layout) {
+    g_object_unref (priv->layout);
+    priv->layout = NULL;
+  }
 
-  widget->style->base[GTK_STATE_NORMAL] = widget->style->bg[GTK_STATE_NORMAL];
-  widget->style->text[GTK_STATE_NORMAL] = widget->style->fg[GTK_STATE_NORMAL];
+  G_OBJECT_CLASS (mux_label_parent_class)->dispose (object);
+}
+
+static void
+mux_label_finalize (GObject *object)
+{
+  MuxLabelPrivate *priv = GET_PRIVATE (object);
+
+  g_array_free (priv->links, TRUE);
+
+  G_OBJECT_CLASS (mux_label_parent_class)->finalize (object);
 }
 
 static void
 mux_label_class_init (MuxLabelClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
   GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
 
+  g_type_class_add_private (klass, sizeof (MuxLabelPrivate));
+
+  object_class->dispose = mux_label_dispose;
+  object_class->finalize = mux_label_finalize;
+
+  widget_class->size_request = mux_label_size_request;
+  widget_class->size_allocate = mux_label_size_allocate;
+  widget_class->expose_event = mux_label_expose_event;
+  widget_class->realize = mux_label_realize;
+  widget_class->unrealize = mux_label_unrealize;
+  widget_class->map = mux_label_map;
+  widget_class->unmap = mux_label_unmap;
+  widget_class->motion_notify_event = mux_label_motion_notify_event;
+  widget_class->leave_notify_event = mux_label_leave_notify_event;
+  widget_class->button_press_event = mux_label_button_event;
+  widget_class->button_release_event = mux_label_button_event;
   widget_class->style_set = mux_label_style_set;
+
+  tag_table = gtk_text_tag_table_new ();
+  interned = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, interned_tag_free);
 }
 
 static void
 mux_label_init (MuxLabel *self)
 {
-  GtkTextView *text = GTK_TEXT_VIEW (self);
+  MuxLabelPrivate *priv = GET_PRIVATE (self);
 
-  g_object_set (text,
-                "editable", FALSE,
-                "cursor-visible", FALSE,
-                "wrap-mode", GTK_WRAP_WORD,
-                "left-margin", 6,
-                "right-margin", 6,
-                "pixels-above-lines", 6,
-                "pixels-below-lines", 6,
-                NULL);
+  GTK_WIDGET_SET_FLAGS (self, GTK_NO_WINDOW);
 
-  /* TODO: find some cunning way of disabling text selection */
+  priv->tags = g_hash_table_new (NULL, NULL);
+  priv->links = g_array_new (FALSE, FALSE, sizeof (Link));
+  priv->width = -1;
+
+  priv->buffer = gtk_text_buffer_new (tag_table);
+  g_signal_connect (priv->buffer, "changed", G_CALLBACK (buffer_changed_cb), self);
+  g_signal_connect_after (priv->buffer, "apply-tag", G_CALLBACK (buffer_tag_cb), self);
+  g_signal_connect_after (priv->buffer, "remove-tag", G_CALLBACK (buffer_tag_cb), self);
+
+  priv->layout = gtk_widget_create_pango_layout (GTK_WIDGET (self), NULL);
+  pango_layout_set_wrap (priv->layout, PANGO_WRAP_WORD);
 }
 
 GtkWidget *
@@ -74,7 +597,7 @@ mux_label_get_buffer (MuxLabel *label)
 {
   g_return_val_if_fail (MUX_IS_LABEL (label), NULL);
 
-  return gtk_text_view_get_buffer (GTK_TEXT_VIEW (label));
+  return GET_PRIVATE (label)->buffer;
 }
 
 static gboolean
@@ -99,14 +622,14 @@ on_link_tag_event (GtkTextTag  *tag,
 GtkTextTag *
 mux_label_create_link_tag (MuxLabel *label, const char *url)
 {
+  MuxLabelPrivate *priv;
   GtkTextTag *tag;
 
-  /* TODO: make a subclass of GtkTextTag for cleanliness and so that we don't
-     leak the URL */
-
   g_return_val_if_fail (MUX_IS_LABEL (label), NULL);
 
-  tag = gtk_text_buffer_create_tag (gtk_text_view_get_buffer (GTK_TEXT_VIEW (label)),
+  priv = GET_PRIVATE (label);
+
+  tag = gtk_text_buffer_create_tag (priv->buffer,
                               NULL,
                               "foreground", "#009bce",
                               "underline", PANGO_UNDERLINE_SINGLE,
@@ -114,7 +637,10 @@ mux_label_create_link_tag (MuxLabel *label, const char *url)
                               NULL);
 
   if (url)
-    g_signal_connect (tag, "event", G_CALLBACK (on_link_tag_event), g_strdup (url));
+    g_signal_connect_data (tag, "event", G_CALLBACK (on_link_tag_event),
+                           g_strdup (url), (GClosureNotify) g_free, 0);
+
+  priv->link_tags = g_slist_prepend (priv->link_tags, tag);
 
   return tag;
 }
@@ -122,19 +648,206 @@ mux_label_create_link_tag (MuxLabel *label, const char *url)
 void
 mux_label_set_text (MuxLabel *label, const char *text)
 {
+  MuxLabelPrivate *priv;
+
   g_return_if_fail (MUX_IS_LABEL (label));
 
-  gtk_text_buffer_set_text (mux_label_get_buffer (label), text, -1);
+  priv = GET_PRIVATE (label);
+
+  gtk_text_buffer_set_text (priv->buffer, text, -1);
+
+  release_tags (priv->tags);
+}
+
+/* Make a tag with the attributes of the iterator's current run */
+static GtkTextTag *
+create_tag (PangoAttrIterator *paiter)
+{
+  PangoAttribute *attr;
+  GtkTextTag *tag;
+
+  tag = gtk_text_tag_new (NULL);
+
+  if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_LANGUAGE)))
+    g_object_set(tag, "language", pango_language_to_string(((PangoAttrLanguage*)attr)->value), NULL);
+
+  if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_FAMILY)))
+    g_object_set(tag, "family", ((PangoAttrString*)attr)->value, NULL);
+
+  if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_STYLE)))
+    g_object_set(tag, "style", ((PangoAttrInt*)attr)->value, NULL);
+
+  if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_WEIGHT)))
+    g_object_set(tag, "weight", ((PangoAttrInt*)attr)->value, NULL);
+
+  if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_VARIANT)))
+    g_object_set(tag, "variant", ((PangoAttrInt*)attr)->value, NULL);
+
+  if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_STRETCH)))
+    g_object_set(tag, "stretch", ((PangoAttrInt*)attr)->value, NULL);
+
+  if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_SIZE)))
+    g_object_set(tag, "size", ((PangoAttrInt*)attr)->value, NULL);
+
+  if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_FONT_DESC)))
+    g_object_set(tag, "font-desc", ((PangoAttrFontDesc*)attr)->desc, NULL);
+
+  if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_FOREGROUND)))
+    {
+      GdkColor col = { 0,
+                       ((PangoAttrColor*)attr)->color.red,
+                       ((PangoAttrColor*)attr)->color.green,
+                       ((PangoAttrColor*)attr)->color.blue
+                     };
+
+      g_object_set(tag, "foreground-gdk", &col, NULL);
+    }
+
+  if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_BACKGROUND)))
+    {
+      GdkColor col = { 0,
+                       ((PangoAttrColor*)attr)->color.red,
+                       ((PangoAttrColor*)attr)->color.green,
+                       ((PangoAttrColor*)attr)->color.blue
+                     };
+
+      g_object_set(tag, "background-gdk", &col, NULL);
+    }
+
+  if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_UNDERLINE)))
+    g_object_set(tag, "underline", ((PangoAttrInt*)attr)->value, NULL);
+
+  if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_STRIKETHROUGH)))
+    g_object_set(tag, "strikethrough", (gboolean)(((PangoAttrInt*)attr)->value != 0), NULL);
+
+  if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_RISE)))
+    g_object_set(tag, "rise", ((PangoAttrInt*)attr)->value, NULL);
+
+  /* PANGO_ATTR_SHAPE cannot be defined via markup text */
+
+  if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_SCALE)))
+    g_object_set(tag, "scale", ((PangoAttrFloat*)attr)->value, NULL);
+
+  return tag;
+}
+
+/* The attribute types create_tag() understands */
+static const PangoAttrType tag_attrs[] = {
+  PANGO_ATTR_LANGUAGE,
+  PANGO_ATTR_FAMILY,
+  PANGO_ATTR_STYLE,
+  PANGO_ATTR_WEIGHT,
+  PANGO_ATTR_VARIANT,
+  PANGO_ATTR_STRETCH,
+  PANGO_ATTR_SIZE,
+  PANGO_ATTR_FONT_DESC,
+  PANGO_ATTR_FOREGROUND,
+  PANGO_ATTR_BACKGROUND,
+  PANGO_ATTR_UNDERLINE,
+  PANGO_ATTR_STRIKETHROUGH,
+  PANGO_ATTR_RISE,
+  PANGO_ATTR_SCALE,
+};
+
+/* Describe the attributes of the current run, or return NULL if it has none */
+static char *
+get_signature (PangoAttrIterator *paiter)
+{
+  PangoAttribute *attr;
+  PangoColor *color;
+  GString *s;
+  char *desc;
+  guint i;
+
+  s = g_string_new (NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (tag_attrs); i++) {
+    attr = pango_attr_iterator_get (paiter, tag_attrs[i]);
+    if (attr == NULL)
+      continue;
+
+    g_string_append_printf (s, "%d=", tag_attrs[i]);
+
+    switch (tag_attrs[i]) {
+    case PANGO_ATTR_LANGUAGE:
+      g_string_append (s, pango_language_to_string (((PangoAttrLanguage*)attr)->value));
+      break;
+    case PANGO_ATTR_FAMILY:
+      g_string_append (s, ((PangoAttrString*)attr)->value);
+      break;
+    case PANGO_ATTR_FONT_DESC:
+      desc = pango_font_description_to_string (((PangoAttrFontDesc*)attr)->desc);
+      g_string_append (s, desc);
+      g_free (desc);
+      break;
+    case PANGO_ATTR_FOREGROUND:
+    case PANGO_ATTR_BACKGROUND:
+      color = &((PangoAttrColor*)attr)->color;
+      g_string_append_printf (s, "%04x%04x%04x", color->red, color->green, color->blue);
+      break;
+    case PANGO_ATTR_SCALE:
+      g_string_append_printf (s, "%g", ((PangoAttrFloat*)attr)->value);
+      break;
+    default:
+      g_string_append_printf (s, "%d", ((PangoAttrInt*)attr)->value);
+      break;
+    }
+
+    g_string_append_c (s, ';');
+  }
+
+  if (s->len == 0) {
+    g_string_free (s, TRUE);
+    return NULL;
+  }
+
+  return g_string_free (s, FALSE);
 }
 
 /*
- * This bad boy was taken from https://bugzilla.gnome.org/show_bug.cgi?id=59390
+ * Find or make the shared tag for the current run, and add it to @used, the
+ * set of tags a label's markup uses.  Returns NULL if the run is plain text.
+ */
+static GtkTextTag *
+intern_tag (PangoAttrIterator *paiter, GHashTable *used)
+{
+  InternedTag *interned_tag;
+  char *signature;
+
+  signature = get_signature (paiter);
+  if (signature == NULL)
+    return NULL;
+
+  interned_tag = g_hash_table_lookup (interned, signature);
+  if (interned_tag) {
+    g_free (signature);
+  } else {
+    interned_tag = g_slice_new0 (InternedTag);
+    interned_tag->tag = create_tag (paiter);
+    gtk_text_tag_table_add (tag_table, interned_tag->tag);
+    g_hash_table_insert (interned, signature, interned_tag);
+    n_unused++;
+  }
+
+  if (!g_hash_table_lookup (used, interned_tag)) {
+    g_hash_table_insert (used, interned_tag, interned_tag);
+    if (interned_tag->users++ == 0)
+      n_unused--;
+  }
+
+  return interned_tag->tag;
+}
+
+/*
+ * This bad boy was taken from https://bugzilla.gnome.org/show_bug.cgi?id=59390,
+ * changed to use the interned tags.
  */
 static void
 gtk_text_buffer_real_insert_markup (GtkTextBuffer *buffer,
                                     GtkTextIter   *textiter,
                                     const gchar   *markup,
-                                    GtkTextTag    *extratag)
+                                    GtkTextTag    *extratag,
+                                    GHashTable    *used)
 {
   PangoAttrIterator  *paiter;
   PangoAttrList      *attrlist;
@@ -171,7 +884,6 @@ gtk_text_buffer_real_insert_markup (GtkTextBuffer *buffer,
 
   do
     {
-      PangoAttribute *attr;
       GtkTextTag     *tag;
       gint            start, end;
 
@@ -180,71 +892,13 @@ gtk_text_buffer_real_insert_markup (GtkTextBuffer *buffer,
       if (end == G_MAXINT)  /* last chunk */
         end = start-1; /* resulting in -1 to be passed to _insert */
 
-      tag = gtk_text_tag_new(NULL);
-
-      if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_LANGUAGE)))
-        g_object_set(tag, "language", pango_language_to_string(((PangoAttrLanguage*)attr)->value), NULL);
-
-      if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_FAMILY)))
-        g_object_set(tag, "family", ((PangoAttrString*)attr)->value, NULL);
-
-      if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_STYLE)))
-        g_object_set(tag, "style", ((PangoAttrInt*)attr)->value, NULL);
-
-      if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_WEIGHT)))
-        g_object_set(tag, "weight", ((PangoAttrInt*)attr)->value, NULL);
-
-      if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_VARIANT)))
-        g_object_set(tag, "variant", ((PangoAttrInt*)attr)->value, NULL);
+      tag = intern_tag(paiter, used);
 
-      if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_STRETCH)))
-        g_object_set(tag, "stretch", ((PangoAttrInt*)attr)->value, NULL);
-
-      if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_SIZE)))
-        g_object_set(tag, "size", ((PangoAttrInt*)attr)->value, NULL);
-
-      if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_FONT_DESC)))
-        g_object_set(tag, "font-desc", ((PangoAttrFontDesc*)attr)->desc, NULL);
-
-      if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_FOREGROUND)))
+      if (tag == NULL)
         {
-          GdkColor col = { 0,
-                           ((PangoAttrColor*)attr)->color.red,
-                           ((PangoAttrColor*)attr)->color.green,
-                           ((PangoAttrColor*)attr)->color.blue
-                         };
-
-          g_object_set(tag, "foreground-gdk", &col, NULL);
+          gtk_text_buffer_insert_with_tags(buffer, textiter, text+start, end - start, extratag, NULL);
         }
-
-      if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_BACKGROUND)))
-        {
-          GdkColor col = { 0,
-                           ((PangoAttrColor*)attr)->color.red,
-                           ((PangoAttrColor*)attr)->color.green,
-                           ((PangoAttrColor*)attr)->color.blue
-                         };
-
-          g_object_set(tag, "background-gdk", &col, NULL);
-        }
-
-      if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_UNDERLINE)))
-        g_object_set(tag, "underline", ((PangoAttrInt*)attr)->value, NULL);
-
-      if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_STRIKETHROUGH)))
-        g_object_set(tag, "strikethrough", (gboolean)(((PangoAttrInt*)attr)->value != 0), NULL);
-
-      if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_RISE)))
-        g_object_set(tag, "rise", ((PangoAttrInt*)attr)->value, NULL);
-
-      /* PANGO_ATTR_SHAPE cannot be defined via markup text */
-
-      if ((attr = pango_attr_iterator_get(paiter, PANGO_ATTR_SCALE)))
-        g_object_set(tag, "scale", ((PangoAttrFloat*)attr)->value, NULL);
-
-      gtk_text_tag_table_add(gtk_text_buffer_get_tag_table(buffer), tag);
-
-      if (extratag)
+      else if (extratag)
         {
           gtk_text_buffer_insert_with_tags(buffer, textiter, text+start, end - start, tag, extratag, NULL);
         }
@@ -268,18 +922,34 @@ gtk_text_buffer_real_insert_markup (GtkTextBuffer *buffer,
 void
 mux_label_set_markup (MuxLabel *label, const char *markup)
 {
+  MuxLabelPrivate *priv;
   GtkTextBuffer *buffer;
   GtkTextIter start, end;
+  GHashTable *old_tags;
 
   g_return_if_fail (MUX_IS_LABEL (label));
   g_return_if_fail (markup != NULL);
 
+  priv = GET_PRIVATE (label);
+
+  if (g_strcmp0 (priv->markup, markup) == 0)
+    return;
+
   buffer = mux_label_get_buffer (label);
 
   gtk_text_buffer_get_bounds (buffer, &start, &end);
 
   gtk_text_buffer_delete (buffer, &start, &end);
 
+  /* Take the new tags before releasing the old, so that shared ones survive */
+  old_tags = priv->tags;
+  priv->tags = g_hash_table_new (NULL, NULL);
+
   gtk_text_buffer_get_iter_at_offset (buffer, &start, 0);
-  gtk_text_buffer_real_insert_markup (buffer, &start, markup, NULL);
+  gtk_text_buffer_real_insert_markup (buffer, &start, markup, NULL, priv->tags);
+
+  release_tags (old_tags);
+  g_hash_table_destroy (old_tags);
+
+  priv->markup = g_strdup (markup);
 }
@@ -48,11 +48,11 @@ typedef struct _MuxLabel      MuxLabel;
 typedef struct _MuxLabelClass MuxLabelClass;
 
 struct _MuxLabel {
-  GtkTextView parent;
+  GtkWidget parent;
 };
 
 struct _MuxLabelClass {
-  GtkTextViewClass parent_class;
+  GtkWidgetClass parent_class;
 };
 
 GType mux_label_get_type (void) G_GNUC_CONST;
@@ -17,12 +17,57 @@
  * this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
 #include <glib.h>
 #include <mojito-keystore/mojito-keystore.h>
 #include "service-info.h"
+#include "bisho-metrics.h"
+#include "bisho-watchdog.h"
 
 #define GROUP "MojitoService"
 #define GROUP_OAUTH "OAuth"
+#define GROUP_FLICKR "Flickr"
+#define GROUP_FACEBOOK "Facebook"
+#define GROUP_VERIFY "Verify"
+
+/*
+ * Look up the API key and secret for a service.  If BISHO_KEYSTORE names a key
+ * file it is used instead of the Mojito keystore, so that bisho can be pointed
+ * at a local test server.  The strings returned should be freed.
+ */
+static gboolean
+get_key_secret (const char *name, char **key, char **secret)
+{
+  const char *path, *const_key, *const_secret;
+  GKeyFile *keystore;
+
+  path = g_getenv ("BISHO_KEYSTORE");
+  if (path == NULL) {
+    if (!mojito_keystore_get_key_secret (name, &const_key, &const_secret))
+      return FALSE;
+    *key = g_strdup (const_key);
+    *secret = g_strdup (const_secret);
+    return TRUE;
+  }
+
+  keystore = g_key_file_new ();
+  if (!g_key_file_load_from_file (keystore, path, G_KEY_FILE_NONE, NULL)) {
+    g_key_file_free (keystore);
+    return FALSE;
+  }
+
+  *key = g_key_file_get_string (keystore, name, "Key", NULL);
+  *secret = g_key_file_get_string (keystore, name, "Secret", NULL);
+  g_key_file_free (keystore);
+
+  if (*key == NULL || *secret == NULL) {
+    g_free (*key);
+    g_free (*secret);
+    return FALSE;
+  }
+
+  return TRUE;
+}
 
 ServiceAuthType
 service_info_authtype_from_string (const char *s)
@@ -45,8 +90,8 @@ service_info_authtype_from_string (const char *s)
   }
 }
 
-ServiceInfo *
-get_info_for_service (const char *name)
+static ServiceInfo *
+parse_service (const char *name)
 {
   char *filename, *path, *real_path, *authstring;
   GKeyFile *keys;
@@ -94,11 +139,11 @@ get_info_for_service (const char *name)
   switch (auth) {
   case AUTH_OAUTH:
     {
-      const char *key, *secret;
+      char *key, *secret;
 
-      if (mojito_keystore_get_key_secret (info->name, &key, &secret)) {
-        info->oauth.consumer_key = g_strdup (key);
-        info->oauth.consumer_secret = g_strdup (secret);
+      if (get_key_secret (info->name, &key, &secret)) {
+        info->oauth.consumer_key = key;
+        info->oauth.consumer_secret = secret;
       } else {
         g_message ("Cannot find keys for %s", info->name);
         /* Yes, we're leaking.  Live with it */
@@ -109,38 +154,44 @@ get_info_for_service (const char *name)
       info->oauth.authorize_function = g_key_file_get_string (keys, GROUP_OAUTH, "AuthoriseFunction", NULL);
       info->oauth.access_token_function = g_key_file_get_string (keys, GROUP_OAUTH, "AccessTokenFunction", NULL);
       info->oauth.callback = g_key_file_get_string (keys, GROUP_OAUTH, "Callback", NULL);
+      info->oauth.embedded_browser = g_key_file_get_boolean (keys, GROUP_OAUTH, "EmbeddedBrowser", NULL);
+      info->oauth.cookie_domains = g_key_file_get_string_list (keys, GROUP_OAUTH, "CookieDomains", NULL, NULL);
     }
     break;
   case AUTH_FLICKR:
     {
-      const char *key, *secret;
+      char *key, *secret;
 
-      if (mojito_keystore_get_key_secret (info->name, &key, &secret)) {
-        info->flickr.api_key = g_strdup (key);
-        info->flickr.shared_secret = g_strdup (secret);
+      if (get_key_secret (info->name, &key, &secret)) {
+        info->flickr.api_key = key;
+        info->flickr.shared_secret = secret;
       } else {
         g_message ("Cannot find keys for %s", info->name);
         /* Yes, we're leaking.  Live with it */
         return NULL;
       }
+      info->flickr.base_url = g_key_file_get_string (keys, GROUP_FLICKR, "BaseURL", NULL);
     }
     break;
   case AUTH_FACEBOOK:
     {
-      const char *key, *secret;
+      char *key, *secret;
 
-      if (mojito_keystore_get_key_secret (info->name, &key, &secret)) {
-        info->facebook.app_id = g_strdup (key);
-        info->facebook.secret = g_strdup (secret);
+      if (get_key_secret (info->name, &key, &secret)) {
+        info->facebook.app_id = key;
+        info->facebook.secret = secret;
       } else {
         g_message ("Cannot find API keys for %s", info->name);
         /* Yes, we're leaking.  Live with it */
         return NULL;
       }
+      info->facebook.base_url = g_key_file_get_string (keys, GROUP_FACEBOOK, "BaseURL", NULL);
     }
     break;
   case AUTH_USERNAME:
   case AUTH_USERNAME_PASSWORD:
+    info->verify_url = g_key_file_get_string (keys, GROUP_VERIFY, "URL", NULL);
+    break;
   case AUTH_INVALID:
     /* Nothing to do */
     break;
@@ -163,3 +214,78 @@ get_info_for_service (const char *name)
   return info;
 }
 
+ServiceInfo *
+get_info_for_service (const char *name)
+{
+  ServiceInfo *info;
+  gint64 start;
+
+  start = g_get_monotonic_time ();
+  bisho_watchdog_span_begin ("service_info.parse");
+  info = parse_service (name);
+  bisho_watchdog_span_end ();
+  bisho_metrics_observe_since ("service_info.parse", start);
+
+  if (info == NULL)
+    bisho_metrics_count ("service_info.parse.failures");
+
+  return info;
+}
+
+static void
+add_services_in (GHashTable *names, const char *data_dir)
+{
+  char *path, *name;
+  const char *filename;
+  GDir *dir;
+
+  path = g_build_filename (data_dir, "mojito", "services", NULL);
+  dir = g_dir_open (path, 0, NULL);
+  g_free (path);
+  if (dir == NULL)
+    return;
+
+  while ((filename = g_dir_read_name (dir)) != NULL) {
+    if (!g_str_has_suffix (filename, ".keys"))
+      continue;
+
+    name = g_strndup (filename, strlen (filename) - strlen (".keys"));
+    g_hash_table_replace (names, name, name);
+  }
+
+  g_dir_close (dir);
+}
+
+/*
+ * Every service with a description in the data directories, sorted by name,
+ * without asking Mojito.  Free the list with g_list_free(); the ServiceInfo
+ * structures are not freed, like those from get_info_for_service().
+ */
+GList *
+service_info_list_all (void)
+{
+  const char * const *dirs;
+  GHashTable *names;
+  GList *keys, *l, *services = NULL;
+  ServiceInfo *info;
+  int i;
+
+  names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  add_services_in (names, g_get_user_data_dir ());
+  dirs = g_get_system_data_dirs ();
+  for (i = 0; dirs[i]; i++)
+    add_services_in (names, dirs[i]);
+
+  keys = g_list_sort (g_hash_table_get_keys (names), (GCompareFunc) strcmp);
+  for (l = keys; l; l = l->next) {
+    info = get_info_for_service (l->data);
+    if (info)
+      services = g_list_prepend (services, info);
+  }
+
+  g_list_free (keys);
+  g_hash_table_destroy (names);
+
+  return g_list_reverse (services);
+}
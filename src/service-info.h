@@ -20,6 +20,8 @@
 #ifndef _SERVICE_INFO_H
 #define _SERVICE_INFO_H
 
+#include <glib.h>
+
 typedef enum {
   AUTH_INVALID = 0,
   AUTH_USERNAME,
@@ -36,6 +38,9 @@ typedef struct {
   char *link;
   ServiceAuthType auth;
   char *icon;
+  /* For username and password services, where to check the details, if
+     anywhere.  See bisho-verify.c. */
+  char *verify_url;
   union {
     struct {
       char *consumer_key;
@@ -45,22 +50,38 @@ typedef struct {
       char *authorize_function;
       char *access_token_function;
       char *callback;
+      gboolean embedded_browser;
+      /* Where the login cookies worth remembering live, or NULL */
+      char **cookie_domains;
     } oauth;
     struct {
       char *api_key;
       char *shared_secret;
       char *frob;
+      char *base_url;
     } flickr;
     struct {
       char *app_id;
       char *secret;
       char *token;
+      char *base_url;
     } facebook;
   };
 } ServiceInfo;
 
+/* The hosts librest-extras and the login pages talk to, unless overridden */
+#define FLICKR_API_URL "http://api.flickr.com/services/rest/"
+#define FLICKR_AUTH_URL "http://flickr.com/services/auth/"
+#define FACEBOOK_API_URL   "http://api.facebook.com/restserver.php"
+#define FACEBOOK_LOGIN_URL "http://www.facebook.com/login.php"
+
+/* Where mojito keeps the settings for username and password services */
+#define SERVICE_INFO_GCONF_DIR "/apps/mojito/services"
+
 ServiceInfo * get_info_for_service (const char *name);
 
+GList * service_info_list_all (void);
+
 ServiceAuthType service_info_authtype_from_string (const char *s);
 
 #endif /* _SERVICE_INFO_H */
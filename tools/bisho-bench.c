@@ -0,0 +1,672 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Drive every kind of pane through logging in, validating the stored
+ * credentials and logging out against the mock server, and report how long
+ * each phase took.  Building and laying out a pane is timed as the construct
+ * phase, and where mallinfo() exists the heap one pane holds is reported as
+ * its memory.  The panes still need a display and a session bus, so run
+ * this as:
+ *
+ *   xvfb-run dbus-launch --exit-with-session ./bisho-bench
+ */
+
+#include <config.h>
+#include <string.h>
+#ifdef HAVE_MALLINFO
+#include <malloc.h>
+#endif
+#include <gtk/gtk.h>
+#include <libsoup/soup.h>
+#include "mock-server.h"
+#include "service-info.h"
+#include "bisho-pane.h"
+#include "bisho-pane-oauth.h"
+#include "bisho-pane-flickr.h"
+#include "bisho-pane-facebook.h"
+#include "bisho-pane-username.h"
+
+/* Give up on a phase after this many seconds */
+#define PHASE_TIMEOUT 30
+
+static const char *services[] = {
+  MOCK_SERVICE_OAUTH,
+  MOCK_SERVICE_OAUTH10,
+  MOCK_SERVICE_FLICKR,
+  MOCK_SERVICE_FACEBOOK,
+  MOCK_SERVICE_USERNAME,
+  MOCK_SERVICE_PASSWORD
+};
+
+static const char *phases[] = {
+  "construct",
+  "login",
+  "login-authorize",
+  "login-complete",
+  "validate",
+  "logout"
+};
+
+enum {
+  PHASE_CONSTRUCT,
+  PHASE_LOGIN,
+  PHASE_LOGIN_AUTHORIZE,
+  PHASE_LOGIN_COMPLETE,
+  PHASE_VALIDATE,
+  PHASE_LOGOUT,
+  N_PHASES
+};
+
+static int iterations = 20;
+static MockServerConfig config = { 0, 0, 0.0, 0 };
+static gboolean expand = FALSE;
+static char *output = NULL;
+
+static const GOptionEntry entries[] = {
+  { "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+    "Run each service N times (default: 20)", "N" },
+  { "latency", 'l', 0, G_OPTION_ARG_INT, &config.latency,
+    "Delay every server response by MS milliseconds", "MS" },
+  { "expand", 'x', 0, G_OPTION_ARG_NONE, &expand,
+    "Expand the panes before logging in, as a user would", NULL },
+  { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+    "Write the results to FILE instead of standard output", "FILE" },
+  { NULL }
+};
+
+typedef struct {
+  MockServer *server;
+  SoupSession *session;
+  MojitoClient *client;
+  GMainLoop *loop;
+
+  BishoPane *pane;
+  /* The state the current phase finishes in */
+  BishoPaneState target;
+  gboolean reached;
+  gboolean logging_in;
+  /* Parameters to continue the log in with, from the authorisation page */
+  GHashTable *params;
+
+  gint64 start;
+  gint64 authorized;
+
+  /* Milliseconds per phase, one array per service */
+  GArray *samples[G_N_ELEMENTS (services)][N_PHASES];
+  guint failures[G_N_ELEMENTS (services)][N_PHASES];
+  /* Heap bytes held by one laid out pane, or -1 if unknown */
+  gssize memory[G_N_ELEMENTS (services)];
+} Bench;
+
+static gpointer
+server_thread (gpointer data)
+{
+  GMainLoop *loop = data;
+
+  g_main_loop_run (loop);
+  return NULL;
+}
+
+static void
+add_sample (Bench *bench, guint service, guint phase, gint64 from, gint64 to)
+{
+  gdouble ms = (to - from) / 1000.0;
+
+  g_array_append_val (bench->samples[service][phase], ms);
+}
+
+/* Run everything that is ready, such as replies from the key file keyring */
+static void
+settle (void)
+{
+  while (g_main_context_pending (NULL))
+    g_main_context_iteration (NULL, FALSE);
+}
+
+static void
+find_widgets (GtkWidget *widget, gpointer data)
+{
+  GList **list = data;
+
+  if (GTK_IS_BUTTON (widget) || GTK_IS_ENTRY (widget))
+    *list = g_list_append (*list, widget);
+  else if (GTK_IS_CONTAINER (widget))
+    gtk_container_forall (GTK_CONTAINER (widget), find_widgets, data);
+}
+
+static GtkWidget *
+find_button (BishoPane *pane)
+{
+  GList *list = NULL, *l;
+  GtkWidget *button = NULL;
+
+  find_widgets (pane->content, &list);
+  for (l = list; l; l = l->next) {
+    if (GTK_IS_BUTTON (l->data)) {
+      button = l->data;
+      break;
+    }
+  }
+  g_list_free (list);
+
+  return button;
+}
+
+/* Type into every entry in a username pane and save it */
+static void
+fill_entries (BishoPane *pane, const char *text)
+{
+  GList *list = NULL, *l;
+
+  find_widgets (pane->content, &list);
+  for (l = list; l; l = l->next) {
+    if (GTK_IS_ENTRY (l->data))
+      gtk_entry_set_text (GTK_ENTRY (l->data), text);
+  }
+  g_list_free (list);
+
+  /* Save now rather than timing the pane's wait for more typing */
+  bisho_pane_set_expanded (pane, FALSE);
+}
+
+static SoupMessage *
+fetch (Bench *bench, const char *url, gboolean follow)
+{
+  SoupMessage *msg;
+
+  msg = soup_message_new (SOUP_METHOD_GET, url);
+  if (msg == NULL)
+    return NULL;
+
+  if (!follow)
+    soup_message_set_flags (msg, SOUP_MESSAGE_NO_REDIRECT);
+
+  soup_session_send_message (bench->session, msg);
+  return msg;
+}
+
+/* Point a URL on the real service at the same path on the mock server */
+static char *
+rewrite_url (Bench *bench, const char *url)
+{
+  SoupURI *uri;
+  char *base, *ret;
+
+  uri = soup_uri_new (url);
+  if (uri == NULL)
+    return g_strdup (url);
+
+  base = mock_server_get_url (bench->server, uri->path);
+  if (uri->query)
+    ret = g_strconcat (base, "?", uri->query, NULL);
+  else
+    ret = g_strdup (base);
+
+  g_free (base);
+  soup_uri_free (uri);
+  return ret;
+}
+
+/* Play the part of the user in the browser */
+static gboolean
+open_url_cb (BishoPane *pane, const char *url, gpointer user_data)
+{
+  Bench *bench = user_data;
+  SoupMessage *msg;
+  const char *body, *location;
+  char *real_url;
+
+  switch (pane->info->auth) {
+  case AUTH_OAUTH:
+    msg = fetch (bench, url, TRUE);
+    if (msg == NULL)
+      break;
+
+    /* The 1.0a "oob" page shows the verifier for the user to type in */
+    body = msg->response_body->data;
+    if (body && (body = strstr (body, "id=\"verifier\">"))) {
+      body += strlen ("id=\"verifier\">");
+      bench->params = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+      g_hash_table_insert (bench->params, g_strdup ("oauth_verifier"),
+                           g_strndup (body, strcspn (body, "<")));
+    }
+    g_object_unref (msg);
+    break;
+  case AUTH_FLICKR:
+    real_url = rewrite_url (bench, url);
+    msg = fetch (bench, real_url, TRUE);
+    if (msg)
+      g_object_unref (msg);
+    g_free (real_url);
+    break;
+  case AUTH_FACEBOOK:
+    /* The login page redirects to a URL with the session in the query */
+    real_url = rewrite_url (bench, url);
+    msg = fetch (bench, real_url, FALSE);
+    g_free (real_url);
+    if (msg == NULL)
+      break;
+
+    location = soup_message_headers_get_one (msg->response_headers, "Location");
+    if (location && strchr (location, '?'))
+      bench->params = soup_form_decode (strchr (location, '?') + 1);
+    g_object_unref (msg);
+    break;
+  default:
+    break;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+continue_cb (gpointer user_data)
+{
+  Bench *bench = user_data;
+
+  if (bench->params) {
+    bisho_pane_continue_auth (bench->pane, bench->params);
+    g_hash_table_destroy (bench->params);
+    bench->params = NULL;
+  } else {
+    gtk_button_clicked (GTK_BUTTON (find_button (bench->pane)));
+  }
+
+  return FALSE;
+}
+
+static void
+state_changed_cb (BishoPane *pane, BishoPaneState state, gpointer user_data)
+{
+  Bench *bench = user_data;
+
+  if (bench->logging_in && state == BISHO_PANE_STATE_CONTINUE_AUTH) {
+    bench->authorized = g_get_monotonic_time ();
+    /* Don't continue from inside the pane's own state change */
+    g_idle_add (continue_cb, bench);
+    return;
+  }
+
+  if (state == bench->target && !bench->reached) {
+    bench->reached = TRUE;
+    if (g_main_loop_is_running (bench->loop))
+      g_main_loop_quit (bench->loop);
+  }
+}
+
+static gboolean
+timeout_cb (gpointer user_data)
+{
+  Bench *bench = user_data;
+
+  g_main_loop_quit (bench->loop);
+  return FALSE;
+}
+
+static gboolean
+wait_for_state (Bench *bench)
+{
+  guint id;
+
+  if (!bench->reached) {
+    id = g_timeout_add_seconds (PHASE_TIMEOUT, timeout_cb, bench);
+    g_main_loop_run (bench->loop);
+    /* Otherwise the timeout has fired and removed itself */
+    if (bench->reached)
+      g_source_remove (id);
+  }
+
+  return bench->reached;
+}
+
+static void
+expect_state (Bench *bench, BishoPaneState state)
+{
+  bench->target = state;
+  bench->reached = FALSE;
+  bench->start = g_get_monotonic_time ();
+  bench->authorized = 0;
+}
+
+static BishoPane *
+create_pane (Bench *bench, ServiceInfo *info)
+{
+  GtkWidget *pane = NULL;
+
+  switch (info->auth) {
+  case AUTH_USERNAME:
+  case AUTH_USERNAME_PASSWORD:
+    pane = bisho_pane_username_new (info);
+    break;
+  case AUTH_OAUTH:
+    pane = bisho_pane_oauth_new (bench->client, info);
+    break;
+  case AUTH_FLICKR:
+    pane = bisho_pane_flickr_new (bench->client, info);
+    break;
+  case AUTH_FACEBOOK:
+    pane = bisho_pane_facebook_new (bench->client, info);
+    break;
+  case AUTH_INVALID:
+    return NULL;
+  }
+
+  g_object_ref_sink (pane);
+  g_signal_connect (pane, "state-changed", G_CALLBACK (state_changed_cb), bench);
+  g_signal_connect (pane, "open-url", G_CALLBACK (open_url_cb), bench);
+
+  /* The same entries as the window, added after connecting as they set the state */
+  if (info->auth == AUTH_USERNAME || info->auth == AUTH_USERNAME_PASSWORD)
+    bisho_pane_username_add_entry (BISHO_PANE_USERNAME (pane), "Username:", "user", TRUE);
+  if (info->auth == AUTH_USERNAME_PASSWORD)
+    bisho_pane_username_add_entry (BISHO_PANE_USERNAME (pane), "Password:", "password", FALSE);
+
+  return BISHO_PANE (pane);
+}
+
+/* Create a pane and lay it out, as the window does when it is shown */
+static BishoPane *
+construct_pane (Bench *bench, ServiceInfo *info)
+{
+  BishoPane *pane;
+  GtkRequisition requisition;
+  GtkAllocation allocation = { 0, 0, 800, 0 };
+
+  pane = create_pane (bench, info);
+  gtk_widget_size_request (GTK_WIDGET (pane), &requisition);
+  allocation.height = requisition.height;
+  gtk_widget_size_allocate (GTK_WIDGET (pane), &allocation);
+  /* The labels ask again once they know their width */
+  gtk_widget_size_request (GTK_WIDGET (pane), &requisition);
+
+  return pane;
+}
+
+static gssize
+get_heap_used (void)
+{
+#ifdef HAVE_MALLINFO
+  return mallinfo ().uordblks;
+#else
+  return -1;
+#endif
+}
+
+static void
+destroy_pane (Bench *bench)
+{
+  settle ();
+  gtk_widget_destroy (GTK_WIDGET (bench->pane));
+  g_object_unref (bench->pane);
+  bench->pane = NULL;
+}
+
+static void
+log_in (Bench *bench)
+{
+  if (bench->pane->info->auth == AUTH_USERNAME ||
+      bench->pane->info->auth == AUTH_USERNAME_PASSWORD)
+    fill_entries (bench->pane, "bisho-bench");
+  else
+    gtk_button_clicked (GTK_BUTTON (find_button (bench->pane)));
+}
+
+static void
+log_out (Bench *bench)
+{
+  if (bench->pane->info->auth == AUTH_USERNAME ||
+      bench->pane->info->auth == AUTH_USERNAME_PASSWORD)
+    fill_entries (bench->pane, "");
+  else
+    gtk_button_clicked (GTK_BUTTON (find_button (bench->pane)));
+}
+
+static void
+run_service (Bench *bench, guint index, ServiceInfo *info)
+{
+  gint64 end;
+
+  /* Log in */
+  expect_state (bench, BISHO_PANE_STATE_LOGGED_OUT);
+  bench->pane = construct_pane (bench, info);
+  add_sample (bench, index, PHASE_CONSTRUCT, bench->start, g_get_monotonic_time ());
+  settle ();
+
+  if (bisho_pane_get_state (bench->pane) == BISHO_PANE_STATE_LOGGED_IN) {
+    /* Left over from an earlier run */
+    expect_state (bench, BISHO_PANE_STATE_LOGGED_OUT);
+    log_out (bench);
+    wait_for_state (bench);
+    settle ();
+  }
+
+  if (expand)
+    bisho_pane_set_expanded (bench->pane, TRUE);
+
+  expect_state (bench, BISHO_PANE_STATE_LOGGED_IN);
+  bench->logging_in = TRUE;
+  log_in (bench);
+  if (wait_for_state (bench)) {
+    end = g_get_monotonic_time ();
+    add_sample (bench, index, PHASE_LOGIN, bench->start, end);
+    if (bench->authorized) {
+      add_sample (bench, index, PHASE_LOGIN_AUTHORIZE, bench->start, bench->authorized);
+      add_sample (bench, index, PHASE_LOGIN_COMPLETE, bench->authorized, end);
+    }
+  } else {
+    bench->failures[index][PHASE_LOGIN]++;
+  }
+  bench->logging_in = FALSE;
+  destroy_pane (bench);
+
+  /* Validate the stored credentials, as happens on start up */
+  expect_state (bench, BISHO_PANE_STATE_LOGGED_IN);
+  bench->pane = create_pane (bench, info);
+  if (wait_for_state (bench))
+    add_sample (bench, index, PHASE_VALIDATE, bench->start, g_get_monotonic_time ());
+  else
+    bench->failures[index][PHASE_VALIDATE]++;
+  settle ();
+
+  /* Log out */
+  expect_state (bench, BISHO_PANE_STATE_LOGGED_OUT);
+  log_out (bench);
+  if (wait_for_state (bench))
+    add_sample (bench, index, PHASE_LOGOUT, bench->start, g_get_monotonic_time ());
+  else
+    bench->failures[index][PHASE_LOGOUT]++;
+  destroy_pane (bench);
+}
+
+/* Measure the heap a pane holds once everything it uses has been set up */
+static void
+measure_service (Bench *bench, guint index, ServiceInfo *info)
+{
+  gssize before;
+
+  before = get_heap_used ();
+  if (before < 0) {
+    bench->memory[index] = -1;
+    return;
+  }
+
+  bench->pane = construct_pane (bench, info);
+  settle ();
+  bench->memory[index] = get_heap_used () - before;
+  destroy_pane (bench);
+}
+
+static int
+compare_doubles (gconstpointer a, gconstpointer b)
+{
+  gdouble x = *(const gdouble *)a, y = *(const gdouble *)b;
+
+  return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/* Nearest-rank percentile of a sorted array */
+static gdouble
+percentile (GArray *samples, guint p)
+{
+  guint rank;
+
+  rank = (p * samples->len + 99) / 100;
+  if (rank == 0)
+    rank = 1;
+
+  return g_array_index (samples, gdouble, rank - 1);
+}
+
+static char *
+format_results (Bench *bench)
+{
+  GString *s;
+  GArray *samples;
+  guint i, j;
+
+  s = g_string_new (NULL);
+  g_string_append_printf (s, "{\n  \"iterations\": %d,\n  \"latency\": %u,\n"
+                          "  \"expand\": %s,\n  \"services\": {\n",
+                          iterations, config.latency, expand ? "true" : "false");
+
+  for (i = 0; i < G_N_ELEMENTS (services); i++) {
+    g_string_append_printf (s, "    \"%s\": {\n", services[i]);
+    if (bench->memory[i] >= 0)
+      g_string_append_printf (s, "      \"memory\": %" G_GSSIZE_FORMAT ",\n", bench->memory[i]);
+
+    for (j = 0; j < N_PHASES; j++) {
+      samples = bench->samples[i][j];
+      g_array_sort (samples, compare_doubles);
+
+      g_string_append_printf (s, "      \"%s\": { \"count\": %u, \"failures\": %u",
+                              phases[j], samples->len, bench->failures[i][j]);
+      if (samples->len) {
+        g_string_append_printf (s, ", \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f",
+                                percentile (samples, 50),
+                                percentile (samples, 95),
+                                percentile (samples, 99));
+      }
+      g_string_append_printf (s, " }%s\n", j + 1 < N_PHASES ? "," : "");
+    }
+
+    g_string_append_printf (s, "    }%s\n", i + 1 < G_N_ELEMENTS (services) ? "," : "");
+  }
+
+  g_string_append (s, "  }\n}\n");
+
+  return g_string_free (s, FALSE);
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *context;
+  GMainContext *server_context;
+  GMainLoop *server_loop;
+  ServiceInfo *info[G_N_ELEMENTS (services)];
+  Bench bench;
+  char *dir, *path, *results;
+  GError *error = NULL;
+  guint i, j;
+  int n;
+
+#if !GLIB_CHECK_VERSION (2, 32, 0)
+  g_thread_init (NULL);
+#endif
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
+
+  context = g_option_context_new ("- time logging in to each kind of service");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gtk_get_option_group (TRUE));
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    return 1;
+  }
+  g_option_context_free (context);
+
+  memset (&bench, 0, sizeof (Bench));
+
+  /* The server answers from its own thread so the panes can block on it */
+  server_context = g_main_context_new ();
+  bench.server = mock_server_new (&config, server_context, &error);
+  if (bench.server == NULL) {
+    g_printerr ("Cannot start server: %s\n", error->message);
+    return 1;
+  }
+  server_loop = g_main_loop_new (server_context, FALSE);
+  g_thread_create (server_thread, server_loop, FALSE, NULL);
+
+  /* Point the service descriptions, API keys and keyring at the fixtures */
+  dir = g_build_filename (g_get_tmp_dir (), "bisho-bench-XXXXXX", NULL);
+  if (g_mkdtemp (dir) == NULL) {
+    g_printerr ("Cannot create %s\n", dir);
+    return 1;
+  }
+  if (!mock_server_write_fixtures (bench.server, dir, &error)) {
+    g_printerr ("Cannot write fixtures: %s\n", error->message);
+    return 1;
+  }
+
+  g_setenv ("XDG_DATA_DIRS", dir, TRUE);
+  path = g_build_filename (dir, "keystore", NULL);
+  g_setenv ("BISHO_KEYSTORE", path, TRUE);
+  g_free (path);
+  path = g_build_filename (dir, "keyring", NULL);
+  g_setenv ("BISHO_KEYRING_FILE", path, TRUE);
+  g_free (path);
+
+  gtk_init (&argc, &argv);
+
+  bench.session = soup_session_sync_new ();
+  bench.client = mojito_client_new ();
+  bench.loop = g_main_loop_new (NULL, FALSE);
+
+  for (i = 0; i < G_N_ELEMENTS (services); i++) {
+    info[i] = get_info_for_service (services[i]);
+    if (info[i] == NULL) {
+      g_printerr ("Cannot load service %s\n", services[i]);
+      return 1;
+    }
+    for (j = 0; j < N_PHASES; j++)
+      bench.samples[i][j] = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  }
+
+  for (n = 0; n < iterations; n++) {
+    for (i = 0; i < G_N_ELEMENTS (services); i++)
+      run_service (&bench, i, info[i]);
+  }
+
+  for (i = 0; i < G_N_ELEMENTS (services); i++)
+    measure_service (&bench, i, info[i]);
+
+  results = format_results (&bench);
+  if (output) {
+    if (!g_file_set_contents (output, results, -1, &error)) {
+      g_printerr ("Cannot write results: %s\n", error->message);
+      return 1;
+    }
+  } else {
+    g_print ("%s", results);
+  }
+  g_free (results);
+
+  g_main_loop_quit (server_loop);
+  return 0;
+}
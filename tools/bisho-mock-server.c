@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <glib.h>
+#include "mock-server.h"
+
+static MockServerConfig config = { 0, 0, 0.0, 0 };
+static char *fixtures = NULL;
+static char *cassette = NULL;
+static gdouble speed = 1.0;
+
+static const GOptionEntry entries[] = {
+  { "port", 'p', 0, G_OPTION_ARG_INT, &config.port,
+    "Port to listen on (default: any)", "PORT" },
+  { "latency", 'l', 0, G_OPTION_ARG_INT, &config.latency,
+    "Delay every response by MS milliseconds", "MS" },
+  { "error-rate", 'e', 0, G_OPTION_ARG_DOUBLE, &config.error_rate,
+    "Fail this fraction of requests with a 503", "RATE" },
+  { "clock-skew", 's', 0, G_OPTION_ARG_INT, &config.clock_skew,
+    "Run the server clock SECONDS ahead of the real one", "SECONDS" },
+  { "fixtures", 'f', 0, G_OPTION_ARG_FILENAME, &fixtures,
+    "Write service descriptions and a keystore to DIR", "DIR" },
+  { "replay", 'r', 0, G_OPTION_ARG_FILENAME, &cassette,
+    "Answer with the calls recorded in FILE by BISHO_RECORD", "FILE" },
+  { "speed", 'S', 0, G_OPTION_ARG_DOUBLE, &speed,
+    "Play recorded calls back FACTOR times faster, or 0 for no delay", "FACTOR" },
+  { NULL }
+};
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *context;
+  GMainLoop *loop;
+  MockServer *server;
+  GError *error = NULL;
+
+#if !GLIB_CHECK_VERSION (2, 32, 0)
+  g_thread_init (NULL);
+#endif
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
+
+  context = g_option_context_new ("- stand-in web services for bisho");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    return 1;
+  }
+  g_option_context_free (context);
+
+  server = mock_server_new (&config, NULL, &error);
+  if (server == NULL) {
+    g_printerr ("Cannot start server: %s\n", error->message);
+    return 1;
+  }
+
+  if (cassette) {
+    if (!mock_server_load_cassette (server, cassette, speed, &error)) {
+      g_printerr ("Cannot load cassette: %s\n", error->message);
+      return 1;
+    }
+  }
+
+  if (fixtures) {
+    if (!mock_server_write_fixtures (server, fixtures, &error)) {
+      g_printerr ("Cannot write fixtures: %s\n", error->message);
+      return 1;
+    }
+    g_print ("XDG_DATA_DIRS=%s BISHO_KEYSTORE=%s/keystore\n", fixtures, fixtures);
+  }
+
+  g_print ("Listening on http://127.0.0.1:%u/\n", mock_server_get_port (server));
+
+  loop = g_main_loop_new (NULL, FALSE);
+  g_main_loop_run (loop);
+
+  mock_server_free (server);
+  return 0;
+}
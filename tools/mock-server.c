@@ -0,0 +1,884 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A stand-in for the web services bisho talks to.  It implements just enough
+ * of OAuth 1.0 and 1.0a, the Flickr auth API and the old Facebook REST API for
+ * the panes to log in, validate their tokens and log out.  Any token it has
+ * handed out starts with "mock-", and tokens with that prefix are accepted
+ * even across restarts so that stored credentials stay valid.
+ *
+ * It can also play back a cassette of real responses recorded by bisho, so
+ * that a login against the real services can be repeated offline.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <libsoup/soup.h>
+#include "mock-server.h"
+
+/* How far apart client and server clocks may be before OAuth fails */
+#define MAX_CLOCK_SKEW 300
+
+#define CONSUMER_KEY    "mock-consumer-key"
+#define CONSUMER_SECRET "mock-consumer-secret"
+#define MOCK_USER_ID    "1234"
+#define MOCK_USER_NAME  "mockuser"
+#define MOCK_FULL_NAME  "Mock User"
+#define MOCK_PASSWORD   "mockpassword"
+
+struct _MockServer {
+  MockServerConfig config;
+  GMainContext *context;
+  SoupServer *server;
+  guint serial;
+  /* Hash of request token to RequestToken */
+  GHashTable *request_tokens;
+  /* Set of frobs that have been authorised */
+  GHashTable *frobs;
+  /* Recorded calls to play back, in order, and how fast to play them */
+  GPtrArray *cassette;
+  gdouble speed;
+};
+
+typedef struct {
+  char *service;
+  char *function;
+  guint status;
+  gdouble elapsed;
+  char *body;
+  gboolean played;
+} CassetteCall;
+
+typedef struct {
+  char *callback;
+  char *verifier;
+  gboolean authorized;
+} RequestToken;
+
+typedef struct {
+  MockServer *server;
+  SoupMessage *msg;
+} Delayed;
+
+static void
+request_token_free (gpointer data)
+{
+  RequestToken *token = data;
+
+  g_free (token->callback);
+  g_free (token->verifier);
+  g_slice_free (RequestToken, token);
+}
+
+static void
+cassette_call_free (gpointer data)
+{
+  CassetteCall *call = data;
+
+  g_free (call->service);
+  g_free (call->function);
+  g_free (call->body);
+  g_slice_free (CassetteCall, call);
+}
+
+static char *
+new_token (MockServer *server, const char *kind)
+{
+  return g_strdup_printf ("mock-%s-%u-%u", kind, ++server->serial, g_random_int ());
+}
+
+static gboolean
+is_mock_token (const char *token)
+{
+  return token && g_str_has_prefix (token, "mock-");
+}
+
+static void
+copy_param (gpointer key, gpointer value, gpointer user_data)
+{
+  g_hash_table_replace (user_data, g_strdup (key), g_strdup (value));
+}
+
+/*
+ * Collect the parameters of a request from the query, a form body and an
+ * OAuth Authorization header.
+ */
+static GHashTable *
+get_params (SoupMessage *msg, GHashTable *query)
+{
+  GHashTable *params, *form;
+  const char *auth;
+  char *body;
+
+  params = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  if (query)
+    g_hash_table_foreach (query, copy_param, params);
+
+  if (msg->request_body->length) {
+    body = g_strndup (msg->request_body->data, msg->request_body->length);
+    form = soup_form_decode (body);
+    g_hash_table_foreach (form, copy_param, params);
+    g_hash_table_destroy (form);
+    g_free (body);
+  }
+
+  auth = soup_message_headers_get_one (msg->request_headers, "Authorization");
+  if (auth && g_ascii_strncasecmp (auth, "OAuth ", 6) == 0) {
+    GHashTableIter iter;
+    gpointer key, value;
+
+    form = soup_header_parse_param_list (auth + 6);
+    g_hash_table_iter_init (&iter, form);
+    while (g_hash_table_iter_next (&iter, &key, &value)) {
+      if (value)
+        g_hash_table_replace (params, g_strdup (key), soup_uri_decode (value));
+    }
+    soup_header_free_param_list (form);
+  }
+
+  return params;
+}
+
+static void
+respond (SoupMessage *msg, guint status, const char *content_type, const char *body)
+{
+  soup_message_set_status (msg, status);
+  soup_message_set_response (msg, content_type, SOUP_MEMORY_COPY, body, strlen (body));
+}
+
+static void
+redirect (SoupMessage *msg, const char *location)
+{
+  soup_message_headers_replace (msg->response_headers, "Location", location);
+  soup_message_set_status (msg, SOUP_STATUS_FOUND);
+}
+
+static gboolean
+check_timestamp (MockServer *server, GHashTable *params)
+{
+  const char *timestamp;
+  glong server_now;
+
+  timestamp = g_hash_table_lookup (params, "oauth_timestamp");
+  if (timestamp == NULL)
+    return FALSE;
+
+  server_now = time (NULL) + server->config.clock_skew;
+  return ABS (server_now - atol (timestamp)) <= MAX_CLOCK_SKEW;
+}
+
+static gboolean
+check_consumer (SoupMessage *msg, MockServer *server, GHashTable *params)
+{
+  if (g_strcmp0 (g_hash_table_lookup (params, "oauth_consumer_key"), CONSUMER_KEY) != 0) {
+    respond (msg, SOUP_STATUS_UNAUTHORIZED, "text/plain",
+             "oauth_problem=consumer_key_unknown");
+    return FALSE;
+  }
+
+  if (!check_timestamp (server, params)) {
+    respond (msg, SOUP_STATUS_UNAUTHORIZED, "text/plain",
+             "oauth_problem=timestamp_refused");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* OAuth.  Paths are /oauth/<function> for 1.0a and /oauth10/<function> for 1.0 */
+static void
+handle_oauth (SoupMessage *msg, MockServer *server, const char *function,
+              gboolean is_10a, GHashTable *params)
+{
+  RequestToken *request;
+  const char *token;
+  char *body;
+
+  if (strcmp (function, "request_token") == 0) {
+    if (!check_consumer (msg, server, params))
+      return;
+
+    request = g_slice_new0 (RequestToken);
+    request->callback = g_strdup (g_hash_table_lookup (params, "oauth_callback"));
+    token = new_token (server, "request");
+    g_hash_table_insert (server->request_tokens, (char *) token, request);
+
+    body = soup_form_encode ("oauth_token", token,
+                             "oauth_token_secret", "mock-request-secret",
+                             is_10a ? "oauth_callback_confirmed" : NULL, "true",
+                             NULL);
+    respond (msg, SOUP_STATUS_OK, "application/x-www-form-urlencoded", body);
+    g_free (body);
+  } else if (strcmp (function, "authorize") == 0) {
+    const char *callback;
+
+    token = g_hash_table_lookup (params, "oauth_token");
+    request = token ? g_hash_table_lookup (server->request_tokens, token) : NULL;
+    if (request == NULL) {
+      respond (msg, SOUP_STATUS_BAD_REQUEST, "text/html",
+               "<html><body>Unknown request token</body></html>");
+      return;
+    }
+
+    request->authorized = TRUE;
+    request->verifier = g_strdup_printf ("%06u", g_random_int_range (0, 1000000));
+
+    /* 1.0 passes the callback to authorize, 1.0a passed it earlier */
+    callback = is_10a ? request->callback : g_hash_table_lookup (params, "oauth_callback");
+
+    if (callback && callback[0] && strcmp (callback, "oob") != 0) {
+      SoupURI *uri;
+      char *location;
+
+      uri = soup_uri_new (callback);
+      if (uri == NULL) {
+        respond (msg, SOUP_STATUS_BAD_REQUEST, "text/plain", "Invalid callback");
+        return;
+      }
+      soup_uri_set_query_from_fields (uri,
+                                      "oauth_token", token,
+                                      is_10a ? "oauth_verifier" : NULL, request->verifier,
+                                      NULL);
+      location = soup_uri_to_string (uri, FALSE);
+      redirect (msg, location);
+      g_free (location);
+      soup_uri_free (uri);
+    } else {
+      body = g_strdup_printf ("<html><body>Your code is <b id=\"verifier\">%s</b></body></html>",
+                              request->verifier);
+      respond (msg, SOUP_STATUS_OK, "text/html", body);
+      g_free (body);
+    }
+  } else if (strcmp (function, "access_token") == 0) {
+    if (!check_consumer (msg, server, params))
+      return;
+
+    token = g_hash_table_lookup (params, "oauth_token");
+    request = token ? g_hash_table_lookup (server->request_tokens, token) : NULL;
+    if (request == NULL || !request->authorized ||
+        (is_10a && g_strcmp0 (request->verifier,
+                              g_hash_table_lookup (params, "oauth_verifier")) != 0)) {
+      respond (msg, SOUP_STATUS_UNAUTHORIZED, "text/plain",
+               "oauth_problem=token_rejected");
+      return;
+    }
+    g_hash_table_remove (server->request_tokens, token);
+
+    token = new_token (server, "access");
+    body = soup_form_encode ("oauth_token", token,
+                             "oauth_token_secret", "mock-access-secret",
+                             NULL);
+    respond (msg, SOUP_STATUS_OK, "application/x-www-form-urlencoded", body);
+    g_free (body);
+    g_free ((char *) token);
+  } else {
+    soup_message_set_status (msg, SOUP_STATUS_NOT_FOUND);
+  }
+}
+
+static void
+flickr_error (SoupMessage *msg, int code, const char *message)
+{
+  char *body;
+
+  body = g_markup_printf_escaped ("<?xml version=\"1.0\" encoding=\"utf-8\" ?>\n"
+                                  "<rsp stat=\"fail\"><err code=\"%d\" msg=\"%s\" /></rsp>",
+                                  code, message);
+  respond (msg, SOUP_STATUS_OK, "text/xml", body);
+  g_free (body);
+}
+
+static void
+flickr_auth (SoupMessage *msg, const char *token)
+{
+  char *body;
+
+  body = g_markup_printf_escaped ("<?xml version=\"1.0\" encoding=\"utf-8\" ?>\n"
+                                  "<rsp stat=\"ok\"><auth>"
+                                  "<token>%s</token><perms>write</perms>"
+                                  "<user nsid=\"%s@N00\" username=\"%s\" fullname=\"%s\" />"
+                                  "</auth></rsp>",
+                                  token, MOCK_USER_ID, MOCK_USER_NAME, MOCK_FULL_NAME);
+  respond (msg, SOUP_STATUS_OK, "text/xml", body);
+  g_free (body);
+}
+
+/* Flickr: flickr.auth.getFrob, flickr.auth.getToken and flickr.auth.checkToken */
+static void
+handle_flickr (SoupMessage *msg, MockServer *server, GHashTable *params)
+{
+  const char *method, *frob;
+  char *body, *token;
+
+  if (g_strcmp0 (g_hash_table_lookup (params, "api_key"), CONSUMER_KEY) != 0) {
+    flickr_error (msg, 100, "Invalid API Key (Key not found)");
+    return;
+  }
+
+  method = g_hash_table_lookup (params, "method");
+
+  if (g_strcmp0 (method, "flickr.auth.getFrob") == 0) {
+    token = new_token (server, "frob");
+    body = g_strdup_printf ("<?xml version=\"1.0\" encoding=\"utf-8\" ?>\n"
+                            "<rsp stat=\"ok\"><frob>%s</frob></rsp>", token);
+    respond (msg, SOUP_STATUS_OK, "text/xml", body);
+    g_free (body);
+    g_free (token);
+  } else if (g_strcmp0 (method, "flickr.auth.getToken") == 0) {
+    frob = g_hash_table_lookup (params, "frob");
+    if (frob == NULL || !g_hash_table_remove (server->frobs, frob)) {
+      flickr_error (msg, 108, "Invalid frob");
+      return;
+    }
+    token = new_token (server, "flickr");
+    flickr_auth (msg, token);
+    g_free (token);
+  } else if (g_strcmp0 (method, "flickr.auth.checkToken") == 0) {
+    const char *auth_token = g_hash_table_lookup (params, "auth_token");
+
+    if (!is_mock_token (auth_token)) {
+      flickr_error (msg, 98, "Invalid auth token");
+      return;
+    }
+    flickr_auth (msg, auth_token);
+  } else {
+    flickr_error (msg, 112, "Method not found");
+  }
+}
+
+/* The page the user visits to authorise a frob */
+static void
+handle_flickr_auth (SoupMessage *msg, MockServer *server, GHashTable *params)
+{
+  const char *frob;
+
+  frob = g_hash_table_lookup (params, "frob");
+  if (!is_mock_token (frob)) {
+    respond (msg, SOUP_STATUS_BAD_REQUEST, "text/html",
+             "<html><body>Invalid frob</body></html>");
+    return;
+  }
+
+  g_hash_table_insert (server->frobs, g_strdup (frob), GINT_TO_POINTER (TRUE));
+  respond (msg, SOUP_STATUS_OK, "text/html",
+           "<html><body>You have authorised this application.</body></html>");
+}
+
+static void
+facebook_error (SoupMessage *msg, int code, const char *message)
+{
+  char *body;
+
+  body = g_markup_printf_escaped ("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                                  "<error_response><error_code>%d</error_code>"
+                                  "<error_msg>%s</error_msg></error_response>",
+                                  code, message);
+  respond (msg, SOUP_STATUS_OK, "text/xml", body);
+  g_free (body);
+}
+
+/* Facebook: users.getLoggedInUser and users.getInfo */
+static void
+handle_facebook (SoupMessage *msg, MockServer *server, GHashTable *params)
+{
+  const char *method;
+
+  if (g_strcmp0 (g_hash_table_lookup (params, "api_key"), CONSUMER_KEY) != 0) {
+    facebook_error (msg, 101, "Invalid API key");
+    return;
+  }
+
+  if (!is_mock_token (g_hash_table_lookup (params, "session_key"))) {
+    facebook_error (msg, 102, "Session key invalid or no longer valid");
+    return;
+  }
+
+  method = g_hash_table_lookup (params, "method");
+
+  if (g_strcmp0 (method, "users.getLoggedInUser") == 0 ||
+      g_strcmp0 (method, "facebook.users.getLoggedInUser") == 0) {
+    respond (msg, SOUP_STATUS_OK, "text/xml",
+             "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+             "<users_getLoggedInUser_response>" MOCK_USER_ID
+             "</users_getLoggedInUser_response>");
+  } else if (g_strcmp0 (method, "users.getInfo") == 0 ||
+             g_strcmp0 (method, "facebook.users.getInfo") == 0) {
+    respond (msg, SOUP_STATUS_OK, "text/xml",
+             "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+             "<users_getInfo_response list=\"true\"><user>"
+             "<uid>" MOCK_USER_ID "</uid><name>" MOCK_FULL_NAME "</name>"
+             "</user></users_getInfo_response>");
+  } else {
+    facebook_error (msg, 3, "Unknown method");
+  }
+}
+
+/*
+ * The Facebook Connect login page.  It redirects straight to the "next" URL
+ * (www.facebook.com by default, which is what the pane waits for) with a
+ * session.
+ */
+static void
+handle_facebook_login (SoupMessage *msg, MockServer *server, GHashTable *params)
+{
+  const char *next;
+  char *session_key, *session, *escaped, *location;
+
+  next = g_hash_table_lookup (params, "next");
+  if (next == NULL)
+    next = "http://www.facebook.com/";
+
+  session_key = new_token (server, "session");
+  session = g_strdup_printf ("{\"session_key\":\"%s\",\"uid\":\"%s\","
+                             "\"expires\":0,\"secret\":\"mock-session-secret\","
+                             "\"sig\":\"0\"}",
+                             session_key, MOCK_USER_ID);
+  escaped = soup_uri_encode (session, "&=+{}\",:");
+  location = g_strdup_printf ("%s%ssession=%s", next,
+                              strchr (next, '?') ? "&" : "?", escaped);
+  redirect (msg, location);
+
+  g_free (location);
+  g_free (escaped);
+  g_free (session);
+  g_free (session_key);
+}
+
+/*
+ * Stands in for the verification endpoint of the username and password
+ * services.  Only MOCK_USER_NAME exists, and a password, if sent, has to be
+ * MOCK_PASSWORD.
+ */
+static void
+handle_verify (SoupMessage *msg, MockServer *server, GHashTable *params)
+{
+  const char *auth;
+  char *encoded, *expected;
+  gboolean ok;
+
+  if (g_strcmp0 (g_hash_table_lookup (params, "user"), MOCK_USER_NAME) != 0) {
+    respond (msg, SOUP_STATUS_NOT_FOUND, "text/plain", "No such user");
+    return;
+  }
+
+  auth = soup_message_headers_get_one (msg->request_headers, "Authorization");
+  if (auth) {
+    encoded = g_base64_encode ((guchar *) MOCK_USER_NAME ":" MOCK_PASSWORD,
+                               strlen (MOCK_USER_NAME ":" MOCK_PASSWORD));
+    expected = g_strconcat ("Basic ", encoded, NULL);
+    ok = strcmp (auth, expected) == 0;
+    g_free (expected);
+    g_free (encoded);
+
+    if (!ok) {
+      respond (msg, SOUP_STATUS_UNAUTHORIZED, "text/plain", "Wrong password");
+      return;
+    }
+  }
+
+  respond (msg, SOUP_STATUS_OK, "text/plain", MOCK_USER_NAME);
+}
+
+/* The last part of an OAuth function, which may be a path such as oauth/request_token */
+static const char *
+function_name (const char *function)
+{
+  const char *slash;
+
+  slash = strrchr (function, '/');
+  return slash ? slash + 1 : function;
+}
+
+/*
+ * Answer from the cassette if it has an unplayed call to the same function.
+ * Returns the number of milliseconds to hold the response back for, or -1 if
+ * the request should be handled as usual.
+ */
+static int
+replay (MockServer *server, SoupMessage *msg, const char *path, GHashTable *params)
+{
+  CassetteCall *call;
+  const char *service, *function, *content_type;
+  guint i;
+
+  if (g_str_has_prefix (path, "/oauth/") || g_str_has_prefix (path, "/oauth10/")) {
+    service = "oauth";
+    function = function_name (path);
+    content_type = "application/x-www-form-urlencoded";
+  } else if (strcmp (path, "/services/rest/") == 0) {
+    service = "flickr";
+    function = g_hash_table_lookup (params, "method");
+    content_type = "text/xml";
+  } else if (strcmp (path, "/restserver.php") == 0) {
+    service = "facebook";
+    function = g_hash_table_lookup (params, "method");
+    content_type = "text/xml";
+  } else {
+    return -1;
+  }
+
+  if (function == NULL)
+    return -1;
+
+  for (i = 0; i < server->cassette->len; i++) {
+    call = g_ptr_array_index (server->cassette, i);
+
+    if (call->played ||
+        strcmp (call->service, service) != 0 ||
+        strcmp (function_name (call->function), function) != 0)
+      continue;
+
+    call->played = TRUE;
+    /* A recorded network failure has no status, the closest we can do is a 503 */
+    respond (msg, call->status ?: SOUP_STATUS_SERVICE_UNAVAILABLE, content_type, call->body);
+
+    if (server->speed <= 0)
+      return 0;
+    return call->elapsed / server->speed;
+  }
+
+  return -1;
+}
+
+static guint
+dispatch (MockServer *server, SoupMessage *msg, const char *path, GHashTable *query)
+{
+  GHashTable *params;
+  int delay;
+
+  if (server->config.error_rate > 0 &&
+      g_random_double () < server->config.error_rate) {
+    respond (msg, SOUP_STATUS_SERVICE_UNAVAILABLE, "text/plain",
+             "Service temporarily unavailable");
+    return 0;
+  }
+
+  params = get_params (msg, query);
+
+  if (server->cassette) {
+    delay = replay (server, msg, path, params);
+    if (delay >= 0) {
+      g_hash_table_destroy (params);
+      return delay;
+    }
+  }
+
+  if (g_str_has_prefix (path, "/oauth/")) {
+    handle_oauth (msg, server, path + strlen ("/oauth/"), TRUE, params);
+  } else if (g_str_has_prefix (path, "/oauth10/")) {
+    handle_oauth (msg, server, path + strlen ("/oauth10/"), FALSE, params);
+  } else if (strcmp (path, "/services/rest/") == 0) {
+    handle_flickr (msg, server, params);
+  } else if (strcmp (path, "/services/auth/") == 0) {
+    handle_flickr_auth (msg, server, params);
+  } else if (strcmp (path, "/restserver.php") == 0) {
+    handle_facebook (msg, server, params);
+  } else if (strcmp (path, "/login.php") == 0) {
+    handle_facebook_login (msg, server, params);
+  } else if (strcmp (path, "/verify") == 0) {
+    handle_verify (msg, server, params);
+  } else {
+    soup_message_set_status (msg, SOUP_STATUS_NOT_FOUND);
+  }
+
+  g_hash_table_destroy (params);
+  return 0;
+}
+
+static gboolean
+delayed_cb (gpointer user_data)
+{
+  Delayed *delayed = user_data;
+
+  soup_server_unpause_message (delayed->server->server, delayed->msg);
+  g_object_unref (delayed->msg);
+  g_slice_free (Delayed, delayed);
+
+  return FALSE;
+}
+
+static void
+server_cb (SoupServer *soup_server, SoupMessage *msg, const char *path,
+           GHashTable *query, SoupClientContext *client, gpointer user_data)
+{
+  MockServer *server = user_data;
+  Delayed *delayed;
+  GSource *source;
+  guint delay;
+
+  delay = dispatch (server, msg, path, query) + server->config.latency;
+
+  if (delay == 0)
+    return;
+
+  /* Hold the response back to simulate a slow network */
+  delayed = g_slice_new (Delayed);
+  delayed->server = server;
+  delayed->msg = g_object_ref (msg);
+  soup_server_pause_message (soup_server, msg);
+
+  source = g_timeout_source_new (delay);
+  g_source_set_callback (source, delayed_cb, delayed, NULL);
+  g_source_attach (source, server->context);
+  g_source_unref (source);
+}
+
+/*
+ * Start a server.  Requests are handled in @context, which may be NULL for the
+ * default main context.
+ */
+MockServer *
+mock_server_new (const MockServerConfig *config, GMainContext *context, GError **error)
+{
+  MockServer *server;
+  SoupAddress *address;
+
+  g_return_val_if_fail (config, NULL);
+
+  server = g_slice_new0 (MockServer);
+  server->config = *config;
+  server->context = context ? g_main_context_ref (context) : g_main_context_ref (g_main_context_default ());
+  server->request_tokens = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, request_token_free);
+  server->frobs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  /* Only listen on loopback, nothing else should reach a test server */
+  address = soup_address_new ("127.0.0.1", config->port);
+  soup_address_resolve_sync (address, NULL);
+
+  server->server = soup_server_new (SOUP_SERVER_INTERFACE, address,
+                                    SOUP_SERVER_ASYNC_CONTEXT, server->context,
+                                    NULL);
+  g_object_unref (address);
+  if (server->server == NULL) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                 "Cannot listen on port %u", config->port);
+    mock_server_free (server);
+    return NULL;
+  }
+
+  soup_server_add_handler (server->server, NULL, server_cb, server, NULL);
+  soup_server_run_async (server->server);
+
+  return server;
+}
+
+/*
+ * Play back the calls in a cassette recorded with BISHO_RECORD.  Each call is
+ * answered once, in the order recorded, after the time it originally took
+ * divided by @speed, or straight away if @speed is 0.  Requests the cassette
+ * has no answer for are handled as usual.
+ */
+gboolean
+mock_server_load_cassette (MockServer *server, const char *path,
+                           gdouble speed, GError **error)
+{
+  GKeyFile *keys;
+  CassetteCall *call;
+  char *group;
+  guint i, n;
+
+  g_return_val_if_fail (server, FALSE);
+  g_return_val_if_fail (path, FALSE);
+
+  keys = g_key_file_new ();
+  if (!g_key_file_load_from_file (keys, path, G_KEY_FILE_NONE, error)) {
+    g_key_file_free (keys);
+    return FALSE;
+  }
+
+  /* See bisho-cassette.h for the format */
+  n = g_key_file_get_integer (keys, "Cassette", "Calls", NULL);
+
+  if (server->cassette)
+    g_ptr_array_free (server->cassette, TRUE);
+  server->cassette = g_ptr_array_new_with_free_func (cassette_call_free);
+  server->speed = speed;
+
+  for (i = 0; i < n; i++) {
+    group = g_strdup_printf ("Call %u", i);
+    if (g_key_file_has_group (keys, group)) {
+      call = g_slice_new0 (CassetteCall);
+      call->service = g_key_file_get_string (keys, group, "Service", NULL);
+      call->function = g_key_file_get_string (keys, group, "Function", NULL);
+      call->status = g_key_file_get_integer (keys, group, "Status", NULL);
+      call->elapsed = g_key_file_get_double (keys, group, "Elapsed", NULL);
+      call->body = g_key_file_get_string (keys, group, "Body", NULL);
+
+      if (call->service && call->function && call->body)
+        g_ptr_array_add (server->cassette, call);
+      else
+        cassette_call_free (call);
+    }
+    g_free (group);
+  }
+
+  g_key_file_free (keys);
+  return TRUE;
+}
+
+guint
+mock_server_get_port (MockServer *server)
+{
+  return soup_server_get_port (server->server);
+}
+
+char *
+mock_server_get_url (MockServer *server, const char *path)
+{
+  return g_strdup_printf ("http://127.0.0.1:%u%s", mock_server_get_port (server), path);
+}
+
+static gboolean
+write_keys (MockServer *server, const char *directory, const char *name,
+            const char *display_name, const char *auth, const char *group,
+            const char *extra, GError **error)
+{
+  char *filename, *path, *contents;
+  gboolean ret;
+
+  contents = g_strdup_printf ("[MojitoService]\n"
+                              "Name=%s\n"
+                              "Description=A stand-in service for testing bisho.\n"
+                              "AuthType=%s\n"
+                              "\n"
+                              "%s%s%s\n"
+                              "%s",
+                              display_name, auth,
+                              group ? "[" : "", group ?: "", group ? "]" : "",
+                              extra ?: "");
+
+  filename = g_strconcat (name, ".keys", NULL);
+  path = g_build_filename (directory, "mojito", "services", filename, NULL);
+  ret = g_file_set_contents (path, contents, -1, error);
+
+  g_free (path);
+  g_free (filename);
+  g_free (contents);
+  return ret;
+}
+
+/*
+ * Write service descriptions pointing at this server, and a keystore with
+ * their API keys.  Run bisho with XDG_DATA_DIRS=@directory and
+ * BISHO_KEYSTORE=@directory/keystore to use them.
+ */
+gboolean
+mock_server_write_fixtures (MockServer *server, const char *directory, GError **error)
+{
+  const char *services[] = { MOCK_SERVICE_OAUTH, MOCK_SERVICE_OAUTH10,
+                             MOCK_SERVICE_FLICKR, MOCK_SERVICE_FACEBOOK };
+  char *dir, *extra, *url;
+  GString *keystore;
+  gboolean ret = FALSE;
+  guint i;
+
+  dir = g_build_filename (directory, "mojito", "services", NULL);
+  if (g_mkdir_with_parents (dir, 0755) != 0) {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                 "Cannot create %s", dir);
+    g_free (dir);
+    return FALSE;
+  }
+  g_free (dir);
+
+  url = mock_server_get_url (server, "/oauth/");
+  extra = g_strdup_printf ("BaseURL=%s\n"
+                           "RequestTokenFunction=request_token\n"
+                           "AuthoriseFunction=authorize\n"
+                           "AccessTokenFunction=access_token\n"
+                           "Callback=oob\n", url);
+  g_free (url);
+  if (!write_keys (server, directory, MOCK_SERVICE_OAUTH, "Mock OAuth 1.0a",
+                   "oauth", "OAuth", extra, error))
+    goto done;
+  g_free (extra);
+
+  url = mock_server_get_url (server, "/oauth10/");
+  extra = g_strdup_printf ("BaseURL=%s\n"
+                           "RequestTokenFunction=request_token\n"
+                           "AuthoriseFunction=authorize\n"
+                           "AccessTokenFunction=access_token\n", url);
+  g_free (url);
+  if (!write_keys (server, directory, MOCK_SERVICE_OAUTH10, "Mock OAuth 1.0",
+                   "oauth", "OAuth", extra, error))
+    goto done;
+  g_free (extra);
+
+  url = mock_server_get_url (server, "/services/rest/");
+  extra = g_strdup_printf ("BaseURL=%s\n", url);
+  g_free (url);
+  if (!write_keys (server, directory, MOCK_SERVICE_FLICKR, "Mock Flickr",
+                   "flickr", "Flickr", extra, error))
+    goto done;
+  g_free (extra);
+
+  url = mock_server_get_url (server, "/restserver.php");
+  extra = g_strdup_printf ("BaseURL=%s\n", url);
+  g_free (url);
+  if (!write_keys (server, directory, MOCK_SERVICE_FACEBOOK, "Mock Facebook",
+                   "facebook", "Facebook", extra, error))
+    goto done;
+  g_free (extra);
+
+  url = mock_server_get_url (server, "/verify");
+  extra = g_strdup_printf ("URL=%s?user={user}\n", url);
+  g_free (url);
+  if (!write_keys (server, directory, MOCK_SERVICE_USERNAME, "Mock Username",
+                   "username", "Verify", extra, error))
+    goto done;
+  if (!write_keys (server, directory, MOCK_SERVICE_PASSWORD, "Mock Password",
+                   "password", "Verify", extra, error))
+    goto done;
+  g_free (extra);
+  extra = NULL;
+
+  keystore = g_string_new (NULL);
+  for (i = 0; i < G_N_ELEMENTS (services); i++) {
+    g_string_append_printf (keystore, "[%s]\nKey=%s\nSecret=%s\n\n",
+                            services[i], CONSUMER_KEY, CONSUMER_SECRET);
+  }
+  dir = g_build_filename (directory, "keystore", NULL);
+  ret = g_file_set_contents (dir, keystore->str, keystore->len, error);
+  g_free (dir);
+  g_string_free (keystore, TRUE);
+
+ done:
+  g_free (extra);
+  return ret;
+}
+
+void
+mock_server_free (MockServer *server)
+{
+  if (server->server) {
+    soup_server_quit (server->server);
+    g_object_unref (server->server);
+  }
+  g_hash_table_destroy (server->request_tokens);
+  g_hash_table_destroy (server->frobs);
+  if (server->cassette)
+    g_ptr_array_free (server->cassette, TRUE);
+  g_main_context_unref (server->context);
+  g_slice_free (MockServer, server);
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MOCK_SERVER_H__
+#define __MOCK_SERVER_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Names of the services described by the generated fixtures */
+#define MOCK_SERVICE_OAUTH    "mockoauth"
+#define MOCK_SERVICE_OAUTH10  "mockoauth10"
+#define MOCK_SERVICE_FLICKR   "mockflickr"
+#define MOCK_SERVICE_FACEBOOK "mockfacebook"
+#define MOCK_SERVICE_USERNAME "mockusername"
+#define MOCK_SERVICE_PASSWORD "mockpassword"
+
+typedef struct {
+  /* Port to listen on, or 0 to pick one */
+  guint port;
+  /* Milliseconds added to every response */
+  guint latency;
+  /* Fraction of requests, between 0 and 1, that fail with a 503 */
+  gdouble error_rate;
+  /* Seconds the server's clock is ahead of (or behind) the client's */
+  gint clock_skew;
+} MockServerConfig;
+
+typedef struct _MockServer MockServer;
+
+MockServer * mock_server_new (const MockServerConfig *config,
+                              GMainContext *context,
+                              GError **error);
+
+guint mock_server_get_port (MockServer *server);
+
+gboolean mock_server_load_cassette (MockServer *server,
+                                    const char *path,
+                                    gdouble speed,
+                                    GError **error);
+
+char * mock_server_get_url (MockServer *server, const char *path);
+
+gboolean mock_server_write_fixtures (MockServer *server,
+                                     const char *directory,
+                                     GError **error);
+
+void mock_server_free (MockServer *server);
+
+G_END_DECLS
+
+#endif /* __MOCK_SERVER_H__ */